@@ -0,0 +1,357 @@
+/* Generic filter interface */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "autofilter.h"
+#include "rtprofile.h"
+
+
+// Names of filter types (indexed by enum FilterType)
+static const char* FILTER_NAMES[] = {
+    "echo",
+    "lms",
+    "lms-sparse",
+    "lms-f32",
+    "lms-mixed",
+    "lms-delayed",
+    "bank",
+    "lowrank",
+    "lms-masked"
+};
+
+// Number of filter types
+#define N_FILTER_TYPES (sizeof(FILTER_NAMES) / sizeof(FILTER_NAMES[0]))
+
+
+// Look up filter type by name
+int FilterAuto_parse_type(const char* name, enum FilterType* type) {
+
+    for (int i = 0; i < (int) N_FILTER_TYPES; i++) {
+        if (strcmp(name, FILTER_NAMES[i]) == 0) {
+            *type = (enum FilterType) i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+// Name of filter type
+const char* FilterAuto_type_name(enum FilterType type) {
+
+    return FILTER_NAMES[type];
+}
+
+
+// Constructor for FilterAuto object
+int FilterAuto_new(struct FilterAuto* flt, enum FilterType type, int dim, struct FilterParams* params) {
+
+    flt->use_engine = 0;
+
+    switch (type) {
+        case FILTER_ECHO:
+            FilterAutoEcho_new(&flt->echo, dim);
+            flt->x_pred = flt->echo.x_pred;
+            break;
+        case FILTER_LMS:
+            FilterAutoLMS_new(&flt->lms, dim, params->order, params->mu);
+            flt->x_pred = flt->lms.x_pred;
+            break;
+        case FILTER_LMS_SPARSE:
+            FilterAutoLMS_new_sparse(&flt->lms, dim, params->order, params->mu);
+            flt->x_pred = flt->lms.x_pred;
+            break;
+        case FILTER_LMS_F32:
+        case FILTER_LMS_MIXED:
+            FilterAutoLMS32_new(&flt->lms32, dim, params->order, params->mu, type == FILTER_LMS_MIXED);
+            flt->x_pred = flt->lms32.x_pred;
+            break;
+        case FILTER_LMS_DELAYED:
+            if (FilterAutoLMSDelayed_new(&flt->delayed, dim, params->order, params->mu, params->first_cpu) != 0) {
+                return 1;
+            }
+            flt->x_pred = flt->delayed.x_pred;
+            break;
+        case FILTER_BANK:
+            if (FilterAutoBank_new(&flt->bank, dim, params->bank_spec, params->mu, params->order,
+                    params->bank_blend) != 0) {
+                return 1;
+            }
+            flt->x_pred = flt->bank.x_pred;
+            break;
+        case FILTER_LOWRANK:
+            if (params->rank < 1) {
+                fprintf(stderr, "Rank of low-rank LMS must be at least 1 (got %d)\n", params->rank);
+                return 1;
+            }
+            FilterAutoLowRank_new(&flt->lowrank, dim, params->order, params->rank, params->mu);
+            flt->x_pred = flt->lowrank.x_pred;
+            break;
+        case FILTER_LMS_MASKED:
+            if (FilterAutoLMSMasked_new(&flt->masked, dim, params->order, params->mu, params->mask_fpath,
+                    params->n_nearest) != 0) {
+                return 1;
+            }
+            flt->x_pred = flt->masked.x_pred;
+            break;
+    }
+
+    // Populate fields
+    flt->type = type;
+    flt->dim = dim;
+
+    // Split LMS updates across threads if requested
+    if ((type == FILTER_LMS || type == FILTER_LMS_SPARSE) && params->n_threads > 1) {
+        if (EngineLMS_new(&flt->engine, &flt->lms, params->n_threads, params->first_cpu) != 0) {
+            FilterAuto_delete(flt);
+            return 1;
+        }
+        flt->use_engine = 1;
+    }
+
+    return 0;
+}
+
+
+// Destructor for FilterAuto object
+void FilterAuto_delete(struct FilterAuto* flt) {
+
+    if (flt->use_engine) {
+        EngineLMS_delete(&flt->engine);
+        flt->use_engine = 0;
+    }
+
+    switch (flt->type) {
+        case FILTER_ECHO:
+            FilterAutoEcho_delete(&flt->echo);
+            break;
+        case FILTER_LMS:
+        case FILTER_LMS_SPARSE:
+            FilterAutoLMS_delete(&flt->lms);
+            break;
+        case FILTER_LMS_F32:
+        case FILTER_LMS_MIXED:
+            FilterAutoLMS32_delete(&flt->lms32);
+            break;
+        case FILTER_LMS_DELAYED:
+            FilterAutoLMSDelayed_delete(&flt->delayed);
+            break;
+        case FILTER_BANK:
+            FilterAutoBank_delete(&flt->bank);
+            break;
+        case FILTER_LOWRANK:
+            FilterAutoLowRank_delete(&flt->lowrank);
+            break;
+        case FILTER_LMS_MASKED:
+            FilterAutoLMSMasked_delete(&flt->masked);
+            break;
+    }
+}
+
+
+// Update filter with new signal value and predict next value
+void FilterAuto_predict_next(struct FilterAuto* flt, double* x) {
+
+    switch (flt->type) {
+        case FILTER_ECHO:
+            FilterAutoEcho_predict_next(&flt->echo, x);
+            break;
+        case FILTER_LMS:
+        case FILTER_LMS_SPARSE:
+            if (flt->use_engine) {
+                EngineLMS_predict_next(&flt->engine, x);
+            }
+            else {
+                FilterAutoLMS_predict_next(&flt->lms, x);
+            }
+            break;
+        case FILTER_LMS_F32:
+        case FILTER_LMS_MIXED:
+            FilterAutoLMS32_predict_next(&flt->lms32, x);
+            break;
+        case FILTER_LMS_DELAYED:
+            FilterAutoLMSDelayed_predict_next(&flt->delayed, x);
+            break;
+        case FILTER_BANK:
+            FilterAutoBank_predict_next(&flt->bank, x);
+            break;
+        case FILTER_LOWRANK:
+            FilterAutoLowRank_predict_next(&flt->lowrank, x);
+            break;
+        case FILTER_LMS_MASKED:
+            FilterAutoLMSMasked_predict_next(&flt->masked, x);
+            break;
+    }
+}
+
+
+// Update filter with block of signal values and predict after each
+void FilterAuto_predict_block(struct FilterAuto* flt, double* x, int n, double* preds) {
+
+    // Threaded engine splits single steps, so it takes blocks one step at a
+    // time
+    if ((flt->type == FILTER_LMS || flt->type == FILTER_LMS_SPARSE) && !flt->use_engine) {
+        FilterAutoLMS_predict_block(&flt->lms, x, n, preds);
+        return;
+    }
+
+    for (int t = 0; t < n; t++) {
+        FilterAuto_predict_next(flt, x + (size_t) t * flt->dim);
+        memcpy(preds + (size_t) t * flt->dim, flt->x_pred, flt->dim * sizeof(double));
+    }
+}
+
+
+// Touch buffer and count its bytes
+static size_t prefault(void* buf, size_t bytes) {
+
+    rt_prefault(buf, bytes);
+    return bytes;
+}
+
+
+// Touch every page of filter's buffers
+size_t FilterAuto_prefault(struct FilterAuto* flt) {
+
+    size_t n = 0;
+    int dim = flt->dim;
+
+    switch (flt->type) {
+        case FILTER_ECHO:
+            n += prefault(flt->echo.x_pred, dim * sizeof(double));
+            break;
+        case FILTER_LMS:
+        case FILTER_LMS_SPARSE:
+            n += prefault(flt->lms.wts, (size_t) dim * flt->lms.hist_size * sizeof(double));
+            n += prefault(flt->lms.x_hist, flt->lms.hist_size * sizeof(double));
+            n += prefault(flt->lms.x_pred, dim * sizeof(double));
+            n += prefault(flt->lms.x_err, dim * sizeof(double));
+            break;
+        case FILTER_LMS_F32:
+        case FILTER_LMS_MIXED:
+            n += prefault(flt->lms32.wts, (size_t) dim * flt->lms32.hist_size * sizeof(float));
+            n += prefault(flt->lms32.x_hist, flt->lms32.hist_size * sizeof(float));
+            n += prefault(flt->lms32.x_new, dim * sizeof(float));
+            n += prefault(flt->lms32.x_pred, dim * sizeof(double));
+            n += prefault(flt->lms32.x_err, dim * sizeof(double));
+            break;
+        case FILTER_LMS_DELAYED:
+            n += prefault(flt->delayed.wts[0], (size_t) dim * flt->delayed.hist_size * sizeof(double));
+            n += prefault(flt->delayed.wts[1], (size_t) dim * flt->delayed.hist_size * sizeof(double));
+            n += prefault(flt->delayed.x_hist, flt->delayed.hist_size * sizeof(double));
+            n += prefault(flt->delayed.x_pred, dim * sizeof(double));
+            break;
+        case FILTER_BANK:
+            n += prefault(flt->bank.wts, flt->bank.n_wts * sizeof(double));
+            n += prefault(flt->bank.preds, flt->bank.n_filters * dim * sizeof(double));
+            n += prefault(flt->bank.errs, flt->bank.n_filters * dim * sizeof(double));
+            n += prefault(flt->bank.x_hist, flt->bank.hist_size * sizeof(double));
+            n += prefault(flt->bank.x_pred, dim * sizeof(double));
+            break;
+        case FILTER_LOWRANK:
+            n += prefault(flt->lowrank.u, (size_t) dim * flt->lowrank.rank * sizeof(double));
+            n += prefault(flt->lowrank.v, (size_t) flt->lowrank.rank * flt->lowrank.hist_size * sizeof(double));
+            n += prefault(flt->lowrank.x_hist, flt->lowrank.hist_size * sizeof(double));
+            n += prefault(flt->lowrank.x_pred, dim * sizeof(double));
+            n += prefault(flt->lowrank.x_err, dim * sizeof(double));
+            break;
+        case FILTER_LMS_MASKED:
+            n += prefault(flt->masked.wts, (size_t) flt->masked.n_conn * flt->masked.order * sizeof(double));
+            n += prefault(flt->masked.x_hist, (size_t) dim * flt->masked.order * sizeof(double));
+            n += prefault(flt->masked.x_pred, dim * sizeof(double));
+            n += prefault(flt->masked.x_err, dim * sizeof(double));
+            break;
+    }
+
+    return n;
+}
+
+
+// Print statistics kept by filter
+void FilterAuto_print_stats(struct FilterAuto* flt) {
+
+    if (flt->type == FILTER_LMS_DELAYED) {
+        FilterAutoLMSDelayed_print_stats(&flt->delayed);
+    }
+    else if (flt->type == FILTER_BANK) {
+        FilterAutoBank_print_stats(&flt->bank);
+    }
+    else if (flt->type == FILTER_LOWRANK) {
+        FilterAutoLowRank_print_stats(&flt->lowrank);
+    }
+    else if (flt->type == FILTER_LMS_MASKED) {
+        FilterAutoLMSMasked_print_stats(&flt->masked);
+    }
+}
+
+
+// Constructor for FilterCompare object
+void FilterCompare_new(struct FilterCompare* cmp, int dim, struct FilterParams* params) {
+
+    FilterAutoLMS_new(&cmp->ref, dim, params->order, params->mu);
+
+    cmp->pred_prev = (double *) malloc(dim * sizeof(double));
+    for (int i = 0; i < dim; i++) {
+        cmp->pred_prev[i] = 0.0;
+    }
+
+    // Populate fields
+    cmp->dim = dim;
+    cmp->n_steps = 0;
+    cmp->max_drift = 0.0;
+    cmp->sse_drift = 0.0;
+    cmp->sse_flt = 0.0;
+    cmp->sse_ref = 0.0;
+}
+
+
+// Destructor for FilterCompare object
+void FilterCompare_delete(struct FilterCompare* cmp) {
+
+    free(cmp->pred_prev);
+    FilterAutoLMS_delete(&cmp->ref);
+}
+
+
+// Update reference filter and compare predictions
+void FilterCompare_update(struct FilterCompare* cmp, double* x, double* x_pred) {
+
+    // Accumulate errors of predictions made on previous step
+    for (int i = 0; i < cmp->dim; i++) {
+        double e_flt = x[i] - cmp->pred_prev[i];
+        double e_ref = x[i] - cmp->ref.x_pred[i];
+        cmp->sse_flt += e_flt * e_flt;
+        cmp->sse_ref += e_ref * e_ref;
+    }
+
+    // Update reference filter and accumulate drift of new predictions
+    FilterAutoLMS_predict_next(&cmp->ref, x);
+    for (int i = 0; i < cmp->dim; i++) {
+        double d = x_pred[i] - cmp->ref.x_pred[i];
+        cmp->sse_drift += d * d;
+        if (fabs(d) > cmp->max_drift) {
+            cmp->max_drift = fabs(d);
+        }
+        cmp->pred_prev[i] = x_pred[i];
+    }
+
+    cmp->n_steps++;
+}
+
+
+// Print summary of comparison
+void FilterCompare_print(struct FilterCompare* cmp) {
+
+    double n = (double) cmp->n_steps * cmp->dim;
+    if (n == 0) {
+        return;
+    }
+
+    printf("Drift from double-precision LMS: max %g, RMS %g\n",
+        cmp->max_drift, sqrt(cmp->sse_drift / n));
+    printf("Prediction MSE: %g (reference: %g)\n", cmp->sse_flt / n, cmp->sse_ref / n);
+}
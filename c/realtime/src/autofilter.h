@@ -0,0 +1,172 @@
+/* Header file for generic filter interface */
+
+
+#ifndef _AUTOFILTER_H
+#define _AUTOFILTER_H
+
+#include <stddef.h>
+
+#include "filters.h"
+#include "engine.h"
+#include "delayed.h"
+#include "bank.h"
+#include "lowrank.h"
+#include "masked.h"
+
+
+/* Generic autoregressive filter
+ *
+ * Wraps one of the filters in filters.h behind a common interface, like the
+ * FilterAuto trait in the Rust prototype, so that the processor can select a
+ * filter by name without knowing which struct implements it.
+ */
+
+// Types of filter that can be selected by name
+enum FilterType {
+    FILTER_ECHO,
+    FILTER_LMS,
+    FILTER_LMS_SPARSE,
+    FILTER_LMS_F32,
+    FILTER_LMS_MIXED,
+    FILTER_LMS_DELAYED,
+    FILTER_BANK,
+    FILTER_LOWRANK,
+    FILTER_LMS_MASKED
+};
+
+// Parameters shared by all filter types (ignored by filters that don't use
+// them)
+struct FilterParams {
+
+    // Order of filter (number of signal vectors in history)
+    int order;
+
+    // Step size used for filter updates
+    double mu;
+
+    // Number of threads used to update LMS filters (1 for single-threaded)
+    int n_threads;
+
+    // CPU that first helper thread (or updater thread of delayed LMS) is
+    // pinned to (negative to leave helper threads unpinned)
+    int first_cpu;
+
+    // Configurations of filter bank ('mu:order' pairs separated by commas, or
+    // NULL for a grid around mu and order), and whether the bank blends its
+    // predictions instead of using the best one
+    const char* bank_spec;
+    int bank_blend;
+
+    // Rank of weight matrix learned by low-rank LMS
+    int rank;
+
+    // Connectivity mask of masked LMS (file of 'row col' pairs, or NULL to
+    // connect each channel to its n_nearest nearest channels)
+    const char* mask_fpath;
+    int n_nearest;
+};
+
+// Filter object
+struct FilterAuto {
+
+    // Type of wrapped filter
+    enum FilterType type;
+
+    // Dimension of signal
+    int dim;
+
+    // Filter prediction (points to prediction of wrapped filter)
+    double* x_pred;
+
+    // Wrapped filter (only the member matching 'type' is used)
+    struct FilterAutoLMS lms;
+    struct FilterAutoLMS32 lms32;
+    struct FilterAutoEcho echo;
+    struct FilterAutoLMSDelayed delayed;
+    struct FilterAutoBank bank;
+    struct FilterAutoLowRank lowrank;
+    struct FilterAutoLMSMasked masked;
+
+    // Parallel engine driving LMS filter (only used if use_engine is 1)
+    struct EngineLMS engine;
+    int use_engine;
+};
+
+// Look up filter type by name ('echo', 'lms', 'lms-sparse', 'lms-f32',
+// 'lms-mixed', 'lms-delayed', 'bank', 'lowrank', 'lms-masked'); returns 0 on
+// success and 1 if name is not recognized
+int FilterAuto_parse_type(const char* name, enum FilterType* type);
+
+// Name of filter type
+const char* FilterAuto_type_name(enum FilterType type);
+
+// Constructor for filter object (returns 0 on success)
+int FilterAuto_new(struct FilterAuto* flt, enum FilterType type, int dim, struct FilterParams* params);
+
+// Destructor for filter object
+void FilterAuto_delete(struct FilterAuto* flt);
+
+// Update filter with new signal value and predict next value
+void FilterAuto_predict_next(struct FilterAuto* flt, double* x);
+
+// Update filter with n signal values (n rows of length dim) and write the
+// prediction made after each to preds (n rows); LMS filters run as block LMS
+// (see filters.h), and other filters take the values one at a time
+void FilterAuto_predict_block(struct FilterAuto* flt, double* x, int n, double* preds);
+
+// Touch every page of filter's weights, history and outputs, so that the
+// first steps don't take page faults; returns number of bytes touched
+size_t FilterAuto_prefault(struct FilterAuto* flt);
+
+// Print statistics kept by filter, if any (lag of delayed LMS, errors of
+// filter bank, size of low-rank and masked LMS)
+void FilterAuto_print_stats(struct FilterAuto* flt);
+
+
+/* Comparison against reference filter
+ *
+ * Runs a double-precision FilterAutoLMS alongside another filter and tracks
+ * how far the other filter's predictions drift from the reference, as well as
+ * the prediction error of both filters. Used to check the accuracy cost of
+ * reduced-precision and approximate filters.
+ */
+struct FilterCompare {
+
+    // Dimension of signal
+    int dim;
+
+    // Reference filter
+    struct FilterAutoLMS ref;
+
+    // Prediction made by compared filter on previous step
+    double* pred_prev;
+
+    // Number of steps compared
+    long n_steps;
+
+    // Largest absolute difference between predictions
+    double max_drift;
+
+    // Sum of squared differences between predictions
+    double sse_drift;
+
+    // Sums of squared prediction errors of compared and reference filters
+    double sse_flt;
+    double sse_ref;
+};
+
+// Constructor for comparison object
+void FilterCompare_new(struct FilterCompare* cmp, int dim, struct FilterParams* params);
+
+// Destructor for comparison object
+void FilterCompare_delete(struct FilterCompare* cmp);
+
+// Update reference filter with new signal value and compare the prediction
+// of the compared filter (made after seeing the same value) against it
+void FilterCompare_update(struct FilterCompare* cmp, double* x, double* x_pred);
+
+// Print summary of comparison
+void FilterCompare_print(struct FilterCompare* cmp);
+
+
+#endif
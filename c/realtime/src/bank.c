@@ -0,0 +1,240 @@
+/* Filter bank */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bank.h"
+
+
+// Decay of average prediction error per step (weight of the newest error is
+// 1 - BANK_ERR_DECAY, so the average spans roughly the last 100 steps)
+#define BANK_ERR_DECAY 0.99
+
+// Floor on average error when weighting blended predictions
+#define BANK_ERR_FLOOR 1e-12
+
+// Multiples of mu in default grid of step sizes
+static const double BANK_MU_SCALES[] = {0.25, 0.5, 1.0, 2.0};
+#define N_BANK_MU_SCALES (sizeof(BANK_MU_SCALES) / sizeof(BANK_MU_SCALES[0]))
+
+
+// Parse filter configurations from spec into mu and order (allocated here);
+// returns number of filters, or 0 if spec is malformed
+static int parse_spec(const char* spec, double** mu, int** order) {
+
+    // Count configurations
+    int n = 1;
+    for (const char* p = spec; *p != '\0'; p++) {
+        if (*p == ',') {
+            n++;
+        }
+    }
+    *mu = (double *) malloc(n * sizeof(double));
+    *order = (int *) malloc(n * sizeof(int));
+
+    // Parse 'mu:order' pairs
+    const char* p = spec;
+    for (int k = 0; k < n; k++) {
+        char* end;
+        (*mu)[k] = strtod(p, &end);
+        if (end == p || *end != ':') {
+            break;
+        }
+        p = end + 1;
+        (*order)[k] = (int) strtol(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0') || (*order)[k] < 1) {
+            break;
+        }
+        p = end + 1;
+        if (k == n - 1) {
+            return n;
+        }
+    }
+
+    fprintf(stderr, "Malformed filter bank '%s' (expected 'mu:order' pairs separated by commas)\n", spec);
+    free(*order);
+    free(*mu);
+    return 0;
+}
+
+
+// Fill mu and order (allocated here) with default grid; returns number of
+// filters
+static int default_grid(double mu_base, int order_base, double** mu, int** order) {
+
+    // Orders: order_base and, if it is above 1, half of it
+    int n_orders = (order_base > 1) ? 2 : 1;
+    int n = n_orders * N_BANK_MU_SCALES;
+    *mu = (double *) malloc(n * sizeof(double));
+    *order = (int *) malloc(n * sizeof(int));
+
+    int k = 0;
+    for (int o = 0; o < n_orders; o++) {
+        for (int s = 0; s < (int) N_BANK_MU_SCALES; s++) {
+            (*mu)[k] = mu_base * BANK_MU_SCALES[s];
+            (*order)[k] = (o == 0) ? order_base : order_base / 2;
+            k++;
+        }
+    }
+
+    return n;
+}
+
+
+// Constructor for FilterAutoBank object
+int FilterAutoBank_new(struct FilterAutoBank* flt, int dim, const char* spec, double mu, int order, int blend) {
+
+    // Read configurations
+    if (spec != NULL) {
+        flt->n_filters = parse_spec(spec, &flt->mu, &flt->order);
+        if (flt->n_filters == 0) {
+            return 1;
+        }
+    }
+    else {
+        flt->n_filters = default_grid(mu, order, &flt->mu, &flt->order);
+    }
+
+    // Size shared history for largest order
+    flt->max_order = 0;
+    for (int k = 0; k < flt->n_filters; k++) {
+        if (flt->order[k] > flt->max_order) {
+            flt->max_order = flt->order[k];
+        }
+    }
+
+    // Populate fields
+    int n_rows = flt->n_filters * dim;
+    flt->dim = dim;
+    flt->hist_size = dim * flt->max_order;
+    flt->head = 0;
+    flt->best = 0;
+    flt->blend = blend;
+    flt->n_steps = 0;
+    flt->kernel = kernel_lms_select();
+
+    // Lay out weight matrices back to back
+    flt->wts_offset = (size_t *) malloc(flt->n_filters * sizeof(size_t));
+    flt->n_wts = 0;
+    for (int k = 0; k < flt->n_filters; k++) {
+        flt->wts_offset[k] = flt->n_wts;
+        flt->n_wts += (size_t) dim * dim * flt->order[k];
+    }
+
+    // Allocate arrays (weights, history and predictions start at zero)
+    flt->x_pred = (double *) calloc(dim, sizeof(double));
+    flt->wts = (double *) calloc(flt->n_wts, sizeof(double));
+    flt->preds = (double *) calloc(n_rows, sizeof(double));
+    flt->errs = (double *) calloc(n_rows, sizeof(double));
+    flt->x_hist = (double *) calloc(flt->hist_size, sizeof(double));
+    flt->blk_old = (const double **) malloc(flt->max_order * sizeof(double*));
+    flt->blk_new = (const double **) malloc(flt->max_order * sizeof(double*));
+    flt->err_avg = (double *) calloc(flt->n_filters, sizeof(double));
+    flt->n_best = (long *) calloc(flt->n_filters, sizeof(long));
+
+    return 0;
+}
+
+
+// Destructor for FilterAutoBank object
+void FilterAutoBank_delete(struct FilterAutoBank* flt) {
+
+    // Free allocated memory
+    free(flt->n_best);
+    free(flt->err_avg);
+    free(flt->blk_new);
+    free(flt->blk_old);
+    free(flt->x_hist);
+    free(flt->errs);
+    free(flt->preds);
+    free(flt->wts);
+    free(flt->x_pred);
+    free(flt->wts_offset);
+    free(flt->order);
+    free(flt->mu);
+}
+
+
+// Update filters with new signal value and predict next value
+void FilterAutoBank_predict_next(struct FilterAutoBank* flt, double* x) {
+
+    int dim = flt->dim;
+
+    // Point kernel at history blocks (block k of the new history is block
+    // k - 1 of the old history, and block 0 is the new signal value)
+    for (int k = 0; k < flt->max_order; k++) {
+        flt->blk_old[k] = flt->x_hist + ((flt->head + k) % flt->max_order) * dim;
+        flt->blk_new[k] = (k == 0) ? x : flt->blk_old[k - 1];
+    }
+
+    // Score last prediction of each filter, then update its weights and
+    // predict in one pass over its weight matrix
+    for (int f = 0; f < flt->n_filters; f++) {
+        double* err = flt->errs + f * dim;
+        double* pred = flt->preds + f * dim;
+        double sse = 0.0;
+        for (int i = 0; i < dim; i++) {
+            err[i] = x[i] - pred[i];
+            sse += err[i] * err[i];
+        }
+        flt->err_avg[f] = BANK_ERR_DECAY * flt->err_avg[f] + (1.0 - BANK_ERR_DECAY) * (sse / dim);
+
+        flt->kernel(
+            flt->wts + flt->wts_offset[f], dim * flt->order[f], dim, flt->order[f], flt->mu[f],
+            err, flt->blk_old, flt->blk_new, pred, 0, dim
+        );
+    }
+
+    // Add new signal value to history, overwriting oldest slot
+    flt->head = (flt->head + flt->max_order - 1) % flt->max_order;
+    memcpy(flt->x_hist + flt->head * dim, x, dim * sizeof(double));
+
+    // Pick filter with lowest average error
+    int best = 0;
+    for (int f = 1; f < flt->n_filters; f++) {
+        if (flt->err_avg[f] < flt->err_avg[best]) {
+            best = f;
+        }
+    }
+    flt->best = best;
+    flt->n_best[best]++;
+    flt->n_steps++;
+
+    // Output its prediction, or blend of all predictions
+    if (!flt->blend) {
+        memcpy(flt->x_pred, flt->preds + best * dim, dim * sizeof(double));
+        return;
+    }
+    double w_sum = 0.0;
+    for (int i = 0; i < dim; i++) {
+        flt->x_pred[i] = 0.0;
+    }
+    for (int f = 0; f < flt->n_filters; f++) {
+        double w = 1.0 / (flt->err_avg[f] + BANK_ERR_FLOOR);
+        const double* pred = flt->preds + f * dim;
+        for (int i = 0; i < dim; i++) {
+            flt->x_pred[i] += w * pred[i];
+        }
+        w_sum += w;
+    }
+    for (int i = 0; i < dim; i++) {
+        flt->x_pred[i] /= w_sum;
+    }
+}
+
+
+// Print average error of each filter and how often it was best
+void FilterAutoBank_print_stats(struct FilterAutoBank* flt) {
+
+    if (flt->n_steps == 0) {
+        return;
+    }
+
+    printf("Filter bank (%s output):\n", flt->blend ? "blended" : "best");
+    for (int f = 0; f < flt->n_filters; f++) {
+        printf("  mu %-10g order %-3d  avg error %-10.6g best on %5.1f%% of steps%s\n",
+            flt->mu[f], flt->order[f], flt->err_avg[f], 100.0 * flt->n_best[f] / flt->n_steps,
+            (f == flt->best) ? "  <- current" : "");
+    }
+}
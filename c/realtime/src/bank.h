@@ -0,0 +1,99 @@
+/* Header file for filter bank */
+
+
+#ifndef _BANK_H
+#define _BANK_H
+
+#include <stddef.h>
+
+#include "kernels.h"
+
+
+/* Bank of autoregressive LMS filters
+ *
+ * Runs several LMS filters with different step sizes and orders over one
+ * shared signal history, so that the best configuration can be picked online
+ * instead of by rerunning the experiment for each one. The history is kept
+ * once, for the largest order, and each filter reads its newest 'order'
+ * blocks. The weight matrices of all filters are stored back to back in one
+ * allocation, and each is updated and read by the fused LMS kernel in a
+ * single pass.
+ *
+ * The bank tracks an exponentially weighted average of each filter's squared
+ * prediction error, and outputs the prediction of the filter whose average is
+ * lowest, or a blend of all predictions weighted by inverse average error.
+ */
+struct FilterAutoBank {
+
+    // Dimension of signal
+    int dim;
+
+    // Number of filters, and step size and order of each
+    int n_filters;
+    double* mu;
+    int* order;
+
+    // Largest order of any filter, and size of shared history (dim *
+    // max_order)
+    int max_order;
+    int hist_size;
+
+    // Offset of each filter's weight matrix in wts (filter k has dim rows of
+    // length dim * order[k]), and total number of weights
+    size_t* wts_offset;
+    size_t n_wts;
+
+    // Bank prediction (best or blended prediction of filters)
+    double* x_pred;
+
+    // Weight matrices of all filters (row-major, back to back)
+    double* wts;
+
+    // Predictions of all filters (n_filters * dim, filter k at k * dim), and
+    // their errors on the last step
+    double* preds;
+    double* errs;
+
+    // Shared signal history (circular buffer, as in FilterAutoLMS), and
+    // pointers to its blocks before (blk_old) and after (blk_new) adding the
+    // newest signal value
+    double* x_hist;
+    int head;
+    const double** blk_old;
+    const double** blk_new;
+
+    // Average squared prediction error of each filter (exponentially
+    // weighted), and number of steps on which each had the lowest
+    double* err_avg;
+    long* n_best;
+
+    // Filter whose prediction was used on the last step
+    int best;
+
+    // Set to blend predictions instead of using best one
+    int blend;
+
+    // Number of steps taken
+    long n_steps;
+
+    // Fused update-and-predict kernel selected for this CPU
+    KernelLMS kernel;
+};
+
+// Constructor for filter object; spec lists filters as 'mu:order' pairs
+// separated by commas (e.g. '0.01:5,0.005:5,0.02:3'), and if NULL, a grid of
+// step sizes around mu and orders up to order is used; returns 0 on success
+// and 1 if spec is malformed
+int FilterAutoBank_new(struct FilterAutoBank* flt, int dim, const char* spec, double mu, int order, int blend);
+
+// Destructor for filter object
+void FilterAutoBank_delete(struct FilterAutoBank* flt);
+
+// Update filters with new signal value and predict next value
+void FilterAutoBank_predict_next(struct FilterAutoBank* flt, double* x);
+
+// Print average error of each filter and how often it was best
+void FilterAutoBank_print_stats(struct FilterAutoBank* flt);
+
+
+#endif
@@ -0,0 +1,556 @@
+/* Microbenchmarks of filter kernels
+
+Times one step (update and prediction) of each registered filter over a grid
+of signal dimensions and filter orders, so that kernel regressions show up and
+the fastest kernel for each probe size can be chosen. Each configuration is
+warmed up, then timed over a number of repetitions, each long enough to make
+timer overhead negligible; statistics are taken over the repetitions.
+
+Results are written as CSV (default) or JSON, one record per configuration,
+for plotting in the notebooks.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "filters.h"
+#include "lowrank.h"
+#include "masked.h"
+#include "timing.h"
+
+
+// Default grid of signal dimensions and filter orders
+#define BENCH_DIMS "64,128,256,512,1024,2048,4096"
+#define BENCH_ORDERS "1,2,5,10,20"
+
+// Largest number of values in a grid list
+#define BENCH_MAX_LIST 32
+
+// Step size of benchmarked filters (doesn't affect cost)
+#define BENCH_MU 0.01
+
+// Number of distinct input frames cycled through
+#define BENCH_N_FRAMES 64
+
+// Default rank of low-rank filter
+#define BENCH_RANK 16
+
+// Default number of nearest channels connected by masked filter
+#define BENCH_NEAREST 8
+
+// Probability of a spike in each entry of an input frame (spike counts are
+// sparse, which matters for sparse-input kernels)
+#define BENCH_SPIKE_PROB 0.05
+
+// Size of buffer for args
+#define ARG_BUF_SIZE 256
+
+
+/* Registry of benchmarked kernels
+ *
+ * Each entry creates a filter of a given size, runs one step of it, and
+ * deletes it. New kernels are benchmarked by adding an entry to BENCH_KERNELS.
+ */
+struct BenchKernel {
+
+    // Name used on command line and in output
+    const char* name;
+
+    // Bytes of filter state per weight (0 if the kernel has no weights)
+    int bytes_per_weight;
+
+    // Create filter object
+    void* (*create)(int dim, int order);
+
+    // Update filter with new signal value and predict next value
+    void (*step)(void* flt, double* x);
+
+    // Delete filter object
+    void (*destroy)(void* flt);
+
+    // Number of weights (NULL if dim * dim * order)
+    double (*n_weights)(int dim, int order);
+
+    // Name of LMS kernel the filter runs (NULL if the kernel selected for
+    // this CPU)
+    const char* (*isa)(void* flt);
+};
+
+
+// Rank of low-rank filter and number of nearest channels of masked filter
+// (set from command line)
+static int bench_rank = BENCH_RANK;
+static int bench_nearest = BENCH_NEAREST;
+
+
+// LMS filter
+static void* bench_lms_create(int dim, int order) {
+    struct FilterAutoLMS* flt = malloc(sizeof(struct FilterAutoLMS));
+    FilterAutoLMS_new(flt, dim, order, BENCH_MU);
+    return flt;
+}
+static void bench_lms_step(void* flt, double* x) {
+    FilterAutoLMS_predict_next((struct FilterAutoLMS*) flt, x);
+}
+static void bench_lms_destroy(void* flt) {
+    FilterAutoLMS_delete((struct FilterAutoLMS*) flt);
+    free(flt);
+}
+static const char* bench_lms_isa(void* flt) {
+    return kernel_lms_name(((struct FilterAutoLMS*) flt)->kernel);
+}
+
+// LMS filter kept on generic kernel even where a fixed-geometry kernel
+// exists (same step and destructor as LMS filter)
+static void* bench_lms_generic_create(int dim, int order) {
+    struct FilterAutoLMS* flt = bench_lms_create(dim, order);
+    flt->kernel = kernel_lms_select();
+    return flt;
+}
+
+// Sparse-input LMS filter (same step and destructor as LMS filter)
+static void* bench_lms_sparse_create(int dim, int order) {
+    struct FilterAutoLMS* flt = malloc(sizeof(struct FilterAutoLMS));
+    FilterAutoLMS_new_sparse(flt, dim, order, BENCH_MU);
+    return flt;
+}
+
+// Single-precision LMS filter, accumulating in float or double
+static void* bench_lms32_create(int dim, int order) {
+    struct FilterAutoLMS32* flt = malloc(sizeof(struct FilterAutoLMS32));
+    FilterAutoLMS32_new(flt, dim, order, BENCH_MU, 0);
+    return flt;
+}
+static void* bench_lms_mixed_create(int dim, int order) {
+    struct FilterAutoLMS32* flt = malloc(sizeof(struct FilterAutoLMS32));
+    FilterAutoLMS32_new(flt, dim, order, BENCH_MU, 1);
+    return flt;
+}
+static void bench_lms32_step(void* flt, double* x) {
+    FilterAutoLMS32_predict_next((struct FilterAutoLMS32*) flt, x);
+}
+static void bench_lms32_destroy(void* flt) {
+    FilterAutoLMS32_delete((struct FilterAutoLMS32*) flt);
+    free(flt);
+}
+
+// Low-rank LMS filter
+static void* bench_lowrank_create(int dim, int order) {
+    struct FilterAutoLowRank* flt = malloc(sizeof(struct FilterAutoLowRank));
+    FilterAutoLowRank_new(flt, dim, order, bench_rank, BENCH_MU);
+    return flt;
+}
+static void bench_lowrank_step(void* flt, double* x) {
+    FilterAutoLowRank_predict_next((struct FilterAutoLowRank*) flt, x);
+}
+static void bench_lowrank_destroy(void* flt) {
+    FilterAutoLowRank_delete((struct FilterAutoLowRank*) flt);
+    free(flt);
+}
+static double bench_lowrank_n_weights(int dim, int order) {
+    return (double) bench_rank * dim * (1.0 + order);
+}
+
+// Masked LMS filter (each channel connected to its nearest channels)
+static void* bench_masked_create(int dim, int order) {
+    struct FilterAutoLMSMasked* flt = malloc(sizeof(struct FilterAutoLMSMasked));
+    FilterAutoLMSMasked_new(flt, dim, order, BENCH_MU, NULL, bench_nearest);
+    return flt;
+}
+static void bench_masked_step(void* flt, double* x) {
+    FilterAutoLMSMasked_predict_next((struct FilterAutoLMSMasked*) flt, x);
+}
+static void bench_masked_destroy(void* flt) {
+    FilterAutoLMSMasked_delete((struct FilterAutoLMSMasked*) flt);
+    free(flt);
+}
+static double bench_masked_n_weights(int dim, int order) {
+    return (double) dim * (bench_nearest + 1) * order;
+}
+
+// Echo filter (baseline cost of a step that only copies the signal)
+static void* bench_echo_create(int dim, int order) {
+    (void) order;
+    struct FilterAutoEcho* flt = malloc(sizeof(struct FilterAutoEcho));
+    FilterAutoEcho_new(flt, dim);
+    return flt;
+}
+static void bench_echo_step(void* flt, double* x) {
+    FilterAutoEcho_predict_next((struct FilterAutoEcho*) flt, x);
+}
+static void bench_echo_destroy(void* flt) {
+    FilterAutoEcho_delete((struct FilterAutoEcho*) flt);
+    free(flt);
+}
+
+const struct BenchKernel BENCH_KERNELS[] = {
+    {"echo", 0, bench_echo_create, bench_echo_step, bench_echo_destroy, NULL, NULL},
+    {"lms", sizeof(double), bench_lms_create, bench_lms_step, bench_lms_destroy, NULL, bench_lms_isa},
+    {"lms-generic", sizeof(double), bench_lms_generic_create, bench_lms_step, bench_lms_destroy, NULL,
+        bench_lms_isa},
+    {"lms-sparse", sizeof(double), bench_lms_sparse_create, bench_lms_step, bench_lms_destroy, NULL, NULL},
+    {"lms-f32", sizeof(float), bench_lms32_create, bench_lms32_step, bench_lms32_destroy, NULL, NULL},
+    {"lms-mixed", sizeof(float), bench_lms_mixed_create, bench_lms32_step, bench_lms32_destroy, NULL, NULL},
+    {"lms-lowrank", sizeof(double), bench_lowrank_create, bench_lowrank_step, bench_lowrank_destroy,
+        bench_lowrank_n_weights, NULL},
+    {"lms-masked", sizeof(double), bench_masked_create, bench_masked_step, bench_masked_destroy,
+        bench_masked_n_weights, NULL},
+};
+const int N_BENCH_KERNELS = sizeof(BENCH_KERNELS) / sizeof(BENCH_KERNELS[0]);
+
+
+// Output formats
+enum BenchFormat {
+    BENCH_CSV,
+    BENCH_JSON
+};
+
+// Benchmark settings
+struct BenchConfig {
+
+    // Warmup time and time of each repetition (seconds)
+    double warmup_s;
+    double rep_s;
+
+    // Number of repetitions
+    int n_reps;
+
+    // Largest filter state benchmarked (bytes)
+    double max_bytes;
+};
+
+// Statistics of one configuration (nanoseconds per step, over repetitions)
+struct BenchResult {
+    const char* isa;
+    long steps_per_rep;
+    double ns_min;
+    double ns_median;
+    double ns_mean;
+    double ns_stddev;
+};
+
+
+// Parse comma-separated list of positive integers; returns number of values,
+// or -1 if list is invalid
+static int parse_list(const char* str, int* vals) {
+
+    int n = 0;
+    const char* p = str;
+    while (*p != '\0') {
+        char* end;
+        long v = strtol(p, &end, 10);
+        if (end == p || v < 1 || n == BENCH_MAX_LIST) {
+            return -1;
+        }
+        vals[n++] = (int) v;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return -1;
+        }
+    }
+
+    return n;
+}
+
+
+// Compare doubles (for qsort)
+static int compare_double(const void* a, const void* b) {
+
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+
+// Fill frames with random spike counts (fixed seed, so every run sees the
+// same input)
+static void make_frames(double* frames, int dim) {
+
+    unsigned int state = 12345;
+    for (long i = 0; i < (long) BENCH_N_FRAMES * dim; i++) {
+        state = state * 1103515245u + 12345u;
+        double u = (state >> 8) / (double) (1u << 24);
+        frames[i] = (u < BENCH_SPIKE_PROB) ? 1.0 + (u < BENCH_SPIKE_PROB / 4) : 0.0;
+    }
+}
+
+
+// Run steps of filter, cycling through input frames; returns elapsed time
+// (nanoseconds)
+static double run_steps(const struct BenchKernel* kern, void* flt, double* frames, int dim, long n_steps) {
+
+    uint64_t t0 = timing_now();
+    for (long s = 0; s < n_steps; s++) {
+        kern->step(flt, frames + (s % BENCH_N_FRAMES) * dim);
+    }
+    return (double) timing_ns(timing_now() - t0);
+}
+
+
+// Benchmark one configuration
+static void bench_one(const struct BenchKernel* kern, int dim, int order, struct BenchConfig* cfg,
+    struct BenchResult* res) {
+
+    double* frames = (double *) malloc((size_t) BENCH_N_FRAMES * dim * sizeof(double));
+    make_frames(frames, dim);
+    void* flt = kern->create(dim, order);
+    res->isa = (kern->isa != NULL) ? kern->isa(flt) : kernel_lms_name(kernel_lms_select());
+
+    // Warm up, doubling the number of steps until the warmup time has passed;
+    // the last batch gives the number of steps per repetition
+    long n_steps = 1;
+    double ns = run_steps(kern, flt, frames, dim, n_steps);
+    double ns_warm = ns;
+    while (ns_warm < cfg->warmup_s * 1e9 || ns < cfg->rep_s * 1e9 / 2) {
+        n_steps *= 2;
+        ns = run_steps(kern, flt, frames, dim, n_steps);
+        ns_warm += ns;
+        if (ns >= cfg->rep_s * 1e9) {
+            break;
+        }
+    }
+    res->steps_per_rep = (long) (n_steps * (cfg->rep_s * 1e9 / ns));
+    if (res->steps_per_rep < 1) {
+        res->steps_per_rep = 1;
+    }
+
+    // Time repetitions
+    double* per_step = (double *) malloc(cfg->n_reps * sizeof(double));
+    for (int r = 0; r < cfg->n_reps; r++) {
+        per_step[r] = run_steps(kern, flt, frames, dim, res->steps_per_rep) / res->steps_per_rep;
+    }
+
+    // Compute statistics
+    qsort(per_step, cfg->n_reps, sizeof(double), compare_double);
+    double sum = 0.0;
+    for (int r = 0; r < cfg->n_reps; r++) {
+        sum += per_step[r];
+    }
+    res->ns_mean = sum / cfg->n_reps;
+    double ss = 0.0;
+    for (int r = 0; r < cfg->n_reps; r++) {
+        ss += (per_step[r] - res->ns_mean) * (per_step[r] - res->ns_mean);
+    }
+    res->ns_stddev = (cfg->n_reps > 1) ? sqrt(ss / (cfg->n_reps - 1)) : 0.0;
+    res->ns_min = per_step[0];
+    res->ns_median = (cfg->n_reps % 2 == 1) ? per_step[cfg->n_reps / 2]
+        : (per_step[cfg->n_reps / 2 - 1] + per_step[cfg->n_reps / 2]) / 2;
+
+    free(per_step);
+    kern->destroy(flt);
+    free(frames);
+}
+
+
+// Write one result record
+static void write_result(FILE* out, enum BenchFormat format, int first, const struct BenchKernel* kern,
+    int dim, int order, struct BenchConfig* cfg, struct BenchResult* res) {
+
+    if (format == BENCH_CSV) {
+        fprintf(out, "%s,%s,%d,%d,%d,%ld,%.2f,%.2f,%.2f,%.2f,%.1f\n",
+            kern->name, res->isa, dim, order, cfg->n_reps,
+            res->steps_per_rep, res->ns_min, res->ns_median, res->ns_mean, res->ns_stddev,
+            1e9 / res->ns_median);
+    }
+    else {
+        fprintf(out, "%s\n    {\"kernel\": \"%s\", \"isa\": \"%s\", \"dim\": %d, \"order\": %d, "
+            "\"reps\": %d, \"steps_per_rep\": %ld, \"ns_min\": %.2f, \"ns_median\": %.2f, "
+            "\"ns_mean\": %.2f, \"ns_stddev\": %.2f, \"samples_per_s\": %.1f}",
+            first ? "" : ",", kern->name, res->isa, dim, order,
+            cfg->n_reps, res->steps_per_rep, res->ns_min, res->ns_median, res->ns_mean,
+            res->ns_stddev, 1e9 / res->ns_median);
+    }
+    fflush(out);
+}
+
+
+// Print usage message
+void print_usage() {
+
+    puts("Usage: realtime_bench [-k kernels] [-d dims] [-r orders] [-R rank] [-g nearest]");
+    puts("                      [-n reps] [-t rep_ms] [-w warmup_ms] [-m max_mb] [-f csv|json]");
+    puts("                      [-o file] [-T] [-l]");
+}
+
+
+int main(int argc, char **argv) {
+
+    // Variables for storing argument values
+    int c;
+    char kernels[ARG_BUF_SIZE] = "";
+    char dims_str[ARG_BUF_SIZE] = BENCH_DIMS;
+    char orders_str[ARG_BUF_SIZE] = BENCH_ORDERS;
+    char out_fpath[ARG_BUF_SIZE] = "";
+    enum BenchFormat format = BENCH_CSV;
+    int use_tsc = 0;
+    struct BenchConfig cfg;
+    cfg.warmup_s = 0.05;
+    cfg.rep_s = 0.02;
+    cfg.n_reps = 10;
+    cfg.max_bytes = 1024.0 * (1 << 20);
+
+    // Use getopt to parse arguments
+    while((c = getopt(argc, argv, "k:d:r:R:g:n:t:w:m:f:o:Tlh")) != -1) {
+        switch (c) {
+            case 'k':
+                strcpy(kernels, optarg);
+                break;
+            case 'd':
+                strcpy(dims_str, optarg);
+                break;
+            case 'r':
+                strcpy(orders_str, optarg);
+                break;
+            case 'R':
+                bench_rank = atoi(optarg);
+                if (bench_rank < 1) {
+                    fprintf(stderr, "rank must be at least 1\n");
+                    return 1;
+                }
+                break;
+            case 'g':
+                bench_nearest = atoi(optarg);
+                if (bench_nearest < 0) {
+                    fprintf(stderr, "number of nearest channels must not be negative\n");
+                    return 1;
+                }
+                break;
+            case 'n':
+                cfg.n_reps = atoi(optarg);
+                if (cfg.n_reps < 1) {
+                    fprintf(stderr, "number of repetitions must be at least 1\n");
+                    return 1;
+                }
+                break;
+            case 't':
+                cfg.rep_s = atof(optarg) / 1e3;
+                break;
+            case 'w':
+                cfg.warmup_s = atof(optarg) / 1e3;
+                break;
+            case 'm':
+                cfg.max_bytes = atof(optarg) * (1 << 20);
+                break;
+            case 'f':
+                if (strcmp(optarg, "csv") == 0) {
+                    format = BENCH_CSV;
+                }
+                else if (strcmp(optarg, "json") == 0) {
+                    format = BENCH_JSON;
+                }
+                else {
+                    fprintf(stderr, "format '%s' not supported\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o':
+                strcpy(out_fpath, optarg);
+                break;
+            case 'T':
+                use_tsc = 1;
+                break;
+            case 'l':
+                for (int i = 0; i < N_BENCH_KERNELS; i++) {
+                    puts(BENCH_KERNELS[i].name);
+                }
+                return 0;
+            case 'h':
+                print_usage();
+                return 0;
+            default:
+                print_usage();
+                return 1;
+        }
+    }
+
+    // Parse grid
+    int dims[BENCH_MAX_LIST];
+    int orders[BENCH_MAX_LIST];
+    int n_dims = parse_list(dims_str, dims);
+    int n_orders = parse_list(orders_str, orders);
+    if (n_dims < 1 || n_orders < 1) {
+        fprintf(stderr, "dimensions and orders must be comma-separated positive integers\n");
+        return 1;
+    }
+
+    // Select kernels (all of them unless a comma-separated list is given)
+    int selected[sizeof(BENCH_KERNELS) / sizeof(BENCH_KERNELS[0])];
+    for (int i = 0; i < N_BENCH_KERNELS; i++) {
+        selected[i] = (kernels[0] == '\0');
+    }
+    for (char* name = strtok(kernels, ","); name != NULL; name = strtok(NULL, ",")) {
+        int found = 0;
+        for (int i = 0; i < N_BENCH_KERNELS; i++) {
+            if (strcmp(name, BENCH_KERNELS[i].name) == 0) {
+                selected[i] = 1;
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "kernel '%s' not supported\n", name);
+            return 1;
+        }
+    }
+
+    // Open output
+    FILE* out = stdout;
+    if (out_fpath[0] != '\0') {
+        out = fopen(out_fpath, "w");
+        if (out == NULL) {
+            perror("Cannot open output file");
+            return 1;
+        }
+    }
+    timing_init(use_tsc);
+    fprintf(stderr, "Using %s LMS kernel, timing with %s\n",
+        kernel_lms_name(kernel_lms_select()), timing_clock_name());
+
+    // Run grid
+    if (format == BENCH_CSV) {
+        fprintf(out, "kernel,isa,dim,order,reps,steps_per_rep,ns_min,ns_median,ns_mean,ns_stddev,samples_per_s\n");
+    }
+    else {
+        fprintf(out, "[");
+    }
+    int first = 1;
+    for (int i = 0; i < N_BENCH_KERNELS; i++) {
+        if (!selected[i]) {
+            continue;
+        }
+        const struct BenchKernel* kern = &BENCH_KERNELS[i];
+        for (int d = 0; d < n_dims; d++) {
+            for (int o = 0; o < n_orders; o++) {
+
+                // Skip configurations whose weights don't fit in memory cap
+                double n_wts = (kern->n_weights != NULL) ? kern->n_weights(dims[d], orders[o])
+                    : dims[d] * (double) dims[d] * orders[o];
+                double bytes = kern->bytes_per_weight * n_wts;
+                if (bytes > cfg.max_bytes) {
+                    fprintf(stderr, "Skipping %s dim %d order %d (%.0f MB of weights)\n",
+                        kern->name, dims[d], orders[o], bytes / (1 << 20));
+                    continue;
+                }
+
+                struct BenchResult res;
+                bench_one(kern, dims[d], orders[o], &cfg, &res);
+                fprintf(stderr, "%-10s dim %5d order %2d: %12.1f ns/step (+/- %.1f)\n",
+                    kern->name, dims[d], orders[o], res.ns_median, res.ns_stddev);
+                write_result(out, format, first, kern, dims[d], orders[o], &cfg, &res);
+                first = 0;
+            }
+        }
+    }
+    if (format == BENCH_JSON) {
+        fprintf(out, "\n]\n");
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* Regression check for parallel LMS engine
+
+Runs the engine with more threads than there are CPUs, so that helper threads
+are usually not yet running when the first step starts, and checks that every
+step finishes and that predictions match those of the single-threaded filter
+bit for bit.
+An alarm fails the check if a step hangs. Exits with 0 on success.
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "filters.h"
+#include "engine.h"
+#include "cpu.h"
+
+
+// Shape and step size of filter, and number of steps checked
+#define CHECK_DIM 64
+#define CHECK_ORDER 3
+#define CHECK_MU 0.01
+#define CHECK_STEPS 200
+
+// Extra threads beyond the number of CPUs
+#define CHECK_EXTRA_THREADS 3
+
+// Seconds after which check is failed as hung
+#define CHECK_TIMEOUT_S 30
+
+
+int main() {
+
+    alarm(CHECK_TIMEOUT_S);
+
+    int n_threads = cpu_count() + CHECK_EXTRA_THREADS;
+    printf("Checking engine with %d threads on %d CPU(s)...\n", n_threads, cpu_count());
+
+    // Reference filter, and filter driven by engine
+    struct FilterAutoLMS ref;
+    struct FilterAutoLMS flt;
+    struct EngineLMS eng;
+    FilterAutoLMS_new(&ref, CHECK_DIM, CHECK_ORDER, CHECK_MU);
+    FilterAutoLMS_new(&flt, CHECK_DIM, CHECK_ORDER, CHECK_MU);
+    if (EngineLMS_new(&eng, &flt, n_threads, -1) != 0) {
+        fprintf(stderr, "Engine creation failed\n");
+        return 1;
+    }
+
+    // Step both filters over the same sparse spike-like signal, starting
+    // right after the engine is created
+    double* x = (double *) malloc(CHECK_DIM * sizeof(double));
+    srand(1);
+    long n_mismatch = 0;
+    double max_diff = 0.0;
+    for (int t = 0; t < CHECK_STEPS; t++) {
+        for (int i = 0; i < CHECK_DIM; i++) {
+            x[i] = (rand() % 10 == 0) ? (double) (1 + rand() % 3) : 0.0;
+        }
+        FilterAutoLMS_predict_next(&ref, x);
+        EngineLMS_predict_next(&eng, x);
+        for (int i = 0; i < CHECK_DIM; i++) {
+            if (ref.x_pred[i] != flt.x_pred[i]) {
+                n_mismatch++;
+                max_diff = fmax(max_diff, fabs(ref.x_pred[i] - flt.x_pred[i]));
+            }
+        }
+    }
+
+    EngineLMS_delete(&eng);
+    FilterAutoLMS_delete(&flt);
+    FilterAutoLMS_delete(&ref);
+    free(x);
+
+    if (n_mismatch > 0) {
+        fprintf(stderr, "%ld engine predictions differ from single-threaded filter (by up to %g)\n",
+            n_mismatch, max_diff);
+        return 1;
+    }
+    printf("Done (%d steps, predictions identical).\n", CHECK_STEPS);
+    return 0;
+}
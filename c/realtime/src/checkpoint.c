@@ -0,0 +1,198 @@
+/* Filter checkpoints */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+
+#include "checkpoint.h"
+#include "timing.h"
+
+
+// Wait on semaphore, retrying if interrupted by a signal
+static void sem_wait_retry(sem_t* sem) {
+
+    while (sem_wait(sem) != 0 && errno == EINTR) {
+    }
+}
+
+
+// Writer thread: write each snapshot handed over by processor
+static void* checkpoint_writer_run(void* arg) {
+
+    struct Checkpointer* ckpt = (struct Checkpointer *) arg;
+
+    // Only run when nothing else wants the CPU, so that waking the writer
+    // never preempts the processor
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+
+    while (1) {
+        sem_wait_retry(&ckpt->snap_ready);
+        if (atomic_load(&ckpt->stop)) {
+            break;
+        }
+        if (FilterAutoLMS_save(&ckpt->snap, ckpt->fpath, ckpt->snap_steps) == 0) {
+            atomic_fetch_add(&ckpt->n_written, 1);
+        }
+        else {
+            atomic_fetch_add(&ckpt->n_failed, 1);
+        }
+        sem_post(&ckpt->writer_idle);
+    }
+
+    return NULL;
+}
+
+
+// Constructor for Checkpointer object
+int Checkpointer_new(struct Checkpointer* ckpt, struct FilterAutoLMS* flt, const char* fpath, long interval) {
+
+    // Populate fields
+    ckpt->fpath = fpath;
+    ckpt->interval = interval;
+    ckpt->next_frame = interval;
+    ckpt->n_wts = (size_t) flt->dim * flt->hist_size;
+    ckpt->n_copied = 0;
+    ckpt->snap_steps = 0;
+    ckpt->copying = 0;
+    ckpt->n_skipped = 0;
+    ckpt->n_copy_frames = 0;
+    ckpt->copy_ns_max = 0;
+    atomic_init(&ckpt->stop, 0);
+    atomic_init(&ckpt->n_written, 0);
+    atomic_init(&ckpt->n_failed, 0);
+
+    // Snapshot has the same shape and weight layout as the filter, so that it
+    // can be saved like one
+    ckpt->snap = *flt;
+    ckpt->snap.x_hist = (double *) malloc(flt->hist_size * sizeof(double));
+    ckpt->snap.x_pred = (double *) malloc(flt->dim * sizeof(double));
+    ckpt->snap.wts = (double *) malloc(ckpt->n_wts * sizeof(double));
+    if (ckpt->snap.x_hist == NULL || ckpt->snap.x_pred == NULL || ckpt->snap.wts == NULL) {
+        fprintf(stderr, "Cannot allocate checkpoint snapshot (%zu weights)\n", ckpt->n_wts);
+        free(ckpt->snap.wts);
+        free(ckpt->snap.x_pred);
+        free(ckpt->snap.x_hist);
+        return 1;
+    }
+
+    // Fault in snapshot now rather than while copying into it
+    memset(ckpt->snap.wts, 0, ckpt->n_wts * sizeof(double));
+
+    // Start writer
+    sem_init(&ckpt->snap_ready, 0, 0);
+    sem_init(&ckpt->writer_idle, 0, 1);
+    if (pthread_create(&ckpt->writer, NULL, checkpoint_writer_run, ckpt) != 0) {
+        fprintf(stderr, "Cannot start checkpoint writer\n");
+        sem_destroy(&ckpt->writer_idle);
+        sem_destroy(&ckpt->snap_ready);
+        free(ckpt->snap.wts);
+        free(ckpt->snap.x_pred);
+        free(ckpt->snap.x_hist);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// Destructor for Checkpointer object
+void Checkpointer_delete(struct Checkpointer* ckpt) {
+
+    // Let writer finish current snapshot (if one is being copied, the writer
+    // is already idle), then stop it
+    if (!ckpt->copying) {
+        sem_wait_retry(&ckpt->writer_idle);
+    }
+    atomic_store(&ckpt->stop, 1);
+    sem_post(&ckpt->snap_ready);
+    pthread_join(ckpt->writer, NULL);
+    sem_destroy(&ckpt->writer_idle);
+    sem_destroy(&ckpt->snap_ready);
+
+    // Free allocated memory
+    free(ckpt->snap.wts);
+    free(ckpt->snap.x_pred);
+    free(ckpt->snap.x_hist);
+}
+
+
+// Copy next chunk of snapshot if a checkpoint is due
+void Checkpointer_step(struct Checkpointer* ckpt, struct FilterAutoLMS* flt, long n_frames, long n_steps) {
+
+    // Start snapshot once checkpoint is due, unless writer is still busy with
+    // the last one
+    if (!ckpt->copying) {
+        if (n_frames < ckpt->next_frame) {
+            return;
+        }
+        if (sem_trywait(&ckpt->writer_idle) != 0) {
+            ckpt->n_skipped++;
+            ckpt->next_frame = n_frames + ckpt->interval;
+            return;
+        }
+        ckpt->copying = 1;
+        ckpt->n_copied = 0;
+    }
+
+    // Copy next chunk of weights (in the filter's own layout)
+    uint64_t t0 = timing_now();
+    size_t n = ckpt->n_wts - ckpt->n_copied;
+    if (n > CHECKPOINT_CHUNK) {
+        n = CHECKPOINT_CHUNK;
+    }
+    memcpy(ckpt->snap.wts + ckpt->n_copied, flt->wts + ckpt->n_copied, n * sizeof(double));
+    ckpt->n_copied += n;
+
+    // Once all weights are copied, add history and prediction, and hand
+    // snapshot to writer
+    if (ckpt->n_copied == ckpt->n_wts) {
+        memcpy(ckpt->snap.x_hist, flt->x_hist, flt->hist_size * sizeof(double));
+        memcpy(ckpt->snap.x_pred, flt->x_pred, flt->dim * sizeof(double));
+        ckpt->snap.head = flt->head;
+        ckpt->snap.mu = flt->mu;
+        ckpt->snap_steps = n_steps;
+        ckpt->copying = 0;
+        ckpt->next_frame = n_frames + ckpt->interval;
+        sem_post(&ckpt->snap_ready);
+    }
+
+    uint64_t ns = timing_ns(timing_now() - t0);
+    ckpt->n_copy_frames++;
+    if (ns > ckpt->copy_ns_max) {
+        ckpt->copy_ns_max = ns;
+    }
+}
+
+
+// Wait for writer, then write exact checkpoint of filter
+int Checkpointer_finish(struct Checkpointer* ckpt, struct FilterAutoLMS* flt, long n_steps) {
+
+    // Drop snapshot being copied, and wait for the one being written
+    if (!ckpt->copying) {
+        sem_wait_retry(&ckpt->writer_idle);
+    }
+    ckpt->copying = 0;
+
+    int status = FilterAutoLMS_save(flt, ckpt->fpath, n_steps);
+    atomic_fetch_add((status == 0) ? &ckpt->n_written : &ckpt->n_failed, 1);
+    sem_post(&ckpt->writer_idle);
+    return status;
+}
+
+
+// Print number of checkpoints and time spent copying snapshots
+void Checkpointer_print(struct Checkpointer* ckpt) {
+
+    printf("Checkpoints: %ld written to '%s', %ld failed, %ld skipped\n",
+        atomic_load(&ckpt->n_written), ckpt->fpath, atomic_load(&ckpt->n_failed), ckpt->n_skipped);
+    if (ckpt->n_copy_frames > 0) {
+        printf("Checkpoint snapshots: copied over %ld frames, at most %.1f us per frame\n",
+            ckpt->n_copy_frames, ckpt->copy_ns_max / 1000.0);
+    }
+}
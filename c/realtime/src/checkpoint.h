@@ -0,0 +1,102 @@
+/* Header file for filter checkpoints */
+
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#include "filters.h"
+
+
+// Number of weights copied into snapshot per frame (256 KB)
+#define CHECKPOINT_CHUNK (32 * 1024)
+
+
+/* Checkpointer
+ *
+ * Saves the state of an LMS filter every few thousand frames while the
+ * processor runs, so that the next session with the same probe can start
+ * from converged weights (see FilterAutoLMS_save()). Neither copying nor
+ * writing the weights of a large filter fits in a bin, so both are taken off
+ * the critical path: once a checkpoint is due, the processor copies
+ * CHECKPOINT_CHUNK weights into a snapshot after replying to each frame, and
+ * when the copy is complete it adds the history and prediction and hands the
+ * snapshot to a writer thread, which writes it to disk. The writer runs under
+ * SCHED_IDLE, so it only gets a CPU that the processor isn't using.
+ *
+ * Since the weights keep changing while they are copied, a snapshot taken
+ * over several frames mixes weights from those frames (all of them within
+ * dim * hist_size / CHECKPOINT_CHUNK steps of the history saved with them).
+ * This doesn't matter for a warm start, which only needs weights close to
+ * converged ones. The final checkpoint, written once the probe disconnects,
+ * is exact. If the writer is still busy when the next checkpoint is due, that
+ * checkpoint is skipped rather than waited for.
+ */
+struct Checkpointer {
+
+    // Path of checkpoint file
+    const char* fpath;
+
+    // Number of frames between checkpoints
+    long interval;
+
+    // Frame count at which next checkpoint is due
+    long next_frame;
+
+    // Snapshot of filter (copy of filter object whose history, prediction
+    // and weights point to buffers owned by checkpointer), number of weights,
+    // number copied so far, and number of steps filter had taken
+    struct FilterAutoLMS snap;
+    size_t n_wts;
+    size_t n_copied;
+    long snap_steps;
+
+    // 1 while snapshot is being copied
+    int copying;
+
+    // Writer thread, posted when snapshot is ready (or when it should stop),
+    // and posting when it is idle again
+    pthread_t writer;
+    sem_t snap_ready;
+    sem_t writer_idle;
+    atomic_int stop;
+
+    // Number of checkpoints written and failed (updated by writer), and
+    // number skipped because writer was still busy
+    atomic_long n_written;
+    atomic_long n_failed;
+    long n_skipped;
+
+    // Number of frames spent copying snapshots, and largest time spent
+    // copying after a single frame (nanoseconds)
+    long n_copy_frames;
+    uint64_t copy_ns_max;
+};
+
+// Create checkpointer writing filter to fpath every interval frames, and
+// start its writer thread (the writer inherits the CPU affinity of the calling
+// thread, so create the checkpointer before applying a real-time profile);
+// returns 0 on success
+int Checkpointer_new(struct Checkpointer* ckpt, struct FilterAutoLMS* flt, const char* fpath, long interval);
+
+// Stop writer thread and free snapshot
+void Checkpointer_delete(struct Checkpointer* ckpt);
+
+// Copy next chunk of snapshot if a checkpoint is due after n_frames frames
+// (filter has taken n_steps steps in total), and hand snapshot to writer once
+// it is complete
+void Checkpointer_step(struct Checkpointer* ckpt, struct FilterAutoLMS* flt, long n_frames, long n_steps);
+
+// Wait for writer, then write exact checkpoint of filter; returns 0 on
+// success
+int Checkpointer_finish(struct Checkpointer* ckpt, struct FilterAutoLMS* flt, long n_steps);
+
+// Print number of checkpoints and time spent copying snapshots
+void Checkpointer_print(struct Checkpointer* ckpt);
+
+
+#endif
@@ -0,0 +1,26 @@
+/* CPU helpers */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "cpu.h"
+
+
+// Pin calling thread to CPU
+int cpu_pin_thread(int cpu) {
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+
+// Number of online CPUs
+int cpu_count(void) {
+
+    return (int) sysconf(_SC_NPROCESSORS_ONLN);
+}
@@ -0,0 +1,23 @@
+/* Header file for CPU helpers */
+
+
+#ifndef _CPU_H
+#define _CPU_H
+
+
+// Hint to CPU that calling thread is spinning
+static inline void cpu_relax(void) {
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Pin calling thread to CPU (returns 0 on success)
+int cpu_pin_thread(int cpu);
+
+// Number of online CPUs
+int cpu_count(void);
+
+
+#endif
@@ -0,0 +1,238 @@
+/* Delayed LMS filter */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+
+#include "delayed.h"
+#include "cpu.h"
+
+
+// Number of pending updates the predictor may run ahead of the updater
+#define DELAYED_QUEUE_LEN 16
+
+// Number of spin iterations after which a waiting thread yields its CPU
+#define SPINS_BEFORE_YIELD (1 << 12)
+
+
+// Spin until cond holds, yielding now and then
+#define SPIN_UNTIL(cond) do { \
+    int spins_ = 0; \
+    while (!(cond)) { \
+        cpu_relax(); \
+        if (++spins_ == SPINS_BEFORE_YIELD) { \
+            spins_ = 0; \
+            sched_yield(); \
+        } \
+    } \
+} while (0)
+
+
+// Number of slots in updater history (enough for the history of every update
+// in a full queue)
+static int updater_hist_slots(struct FilterAutoLMSDelayed* flt) {
+
+    return flt->order + flt->queue_len;
+}
+
+
+// Apply queued updates [begin, end) to one copy of the weights
+static void updater_apply(struct FilterAutoLMSDelayed* flt, double* wts, long begin, long end) {
+
+    int n_slots = updater_hist_slots(flt);
+    for (long t = begin; t < end; t++) {
+
+        // Update t uses history before step t (signal values t - 1 back to
+        // t - order; values before the first step are zero)
+        for (int k = 0; k < flt->order; k++) {
+            long slot = ((t - 1 - k) % n_slots + n_slots) % n_slots;
+            flt->u_blk[k] = flt->u_hist + slot * flt->dim;
+        }
+        const double* err = flt->q_err + (t % flt->queue_len) * flt->dim;
+        flt->rank1(wts, flt->hist_size, flt->dim, flt->order, flt->mu, err, flt->u_blk, 0, flt->dim);
+    }
+}
+
+
+// Main loop of updater thread
+static void* updater_run(void* arg) {
+
+    struct FilterAutoLMSDelayed* flt = (struct FilterAutoLMSDelayed*) arg;
+
+    if (flt->cpu >= 0 && cpu_pin_thread(flt->cpu) != 0) {
+        fprintf(stderr, "Could not pin updater thread to CPU %d\n", flt->cpu);
+    }
+
+    int n_slots = updater_hist_slots(flt);
+    long applied = 0;
+    while (1) {
+
+        // Wait for updates
+        long queued;
+        SPIN_UNTIL((queued = atomic_load_explicit(&flt->n_queued, memory_order_acquire)) > applied
+            || atomic_load_explicit(&flt->stop, memory_order_relaxed));
+        if (queued == applied) {
+            return NULL;
+        }
+
+        // Copy signal values of queued steps into history
+        for (long t = applied; t < queued; t++) {
+            memcpy(flt->u_hist + (t % n_slots) * flt->dim, flt->q_x + (t % flt->queue_len) * flt->dim,
+                flt->dim * sizeof(double));
+        }
+
+        // Update back copy and publish it
+        int old = atomic_load_explicit(&flt->front, memory_order_relaxed);
+        updater_apply(flt, flt->wts[1 - old], applied, queued);
+        atomic_store_explicit(&flt->front, 1 - old, memory_order_seq_cst);
+
+        // Bring old front copy up to date once predictor has left it
+        SPIN_UNTIL(atomic_load_explicit(&flt->reading, memory_order_seq_cst) != old);
+        updater_apply(flt, flt->wts[old], applied, queued);
+
+        // Release queue slots
+        applied = queued;
+        atomic_store_explicit(&flt->n_applied, applied, memory_order_release);
+    }
+
+    return NULL;
+}
+
+
+// Constructor for FilterAutoLMSDelayed object
+int FilterAutoLMSDelayed_new(struct FilterAutoLMSDelayed* flt, int dim, int order, double mu, int cpu) {
+
+    // Populate fields
+    flt->dim = dim;
+    flt->order = order;
+    flt->hist_size = dim * order;
+    flt->mu = mu;
+    flt->queue_len = DELAYED_QUEUE_LEN;
+    flt->head = 0;
+    flt->gemv = kernel_gemv_select();
+    flt->rank1 = kernel_rank1_select();
+    flt->n_steps = 0;
+    flt->lag_sum = 0;
+    flt->lag_max = 0;
+    flt->n_stalls = 0;
+    flt->cpu = cpu;
+    atomic_init(&flt->front, 0);
+    atomic_init(&flt->reading, -1);
+    atomic_init(&flt->n_queued, 0);
+    atomic_init(&flt->n_applied, 0);
+    atomic_init(&flt->stop, 0);
+
+    // Allocate arrays (weights and histories start at zero)
+    flt->x_pred = (double *) calloc(dim, sizeof(double));
+    flt->wts[0] = (double *) calloc((size_t) dim * flt->hist_size, sizeof(double));
+    flt->wts[1] = (double *) calloc((size_t) dim * flt->hist_size, sizeof(double));
+    flt->x_hist = (double *) calloc(flt->hist_size, sizeof(double));
+    flt->blk = (const double **) malloc(order * sizeof(double*));
+    flt->q_err = (double *) malloc((size_t) flt->queue_len * dim * sizeof(double));
+    flt->q_x = (double *) malloc((size_t) flt->queue_len * dim * sizeof(double));
+    flt->u_hist = (double *) calloc((size_t) updater_hist_slots(flt) * dim, sizeof(double));
+    flt->u_blk = (const double **) malloc(order * sizeof(double*));
+
+    // Start updater
+    if (pthread_create(&flt->thread, NULL, updater_run, flt) != 0) {
+        perror("Could not create updater thread");
+        free(flt->u_blk);
+        free(flt->u_hist);
+        free(flt->q_x);
+        free(flt->q_err);
+        free(flt->blk);
+        free(flt->x_hist);
+        free(flt->wts[1]);
+        free(flt->wts[0]);
+        free(flt->x_pred);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// Destructor for FilterAutoLMSDelayed object
+void FilterAutoLMSDelayed_delete(struct FilterAutoLMSDelayed* flt) {
+
+    // Stop updater (after it has applied every queued update)
+    atomic_store(&flt->stop, 1);
+    pthread_join(flt->thread, NULL);
+
+    // Free allocated memory
+    free(flt->u_blk);
+    free(flt->u_hist);
+    free(flt->q_x);
+    free(flt->q_err);
+    free(flt->blk);
+    free(flt->x_hist);
+    free(flt->wts[1]);
+    free(flt->wts[0]);
+    free(flt->x_pred);
+}
+
+
+// Update filter with new signal value and predict next value
+void FilterAutoLMSDelayed_predict_next(struct FilterAutoLMSDelayed* flt, double* x) {
+
+    int dim = flt->dim;
+    long n = flt->n_steps;
+
+    // Wait for room in queue (only if updater is a full queue behind)
+    if (n - atomic_load_explicit(&flt->n_applied, memory_order_acquire) >= flt->queue_len) {
+        flt->n_stalls++;
+        SPIN_UNTIL(n - atomic_load_explicit(&flt->n_applied, memory_order_acquire) < flt->queue_len);
+    }
+
+    // Queue update: error of last prediction, and new signal value
+    double* err = flt->q_err + (n % flt->queue_len) * dim;
+    double* q_x = flt->q_x + (n % flt->queue_len) * dim;
+    for (int i = 0; i < dim; i++) {
+        err[i] = x[i] - flt->x_pred[i];
+        q_x[i] = x[i];
+    }
+    atomic_store_explicit(&flt->n_queued, n + 1, memory_order_release);
+
+    // Add new signal value to history, overwriting oldest slot
+    flt->head = (flt->head + flt->order - 1) % flt->order;
+    memcpy(flt->x_hist + flt->head * dim, x, dim * sizeof(double));
+    for (int k = 0; k < flt->order; k++) {
+        flt->blk[k] = flt->x_hist + ((flt->head + k) % flt->order) * dim;
+    }
+
+    // Record how many updates the weights lack
+    long lag = n + 1 - atomic_load_explicit(&flt->n_applied, memory_order_relaxed);
+    flt->lag_sum += lag;
+    if (lag > flt->lag_max) {
+        flt->lag_max = lag;
+    }
+
+    // Claim published copy of weights (checking that it wasn't swapped
+    // before the claim became visible) and predict
+    int f = atomic_load_explicit(&flt->front, memory_order_seq_cst);
+    while (1) {
+        atomic_store_explicit(&flt->reading, f, memory_order_seq_cst);
+        int f2 = atomic_load_explicit(&flt->front, memory_order_seq_cst);
+        if (f2 == f) {
+            break;
+        }
+        f = f2;
+    }
+    flt->gemv(flt->wts[f], flt->hist_size, dim, flt->order, flt->blk, flt->x_pred, 0, dim);
+    atomic_store_explicit(&flt->reading, -1, memory_order_release);
+
+    flt->n_steps++;
+}
+
+
+// Print lag statistics
+void FilterAutoLMSDelayed_print_stats(struct FilterAutoLMSDelayed* flt) {
+
+    if (flt->n_steps == 0) {
+        return;
+    }
+
+    printf("Delayed LMS: mean lag %.2f updates, max lag %ld, queue full on %ld of %ld steps\n",
+        (double) flt->lag_sum / flt->n_steps, flt->lag_max, flt->n_stalls, flt->n_steps);
+}
@@ -0,0 +1,112 @@
+/* Header file for delayed LMS filter */
+
+
+#ifndef _DELAYED_H
+#define _DELAYED_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "kernels.h"
+
+
+/* Delayed autoregressive LMS filter
+ *
+ * Takes the weight update off the path of each prediction. The calling
+ * thread only computes the prediction, as a matrix-vector product against the
+ * weights most recently published, and queues the error and signal value of
+ * the step; a background thread (optionally pinned) applies the queued
+ * rank-1 updates. Predictions may therefore be made with weights that lack
+ * the last few updates, which is the delayed LMS algorithm: for small step
+ * sizes it converges like LMS, and the delay is reported as the lag.
+ *
+ * The delay shrinks the range of stable step sizes. A prediction can be made
+ * with weights up to 16 updates stale (the length of the update queue), and
+ * the largest stable step size of delayed LMS falls roughly in proportion to
+ * the lag, so a step size that is stable for LMS can diverge here. On
+ * 64- and 100-neuron recordings, mu 0.02 still converges with LMS and
+ * diverges with this filter, and on some recordings divergence starts below
+ * mu 0.001. Choose the step size for this filter with its own replay rather
+ * than reusing one tuned for LMS.
+ *
+ * The weights are double-buffered. The updater applies pending updates to the
+ * back copy, publishes it, waits until the predictor has left the old front
+ * copy, and applies the same updates to that copy, so both copies are equal
+ * again before the next batch. The predictor never waits for the updater
+ * unless the queue of pending updates is full.
+ */
+struct FilterAutoLMSDelayed {
+
+    // Dimension of signal
+    int dim;
+
+    // Order of filter (number of signal vectors in history)
+    int order;
+
+    // Size of history (dim * order)
+    int hist_size;
+
+    // Step size used for filter updates
+    double mu;
+
+    // Filter prediction
+    double* x_pred;
+
+    // Two copies of weight matrix (row-major), index of copy the predictor
+    // reads, and index of copy it is reading right now (-1 between steps)
+    double* wts[2];
+    atomic_int front;
+    atomic_int reading;
+
+    // Signal history of predictor (circular buffer, as in FilterAutoLMS), and
+    // pointers to its blocks from newest to oldest
+    double* x_hist;
+    int head;
+    const double** blk;
+
+    // Queue of pending updates (error and signal value of each step), with
+    // number of steps queued by predictor and applied by updater
+    int queue_len;
+    double* q_err;
+    double* q_x;
+    _Alignas(64) atomic_long n_queued;
+    _Alignas(64) atomic_long n_applied;
+
+    // Signal history of updater (one slot per step, indexed by step number
+    // modulo order + queue_len), and pointers to its blocks
+    double* u_hist;
+    const double** u_blk;
+
+    // Kernels selected for this CPU
+    KernelGemv gemv;
+    KernelRank1 rank1;
+
+    // Lag statistics (updates queued but not yet applied when predicting),
+    // and number of steps where predictor waited for room in queue
+    long n_steps;
+    long lag_sum;
+    long lag_max;
+    long n_stalls;
+
+    // Updater thread, CPU it is pinned to (-1 if not pinned), and flag
+    // telling it to exit
+    pthread_t thread;
+    int cpu;
+    atomic_int stop;
+};
+
+// Constructor for filter object (updater thread is pinned to cpu, unless it
+// is negative); returns 0 on success
+int FilterAutoLMSDelayed_new(struct FilterAutoLMSDelayed* flt, int dim, int order, double mu, int cpu);
+
+// Destructor for filter object (stops updater thread)
+void FilterAutoLMSDelayed_delete(struct FilterAutoLMSDelayed* flt);
+
+// Update filter with new signal value and predict next value
+void FilterAutoLMSDelayed_predict_next(struct FilterAutoLMSDelayed* flt, double* x);
+
+// Print lag statistics
+void FilterAutoLMSDelayed_print_stats(struct FilterAutoLMSDelayed* flt);
+
+
+#endif
@@ -0,0 +1,150 @@
+/* Parallel filter engine */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+
+#include "engine.h"
+#include "cpu.h"
+
+
+// Number of spin iterations after which a waiting thread yields its CPU
+// (only matters when there are more threads than free CPUs)
+#define SPINS_BEFORE_YIELD (1 << 16)
+
+// Row blocks are rounded to this many rows, so that threads don't share cache
+// lines of the prediction and error vectors
+#define ROW_ALIGN 8
+
+
+// Main loop of helper thread
+static void* engine_worker_run(void* arg) {
+
+    struct EngineWorker* wkr = (struct EngineWorker*) arg;
+    struct EngineLMS* eng = wkr->eng;
+
+    if (wkr->cpu >= 0 && cpu_pin_thread(wkr->cpu) != 0) {
+        fprintf(stderr, "Could not pin engine thread to CPU %d\n", wkr->cpu);
+    }
+
+    // Start from the epoch the engine was created with, not the current one
+    // (the first step may already have started before this thread runs)
+    unsigned int seen = wkr->epoch;
+    while (1) {
+
+        // Wait for next step
+        int spins = 0;
+        unsigned int epoch;
+        while ((epoch = atomic_load_explicit(&eng->epoch, memory_order_acquire)) == seen) {
+            if (atomic_load_explicit(&eng->stop, memory_order_relaxed)) {
+                return NULL;
+            }
+            cpu_relax();
+            if (++spins == SPINS_BEFORE_YIELD) {
+                spins = 0;
+                sched_yield();
+            }
+        }
+        seen = epoch;
+
+        // Update rows and report completion
+        FilterAutoLMS_update_rows(eng->flt, eng->x, wkr->row_begin, wkr->row_end);
+        atomic_fetch_add_explicit(&eng->n_done, 1, memory_order_release);
+    }
+
+    return NULL;
+}
+
+
+// Constructor for EngineLMS object
+int EngineLMS_new(struct EngineLMS* eng, struct FilterAutoLMS* flt, int n_threads, int first_cpu) {
+
+    // Don't use more threads than there are row blocks
+    int n_blocks = (flt->dim + ROW_ALIGN - 1) / ROW_ALIGN;
+    if (n_threads > n_blocks) {
+        n_threads = n_blocks;
+    }
+    if (n_threads < 1) {
+        n_threads = 1;
+    }
+
+    // Populate fields
+    eng->flt = flt;
+    eng->n_threads = n_threads;
+    eng->x = NULL;
+    atomic_init(&eng->epoch, 0);
+    atomic_init(&eng->n_done, 0);
+    atomic_init(&eng->stop, 0);
+
+    // Split rows into blocks of (nearly) equal size
+    int n_cpus = cpu_count();
+    eng->workers = (struct EngineWorker *) malloc(n_threads * sizeof(struct EngineWorker));
+    for (int t = 0; t < n_threads; t++) {
+        struct EngineWorker* wkr = &eng->workers[t];
+        wkr->eng = eng;
+        wkr->row_begin = (int) ((long) n_blocks * t / n_threads) * ROW_ALIGN;
+        wkr->row_end = (int) ((long) n_blocks * (t + 1) / n_threads) * ROW_ALIGN;
+        if (wkr->row_end > flt->dim) {
+            wkr->row_end = flt->dim;
+        }
+        wkr->cpu = (t > 0 && first_cpu >= 0) ? (first_cpu + t - 1) % n_cpus : -1;
+        wkr->epoch = 0;
+    }
+
+    // Start helper threads
+    eng->threads = (pthread_t *) malloc(n_threads * sizeof(pthread_t));
+    for (int t = 1; t < n_threads; t++) {
+        if (pthread_create(&eng->threads[t], NULL, engine_worker_run, &eng->workers[t]) != 0) {
+            perror("Could not create engine thread");
+            eng->n_threads = t;
+            EngineLMS_delete(eng);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+// Destructor for EngineLMS object
+void EngineLMS_delete(struct EngineLMS* eng) {
+
+    // Stop helper threads
+    atomic_store(&eng->stop, 1);
+    for (int t = 1; t < eng->n_threads; t++) {
+        pthread_join(eng->threads[t], NULL);
+    }
+
+    // Free allocated memory
+    free(eng->threads);
+    free(eng->workers);
+}
+
+
+// Update filter with new signal value and predict next value
+void EngineLMS_predict_next(struct EngineLMS* eng, double* x) {
+
+    struct FilterAutoLMS* flt = eng->flt;
+
+    // Set up step and release helper threads
+    FilterAutoLMS_prepare(flt, x);
+    eng->x = x;
+    atomic_store_explicit(&eng->n_done, 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&eng->epoch, 1, memory_order_release);
+
+    // Update first block of rows on calling thread
+    FilterAutoLMS_update_rows(flt, x, eng->workers[0].row_begin, eng->workers[0].row_end);
+
+    // Wait for helper threads to finish
+    int spins = 0;
+    while (atomic_load_explicit(&eng->n_done, memory_order_acquire) < eng->n_threads - 1) {
+        cpu_relax();
+        if (++spins == SPINS_BEFORE_YIELD) {
+            spins = 0;
+            sched_yield();
+        }
+    }
+
+    // Add signal value to history
+    FilterAutoLMS_ingest(flt, x);
+}
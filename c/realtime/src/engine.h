@@ -0,0 +1,82 @@
+/* Header file for parallel filter engine */
+
+
+#ifndef _ENGINE_H
+#define _ENGINE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "filters.h"
+
+
+/* Parallel LMS engine
+ *
+ * Splits the rows of a FilterAutoLMS weight matrix across a pool of threads.
+ * The calling thread handles the first block of rows, and each helper thread
+ * is pinned to its own CPU and handles one of the remaining blocks. Helpers
+ * spin on a lock-free barrier between samples instead of sleeping, so a
+ * sample costs no futex wakeups; the tradeoff is that each helper keeps its
+ * CPU busy for as long as the engine exists.
+ */
+
+// Per-thread state of engine
+struct EngineWorker {
+
+    // Engine that owns this worker
+    struct EngineLMS* eng;
+
+    // Range of weight rows handled by this worker
+    int row_begin;
+    int row_end;
+
+    // CPU that worker is pinned to (-1 if not pinned)
+    int cpu;
+
+    // Epoch of engine when worker was created (worker waits for the epoch to
+    // move past it before taking its first step)
+    unsigned int epoch;
+};
+
+// Engine object
+struct EngineLMS {
+
+    // Filter updated by engine
+    struct FilterAutoLMS* flt;
+
+    // Number of threads (including calling thread)
+    int n_threads;
+
+    // Helper threads (n_threads - 1)
+    pthread_t* threads;
+
+    // Per-thread state (worker 0 is the calling thread)
+    struct EngineWorker* workers;
+
+    // Signal value for current step
+    double* x;
+
+    // Step counter (incremented by calling thread to start a step)
+    atomic_uint epoch;
+
+    // Number of helper threads that have finished current step
+    atomic_int n_done;
+
+    // Flag telling helper threads to exit
+    atomic_int stop;
+};
+
+// Constructor for engine object (helper thread i, counting from 0, is pinned
+// to CPU first_cpu + i, wrapping around the number of online CPUs; the calling
+// thread is left where it is, and a negative first_cpu leaves helper threads
+// unpinned); returns 0 on success
+int EngineLMS_new(struct EngineLMS* eng, struct FilterAutoLMS* flt, int n_threads, int first_cpu);
+
+// Destructor for engine object (stops helper threads)
+void EngineLMS_delete(struct EngineLMS* eng);
+
+// Update filter with new signal value and predict next value
+void EngineLMS_predict_next(struct EngineLMS* eng, double* x);
+
+
+#endif
@@ -2,11 +2,26 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <cblas.h>
 
 #include "filters.h"
 
 
+// Alignment of weight matrix and history (bytes; one cache line, and one
+// AVX-512 register)
+#define LMS_ALIGN 64
+
+
+// Allocate buffer of given size aligned to LMS_ALIGN
+static void* alloc_aligned(size_t bytes) {
+
+    // Size passed to aligned_alloc() must be a multiple of the alignment
+    size_t padded = (bytes + LMS_ALIGN - 1) / LMS_ALIGN * LMS_ALIGN;
+    return aligned_alloc(LMS_ALIGN, (padded > 0) ? padded : LMS_ALIGN);
+}
+
+
 // Constructor for FilterAutoLMS object
 void FilterAutoLMS_new(struct FilterAutoLMS* flt, int dim, int order, double mu) {
 
@@ -25,23 +40,58 @@ void FilterAutoLMS_new(struct FilterAutoLMS* flt, int dim, int order, double mu)
         flt->x_err[i] = 0.0;
     }
 
-    // Allocate array for history and set to zero 
-    flt->x_hist = (double *) malloc(hist_size * sizeof(double));
+    // Allocate array for history and set to zero (aligned, so that history
+    // blocks are aligned when dim is a multiple of 8)
+    flt->x_hist = (double *) alloc_aligned(hist_size * sizeof(double));
     for (int i = 0; i < hist_size; i++) {
         flt->x_hist[i] = 0.0;
     }
 
-    // Allocate array for weights and set to zero
-    flt->wts = (double *) malloc(dim * hist_size * sizeof(double));
+    // Allocate array for weights and set to zero (aligned, so that rows are
+    // aligned when dim is a multiple of 8)
+    flt->wts = (double *) alloc_aligned((size_t) dim * hist_size * sizeof(double));
     for (int i = 0; i < dim * hist_size; i++) {
         flt->wts[i] = 0.0;
     }
 
+    // Allocate arrays of pointers to history blocks
+    flt->blk_old = (const double **) malloc(order * sizeof(double*));
+    flt->blk_new = (const double **) malloc(order * sizeof(double*));
+
+    // Allocate nonzero index lists for history slots (all slots start empty)
+    flt->nz_idx = (int **) malloc((order + 1) * sizeof(int*));
+    flt->nz_count = (int *) malloc((order + 1) * sizeof(int));
+    for (int s = 0; s <= order; s++) {
+        flt->nz_idx[s] = (int *) malloc(dim * sizeof(int));
+        flt->nz_count[s] = 0;
+    }
+    flt->nzb_old = (const int **) malloc(order * sizeof(int*));
+    flt->nzb_new = (const int **) malloc(order * sizeof(int*));
+    flt->nzn_old = (int *) malloc(order * sizeof(int));
+    flt->nzn_new = (int *) malloc(order * sizeof(int));
+
     // Populate fields
     flt->dim = dim;
     flt->order = order;
     flt->hist_size = hist_size;
     flt->mu = mu;
+    flt->head = 0;
+    flt->sparse = 0;
+    flt->kernel = kernel_lms_select_for(dim, order);
+    flt->kernel_sparse = kernel_lms_sparse_select();
+    flt->blk_rows = NULL;
+    flt->blk_err = NULL;
+    flt->blk_cap = 0;
+}
+
+
+// Constructor for FilterAutoLMS object in sparse-input mode
+void FilterAutoLMS_new_sparse(struct FilterAutoLMS* flt, int dim, int order, double mu) {
+
+    // Weights start at zero, so switching them to column-major order only
+    // requires setting the flag
+    FilterAutoLMS_new(flt, dim, order, mu);
+    flt->sparse = 1;
 }
 
 
@@ -49,6 +99,19 @@ void FilterAutoLMS_new(struct FilterAutoLMS* flt, int dim, int order, double mu)
 void FilterAutoLMS_delete(struct FilterAutoLMS* flt) {
 
     // Free allocated memory
+    free(flt->blk_err);
+    free(flt->blk_rows);
+    free(flt->nzn_new);
+    free(flt->nzn_old);
+    free(flt->nzb_new);
+    free(flt->nzb_old);
+    for (int s = 0; s <= flt->order; s++) {
+        free(flt->nz_idx[s]);
+    }
+    free(flt->nz_count);
+    free(flt->nz_idx);
+    free(flt->blk_new);
+    free(flt->blk_old);
     free(flt->wts);
     free(flt->x_hist);
     free(flt->x_err);
@@ -56,33 +119,429 @@ void FilterAutoLMS_delete(struct FilterAutoLMS* flt) {
 }
 
 
-// Update filter with new signal value and predict next value (using CBLAS)
-void FilterAutoLMS_predict_next(struct FilterAutoLMS* flt, double* x) {
+// Write indices of nonzero entries of x to idx and return their number
+static int find_nonzero(const double* x, int dim, int* idx) {
+
+    int n = 0;
+    for (int i = 0; i < dim; i++) {
+        if (x[i] != 0.0) {
+            idx[n++] = i;
+        }
+    }
+
+    return n;
+}
+
+
+// Prepare filter for update with new signal value
+void FilterAutoLMS_prepare(struct FilterAutoLMS* flt, double* x) {
+
+    // Point kernel at history blocks (block k of the new history is block
+    // k - 1 of the old history, and block 0 is the new signal value)
+    if (!flt->sparse) {
+        for (int k = 0; k < flt->order; k++) {
+            flt->blk_old[k] = flt->x_hist + ((flt->head + k) % flt->order) * flt->dim;
+            flt->blk_new[k] = (k == 0) ? x : flt->blk_old[k - 1];
+        }
+        return;
+    }
+
+    // Index nonzero entries of new signal value
+    flt->nz_count[flt->order] = find_nonzero(x, flt->dim, flt->nz_idx[flt->order]);
+
+    // Do the same in sparse-input mode, along with the nonzero index lists of
+    // the blocks
+    for (int k = 0; k < flt->order; k++) {
+        int slot = (flt->head + k) % flt->order;
+        flt->blk_old[k] = flt->x_hist + slot * flt->dim;
+        flt->nzb_old[k] = flt->nz_idx[slot];
+        flt->nzn_old[k] = flt->nz_count[slot];
+        if (k == 0) {
+            flt->blk_new[k] = x;
+            flt->nzb_new[k] = flt->nz_idx[flt->order];
+            flt->nzn_new[k] = flt->nz_count[flt->order];
+        }
+        else {
+            flt->blk_new[k] = flt->blk_old[k - 1];
+            flt->nzb_new[k] = flt->nzb_old[k - 1];
+            flt->nzn_new[k] = flt->nzn_old[k - 1];
+        }
+    }
+}
+
+
+// Update weights and predictions for rows [row_begin, row_end)
+void FilterAutoLMS_update_rows(struct FilterAutoLMS* flt, double* x, int row_begin, int row_end) {
 
     // Compute error
-    for (int i = 0; i < flt->dim; i++) {
+    for (int i = row_begin; i < row_end; i++) {
         flt->x_err[i] = x[i] - flt->x_pred[i];
     }
 
-    // Update weights (wts := wts + mu * x_err * x_hist')
-    cblas_dger(
-        CblasRowMajor, flt->dim, flt->hist_size, flt->mu, 
-        flt->x_err, 1, flt->x_hist, 1, flt->wts, flt->hist_size
+    // Update weights and prediction in a single pass over weight matrix
+    // (wts := wts + mu * x_err * x_hist'; x_pred := wts * [x, x_hist[0:end-dim]])
+    if (flt->sparse) {
+        flt->kernel_sparse(
+            flt->wts, flt->dim, flt->order, flt->mu, flt->x_err,
+            flt->blk_old, flt->nzb_old, flt->nzn_old,
+            flt->blk_new, flt->nzb_new, flt->nzn_new,
+            flt->x_pred, row_begin, row_end
+        );
+    }
+    else {
+        flt->kernel(
+            flt->wts, flt->hist_size, flt->dim, flt->order, flt->mu,
+            flt->x_err, flt->blk_old, flt->blk_new, flt->x_pred, row_begin, row_end
+        );
+    }
+}
+
+
+// Add new signal value to history
+void FilterAutoLMS_ingest(struct FilterAutoLMS* flt, double* x) {
+
+    // Overwrite oldest slot with new signal value, which avoids shifting the
+    // whole history every step
+    flt->head = (flt->head + flt->order - 1) % flt->order;
+    double* x_head = flt->x_hist + flt->head * flt->dim;
+    for (int i = 0; i < flt->dim; i++) {
+        x_head[i] = x[i];
+    }
+
+    // Swap nonzero index list of new value into its slot (only kept in
+    // sparse-input mode)
+    if (!flt->sparse) {
+        return;
+    }
+    int* nz_tmp = flt->nz_idx[flt->head];
+    flt->nz_idx[flt->head] = flt->nz_idx[flt->order];
+    flt->nz_idx[flt->order] = nz_tmp;
+    flt->nz_count[flt->head] = flt->nz_count[flt->order];
+}
+
+
+// Update filter with new signal value and predict next value
+void FilterAutoLMS_predict_next(struct FilterAutoLMS* flt, double* x) {
+
+    FilterAutoLMS_prepare(flt, x);
+    FilterAutoLMS_update_rows(flt, x, 0, flt->dim);
+    FilterAutoLMS_ingest(flt, x);
+}
+
+
+// Write filter state to checkpoint file
+int FilterAutoLMS_save(struct FilterAutoLMS* flt, const char* fpath, long n_steps) {
+
+    int dim = flt->dim;
+
+    // Write to temporary file next to checkpoint
+    size_t tmp_len = strlen(fpath) + 5;
+    char* tmp_fpath = (char *) malloc(tmp_len);
+    snprintf(tmp_fpath, tmp_len, "%s.tmp", fpath);
+    FILE* fp = fopen(tmp_fpath, "wb");
+    if (fp == NULL) {
+        perror("Cannot open checkpoint file");
+        free(tmp_fpath);
+        return 1;
+    }
+
+    struct CheckpointHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = CHECKPOINT_MAGIC;
+    hdr.version = CHECKPOINT_VERSION;
+    hdr.dim = dim;
+    hdr.order = flt->order;
+    hdr.mu = flt->mu;
+    hdr.n_steps = n_steps;
+    int status = (fwrite(&hdr, sizeof(hdr), 1, fp) != 1);
+
+    // History, from newest block to oldest, and prediction
+    for (int k = 0; k < flt->order && status == 0; k++) {
+        const double* blk = flt->x_hist + ((flt->head + k) % flt->order) * dim;
+        status = (fwrite(blk, sizeof(double), dim, fp) != (size_t) dim);
+    }
+    if (status == 0) {
+        status = (fwrite(flt->x_pred, sizeof(double), dim, fp) != (size_t) dim);
+    }
+
+    // Weights, row by row (gathered from columns in sparse-input mode)
+    if (!flt->sparse) {
+        size_t n_wts = (size_t) dim * flt->hist_size;
+        status = status || (fwrite(flt->wts, sizeof(double), n_wts, fp) != n_wts);
+    }
+    else {
+        double* row = (double *) malloc(flt->hist_size * sizeof(double));
+        for (int i = 0; i < dim && status == 0; i++) {
+            for (int c = 0; c < flt->hist_size; c++) {
+                row[c] = flt->wts[(size_t) c * dim + i];
+            }
+            status = (fwrite(row, sizeof(double), flt->hist_size, fp) != (size_t) flt->hist_size);
+        }
+        free(row);
+    }
+
+    // Move finished checkpoint into place
+    if (fclose(fp) != 0) {
+        status = 1;
+    }
+    if (status == 0 && rename(tmp_fpath, fpath) != 0) {
+        perror("Cannot rename checkpoint file");
+        status = 1;
+    }
+    else if (status != 0) {
+        fprintf(stderr, "Failed to write checkpoint '%s'\n", tmp_fpath);
+        remove(tmp_fpath);
+    }
+
+    free(tmp_fpath);
+    return status;
+}
+
+
+// Read filter state from checkpoint file
+int FilterAutoLMS_load(struct FilterAutoLMS* flt, const char* fpath, long* n_steps) {
+
+    int dim = flt->dim;
+
+    FILE* fp = fopen(fpath, "rb");
+    if (fp == NULL) {
+        perror("Cannot open checkpoint file");
+        return 1;
+    }
+
+    // Check header, and that file holds the whole state, before touching the
+    // filter
+    struct CheckpointHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != CHECKPOINT_MAGIC
+            || hdr.version != CHECKPOINT_VERSION) {
+        fprintf(stderr, "'%s' is not a checkpoint\n", fpath);
+        fclose(fp);
+        return 1;
+    }
+    if (hdr.dim != dim || hdr.order != flt->order) {
+        fprintf(stderr, "Checkpoint '%s' is for %d neurons at order %d (filter has %d at order %d)\n",
+            fpath, hdr.dim, hdr.order, dim, flt->order);
+        fclose(fp);
+        return 1;
+    }
+    long expected = (long) sizeof(hdr) + (long) ((size_t) flt->hist_size + dim
+        + (size_t) dim * flt->hist_size) * sizeof(double);
+    if (fseek(fp, 0, SEEK_END) != 0 || ftell(fp) != expected || fseek(fp, sizeof(hdr), SEEK_SET) != 0) {
+        fprintf(stderr, "Checkpoint '%s' is truncated\n", fpath);
+        fclose(fp);
+        return 1;
+    }
+
+    // History (newest block into slot 0), with nonzero index lists of each
+    // slot, and prediction
+    int status = 0;
+    flt->head = 0;
+    status = (fread(flt->x_hist, sizeof(double), flt->hist_size, fp) != (size_t) flt->hist_size);
+    for (int s = 0; s < flt->order && flt->sparse; s++) {
+        flt->nz_count[s] = find_nonzero(flt->x_hist + s * dim, dim, flt->nz_idx[s]);
+    }
+    status = status || (fread(flt->x_pred, sizeof(double), dim, fp) != (size_t) dim);
+
+    // Weights, row by row (scattered into columns in sparse-input mode)
+    if (!flt->sparse) {
+        size_t n_wts = (size_t) dim * flt->hist_size;
+        status = status || (fread(flt->wts, sizeof(double), n_wts, fp) != n_wts);
+    }
+    else {
+        double* row = (double *) malloc(flt->hist_size * sizeof(double));
+        for (int i = 0; i < dim && status == 0; i++) {
+            status = (fread(row, sizeof(double), flt->hist_size, fp) != (size_t) flt->hist_size);
+            for (int c = 0; c < flt->hist_size; c++) {
+                flt->wts[(size_t) c * dim + i] = row[c];
+            }
+        }
+        free(row);
+    }
+    fclose(fp);
+
+    if (status != 0) {
+        fprintf(stderr, "Failed to read checkpoint '%s'\n", fpath);
+        return 1;
+    }
+    flt->mu = hdr.mu;
+    *n_steps = (long) hdr.n_steps;
+    return 0;
+}
+
+
+// Grow block buffers to hold n samples
+static void reserve_block(struct FilterAutoLMS* flt, int n) {
+
+    if (n <= flt->blk_cap) {
+        return;
+    }
+    free(flt->blk_err);
+    free(flt->blk_rows);
+    flt->blk_rows = (double *) malloc((size_t) (n + 1) * flt->hist_size * sizeof(double));
+    flt->blk_err = (double *) malloc((size_t) n * flt->dim * sizeof(double));
+    flt->blk_cap = n;
+}
+
+
+// Update filter with n signal values and write prediction made after each
+void FilterAutoLMS_predict_block(struct FilterAutoLMS* flt, const double* x, int n, double* preds) {
+
+    int dim = flt->dim;
+    int order = flt->order;
+    int hist_size = flt->hist_size;
+
+    // Nothing to do for an empty block
+    if (n < 1) {
+        return;
+    }
+
+    // Weights of sparse-input filters are column-major and updated only where
+    // history is nonzero, so take their samples one at a time
+    if (flt->sparse) {
+        for (int t = 0; t < n; t++) {
+            FilterAutoLMS_predict_next(flt, (double*) x + (size_t) t * dim);
+            memcpy(preds + (size_t) t * dim, flt->x_pred, dim * sizeof(double));
+        }
+        return;
+    }
+    reserve_block(flt, n);
+    double* rows = flt->blk_rows;
+    double* err = flt->blk_err;
+
+    // Lay out history after the first t samples of block as row t (block k
+    // is sample t - 1 - k, or block k - t of the history from before the
+    // block)
+    for (int t = 0; t <= n; t++) {
+        double* row = rows + (size_t) t * hist_size;
+        for (int k = 0; k < order; k++) {
+            const double* src = (k < t) ? x + (size_t) (t - 1 - k) * dim
+                : flt->x_hist + ((flt->head + k - t) % order) * dim;
+            memcpy(row + k * dim, src, dim * sizeof(double));
+        }
+    }
+
+    // Predict samples 1 .. n - 1 with weights from start of block
+    // (preds[t - 1] := wts * rows[t])
+    if (n > 1) {
+        cblas_dgemm(
+            CblasRowMajor, CblasNoTrans, CblasTrans, n - 1, dim, hist_size, 1.0,
+            rows + hist_size, hist_size, flt->wts, hist_size, 0.0, preds, dim
+        );
+    }
+
+    // Compute errors (sample 0 was predicted before the block)
+    for (int t = 0; t < n; t++) {
+        const double* pred = (t == 0) ? flt->x_pred : preds + (size_t) (t - 1) * dim;
+        for (int i = 0; i < dim; i++) {
+            err[(size_t) t * dim + i] = x[(size_t) t * dim + i] - pred[i];
+        }
+    }
+
+    // Apply sum of updates of block (wts := wts + mu * err' * rows[0:n])
+    cblas_dgemm(
+        CblasRowMajor, CblasTrans, CblasNoTrans, dim, hist_size, n, flt->mu,
+        err, dim, rows, hist_size, 1.0, flt->wts, hist_size
+    );
+
+    // Predict next value with updated weights
+    cblas_dgemv(
+        CblasRowMajor, CblasNoTrans, dim, hist_size, 1.0, flt->wts, hist_size,
+        rows + (size_t) n * hist_size, 1, 0.0, flt->x_pred, 1
     );
+    memcpy(preds + (size_t) (n - 1) * dim, flt->x_pred, dim * sizeof(double));
+    memcpy(flt->x_err, err + (size_t) (n - 1) * dim, dim * sizeof(double));
+
+    // Add samples to history (only the last 'order' of them stay in it)
+    for (int t = (n > order) ? n - order : 0; t < n; t++) {
+        flt->head = (flt->head + order - 1) % order;
+        memcpy(flt->x_hist + flt->head * dim, x + (size_t) t * dim, dim * sizeof(double));
+    }
+}
+
+
+// Constructor for FilterAutoLMS32 object
+void FilterAutoLMS32_new(struct FilterAutoLMS32* flt, int dim, int order, double mu, int mixed) {
+
+    // Number of elements in history
+    int hist_size = dim * order;
+
+    // Allocate arrays for prediction and error and set to zero
+    flt->x_pred = (double *) malloc(dim * sizeof(double));
+    flt->x_err = (double *) malloc(dim * sizeof(double));
+    for (int i = 0; i < dim; i++) {
+        flt->x_pred[i] = 0.0;
+        flt->x_err[i] = 0.0;
+    }
 
-    // Update history (x_hist[dim:end] := x_hist[0:end-dim]; x_hist[0:dim] := x)
-    for (int i = (flt->hist_size - 1); i >= flt->dim; i--) {
-        flt->x_hist[i] = flt->x_hist[i - flt->dim];
+    // Allocate array for history and set to zero
+    flt->x_hist = (float *) malloc(hist_size * sizeof(float));
+    for (int i = 0; i < hist_size; i++) {
+        flt->x_hist[i] = 0.0f;
+    }
+    flt->x_new = (float *) malloc(dim * sizeof(float));
+
+    // Allocate array for weights and set to zero
+    flt->wts = (float *) malloc((long) dim * hist_size * sizeof(float));
+    for (long i = 0; i < (long) dim * hist_size; i++) {
+        flt->wts[i] = 0.0f;
     }
+
+    // Allocate arrays of pointers to history blocks
+    flt->blk_old = (const float **) malloc(order * sizeof(float*));
+    flt->blk_new = (const float **) malloc(order * sizeof(float*));
+
+    // Populate fields
+    flt->dim = dim;
+    flt->order = order;
+    flt->hist_size = hist_size;
+    flt->mu = mu;
+    flt->mixed = mixed;
+    flt->head = 0;
+    flt->kernel = kernel_lms32_select(mixed);
+}
+
+
+// Destructor for FilterAutoLMS32 object
+void FilterAutoLMS32_delete(struct FilterAutoLMS32* flt) {
+
+    // Free allocated memory
+    free(flt->blk_new);
+    free(flt->blk_old);
+    free(flt->wts);
+    free(flt->x_new);
+    free(flt->x_hist);
+    free(flt->x_err);
+    free(flt->x_pred);
+}
+
+
+// Update filter with new signal value and predict next value
+void FilterAutoLMS32_predict_next(struct FilterAutoLMS32* flt, double* x) {
+
+    // Compute error and convert signal value to float
     for (int i = 0; i < flt->dim; i++) {
-        flt->x_hist[i] = x[i];
+        flt->x_err[i] = x[i] - flt->x_pred[i];
+        flt->x_new[i] = (float) x[i];
     }
 
-    // Update prediction (x_pred := wts * x_hist)
-    cblas_dgemv(
-        CblasRowMajor, CblasNoTrans, flt->dim, flt->hist_size, 1.0, 
-        flt->wts, flt->hist_size, flt->x_hist, 1, 0.0, flt->x_pred, 1
+    // Point kernel at history blocks
+    for (int k = 0; k < flt->order; k++) {
+        flt->blk_old[k] = flt->x_hist + ((flt->head + k) % flt->order) * flt->dim;
+        flt->blk_new[k] = (k == 0) ? flt->x_new : flt->blk_old[k - 1];
+    }
+
+    // Update weights and prediction in a single pass over weight matrix
+    flt->kernel(
+        flt->wts, flt->hist_size, flt->dim, flt->order, flt->mu,
+        flt->x_err, flt->blk_old, flt->blk_new, flt->x_pred, 0, flt->dim
     );
+
+    // Overwrite oldest slot of history with new signal value
+    flt->head = (flt->head + flt->order - 1) % flt->order;
+    float* x_head = flt->x_hist + flt->head * flt->dim;
+    for (int i = 0; i < flt->dim; i++) {
+        x_head[i] = flt->x_new[i];
+    }
 }
 
 
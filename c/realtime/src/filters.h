@@ -4,6 +4,10 @@
 #ifndef _FILTERS_H
 #define _FILTERS_H
 
+#include <stdint.h>
+
+#include "kernels.h"
+
 
 /* Autoregressive least-mean-squares filter */
 struct FilterAutoLMS {
@@ -20,17 +24,57 @@ struct FilterAutoLMS {
     // Step size used for filter updates
     double mu;
 
-    // Filter prediction (should always be equal to wts * x_hist)
+    // Filter prediction (should always be equal to wts * x_hist, with history
+    // blocks taken in order from newest to oldest)
     double* x_pred;
 
     // Filter error from last step
     double* x_err;
 
-    // Signal history (represented as vector of concatenated signal vectors)
+    // Signal history (circular buffer of 'order' signal vectors; the newest
+    // vector is stored in slot 'head', and the vector from k steps back is
+    // stored in slot (head + k) % order)
     double* x_hist;
 
-    // Weight matrix (row-major)
+    // Slot of x_hist holding newest signal vector
+    int head;
+
+    // Weight matrix (row-major, or column-major in sparse-input mode)
     double* wts;
+
+    // Sparse-input mode flag (1 if weights are updated and read only where
+    // history entries are nonzero, 0 otherwise)
+    int sparse;
+
+    // Fused update-and-predict kernels selected for this CPU
+    KernelLMS kernel;
+    KernelLMSSparse kernel_sparse;
+
+    // Pointers to blocks of history before (blk_old) and after (blk_new)
+    // adding the newest signal value, passed to the kernel
+    const double** blk_old;
+    const double** blk_new;
+
+    // Indices of nonzero entries of each history slot (nz_idx[s] holds
+    // nz_count[s] indices for slot s; the extra entry nz_idx[order] holds the
+    // indices for the newest signal value before it is added to the history;
+    // only kept up to date in sparse-input mode)
+    int** nz_idx;
+    int* nz_count;
+
+    // Nonzero index lists matching blk_old and blk_new, passed to the sparse
+    // kernel
+    const int** nzb_old;
+    const int** nzb_new;
+    int* nzn_old;
+    int* nzn_new;
+
+    // Buffers used by FilterAutoLMS_predict_block() (allocated on first use):
+    // history before each sample of block as rows, errors of block, and
+    // number of samples they can hold
+    double* blk_rows;
+    double* blk_err;
+    int blk_cap;
 };
 
 // Constructor for filter object
@@ -39,9 +83,164 @@ void FilterAutoLMS_new(struct FilterAutoLMS* flt, int dim, int order, double mu)
 // Destructor for filter object
 void FilterAutoLMS_delete(struct FilterAutoLMS* flt);
 
+// Constructor for filter object in sparse-input mode, which only touches
+// weights that multiply nonzero history entries (much faster for sparse
+// signals such as spike counts, same predictions up to rounding)
+void FilterAutoLMS_new_sparse(struct FilterAutoLMS* flt, int dim, int order, double mu);
+
 // Update filter with new signal value and predict next value
 void FilterAutoLMS_predict_next(struct FilterAutoLMS* flt, double* x);
 
+/* Block LMS
+ *
+ * FilterAutoLMS_predict_block() takes n signal values at once (n rows of
+ * length dim) and writes the n predictions that FilterAutoLMS_predict_next()
+ * would have left in x_pred after each of them (n rows of preds). Within the
+ * block the weights are held fixed: the predictions for samples 1 .. n - 1
+ * come out of one matrix-matrix product with the weights from the start of the
+ * block, and the sum of the n rank-1 updates is applied with a second one,
+ *
+ *     wts := wts + mu * err' * H
+ *
+ * where row t of H is the history before sample t. Only the last prediction
+ * uses the updated weights. This is the block LMS algorithm. For n = 1 it is
+ * the per-sample filter (up to rounding), and a block of n samples moves the
+ * weights about as far as n per-sample steps.
+ *
+ * Because the n updates are all computed from the weights at the start of the
+ * block, the block update behaves like a single per-sample step of size
+ * n * mu, and its stable range shrinks accordingly. Where per-sample LMS needs
+ * roughly 0 < mu < 2 / (3 * E|h|^2) (h a history vector), block LMS needs
+ * 0 < n * mu < 2 / (3 * E|h|^2): a step size is only safe with blocks of n if
+ * n times it is safe per sample. On the 64-neuron test recording, mu 0.01
+ * converges with n = 8 and diverges with n = 32; on a 100-neuron recording,
+ * mu 0.001 converges per sample and diverges with n = 8. Sparse-input filters
+ * process the block one sample at a time. n must be at least 1.
+ */
+
+// Update filter with n signal values and write prediction made after each
+void FilterAutoLMS_predict_block(struct FilterAutoLMS* flt, const double* x, int n, double* preds);
+
+/* The three steps of FilterAutoLMS_predict_next, exposed so that the row
+ * updates can be split across threads: call FilterAutoLMS_prepare() once,
+ * then FilterAutoLMS_update_rows() for ranges of rows covering [0, dim) (in
+ * any order or concurrently), then FilterAutoLMS_ingest() once.
+ */
+
+// Prepare filter for update with new signal value
+void FilterAutoLMS_prepare(struct FilterAutoLMS* flt, double* x);
+
+// Update weights and predictions for rows [row_begin, row_end)
+void FilterAutoLMS_update_rows(struct FilterAutoLMS* flt, double* x, int row_begin, int row_end);
+
+// Add new signal value to history
+void FilterAutoLMS_ingest(struct FilterAutoLMS* flt, double* x);
+
+/* Checkpoints
+ *
+ * FilterAutoLMS_save() writes the state of a filter (step size, history,
+ * prediction and weights) to a binary file. FilterAutoLMS_load() reads it
+ * back into a filter of the same dimension and order, so that a new session
+ * starts from weights that have already converged instead of from zero. The
+ * file is a CheckpointHeader followed by the history (newest block first), the
+ * prediction, and the weight matrix (row-major in either mode), all in host
+ * byte order. It is written under a temporary name and renamed into place, so
+ * a reader never sees a partly written checkpoint.
+ */
+
+// Magic number ('RTC1') and version at start of checkpoint
+#define CHECKPOINT_MAGIC 0x31435452
+#define CHECKPOINT_VERSION 1
+
+// Header of checkpoint
+struct CheckpointHeader {
+
+    // CHECKPOINT_MAGIC and CHECKPOINT_VERSION
+    uint32_t magic;
+    uint32_t version;
+
+    // Dimension and order of filter
+    int32_t dim;
+    int32_t order;
+
+    // Step size of filter
+    double mu;
+
+    // Number of steps filter had taken
+    int64_t n_steps;
+};
+
+// Write filter state to checkpoint file, recording that the filter has taken
+// n_steps steps; returns 0 on success
+int FilterAutoLMS_save(struct FilterAutoLMS* flt, const char* fpath, long n_steps);
+
+// Read filter state from checkpoint file, and set n_steps to the number of
+// steps recorded in it; returns 0 on success, and 1 if the file can't be read
+// or doesn't match the filter (the filter is left untouched then)
+int FilterAutoLMS_load(struct FilterAutoLMS* flt, const char* fpath, long* n_steps);
+
+
+/* Single-precision autoregressive least-mean-squares filter
+ *
+ * Same algorithm as FilterAutoLMS, but weights and history are stored as
+ * float, which halves the memory traffic of each step. Spike counts are
+ * represented exactly in float, so the only loss of precision is in the
+ * weights and (unless 'mixed' is set) in the accumulation of predictions.
+ */
+struct FilterAutoLMS32 {
+
+    // Dimension of signal
+    int dim;
+
+    // Order of filter (number of signal vectors in history)
+    int order;
+
+    // Size of history (dim * order)
+    int hist_size;
+
+    // Step size used for filter updates
+    double mu;
+
+    // Mixed-precision flag (1 if predictions are accumulated in double, 0 if
+    // they are accumulated in float)
+    int mixed;
+
+    // Filter prediction (kept in double so it can be sent as-is)
+    double* x_pred;
+
+    // Filter error from last step
+    double* x_err;
+
+    // Signal history (circular buffer, as in FilterAutoLMS)
+    float* x_hist;
+
+    // Slot of x_hist holding newest signal vector
+    int head;
+
+    // New signal value converted to float
+    float* x_new;
+
+    // Weight matrix (row-major)
+    float* wts;
+
+    // Fused update-and-predict kernel selected for this CPU
+    KernelLMS32 kernel;
+
+    // Pointers to blocks of history before and after adding the newest signal
+    // value, passed to the kernel
+    const float** blk_old;
+    const float** blk_new;
+};
+
+// Constructor for filter object (mixed is 1 for double accumulation)
+void FilterAutoLMS32_new(struct FilterAutoLMS32* flt, int dim, int order, double mu, int mixed);
+
+// Destructor for filter object
+void FilterAutoLMS32_delete(struct FilterAutoLMS32* flt);
+
+// Update filter with new signal value and predict next value
+void FilterAutoLMS32_predict_next(struct FilterAutoLMS32* flt, double* x);
+
 
 /* 'Echo' filter */
 struct FilterAutoEcho {
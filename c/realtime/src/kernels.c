@@ -0,0 +1,1125 @@
+/* Compute kernels
+ *
+ * Each kernel comes in a portable scalar version and, on x86-64 builds with
+ * GCC or Clang, AVX2 and AVX-512 versions. The vectorized versions are
+ * compiled with per-function target attributes, so the binary runs on any
+ * x86-64 CPU and the fastest version is picked at runtime.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "kernels.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+
+// Body of fused LMS kernel (portable scalar version; inlined into generic and
+// fixed-geometry kernels, so constant dim and order can be folded in)
+static inline __attribute__((always_inline)) void lms_rows_scalar(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        double* w = wts + (long) i * hist_size;
+        double a = mu * err[i];
+        double acc = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            double* w_k = w + k * dim;
+            const double* xo = x_old[k];
+            const double* xn = x_new[k];
+            for (int j = 0; j < dim; j++) {
+                w_k[j] += a * xo[j];
+                acc += w_k[j] * xn[j];
+            }
+        }
+
+        pred[i] = acc;
+    }
+}
+
+
+// Fused LMS kernel (portable scalar version)
+static void kernel_lms_scalar(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    lms_rows_scalar(wts, hist_size, dim, order, mu, err, x_old, x_new, pred, row_begin, row_end);
+}
+
+
+// Sparse-input fused LMS kernel (portable scalar version)
+static void kernel_lms_sparse_scalar(
+    double* wts, int dim, int order, double mu, const double* err,
+    const double* const* x_old, const int* const* nz_old, const int* n_nz_old,
+    const double* const* x_new, const int* const* nz_new, const int* n_nz_new,
+    double* pred, int row_begin, int row_end) {
+
+    // Update weight columns that multiply nonzero entries of old history
+    for (int k = 0; k < order; k++) {
+        for (int m = 0; m < n_nz_old[k]; m++) {
+            int j = nz_old[k][m];
+            double* w = wts + (long) (k * dim + j) * dim;
+            double a = mu * x_old[k][j];
+            for (int i = row_begin; i < row_end; i++) {
+                w[i] += a * err[i];
+            }
+        }
+    }
+
+    // Accumulate prediction over columns that multiply nonzero entries of new
+    // history
+    for (int i = row_begin; i < row_end; i++) {
+        pred[i] = 0.0;
+    }
+    for (int k = 0; k < order; k++) {
+        for (int m = 0; m < n_nz_new[k]; m++) {
+            int j = nz_new[k][m];
+            const double* w = wts + (long) (k * dim + j) * dim;
+            double v = x_new[k][j];
+            for (int i = row_begin; i < row_end; i++) {
+                pred[i] += v * w[i];
+            }
+        }
+    }
+}
+
+
+// Masked fused LMS kernel (portable scalar version)
+static void kernel_lms_masked_scalar(
+    double* wts, const int* row_ptr, const int* cols, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        int n = row_ptr[i + 1] - row_ptr[i];
+        const int* c = cols + row_ptr[i];
+        double* w = wts + (long) row_ptr[i] * order;
+        double a = mu * err[i];
+        double acc = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            double* w_k = w + k * n;
+            const double* xo = x_old[k];
+            const double* xn = x_new[k];
+            for (int m = 0; m < n; m++) {
+                w_k[m] += a * xo[c[m]];
+                acc += w_k[m] * xn[c[m]];
+            }
+        }
+
+        pred[i] = acc;
+    }
+}
+
+
+// Single-precision fused LMS kernel (portable scalar version)
+static void kernel_lms32_scalar(
+    float* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const float* const* x_old, const float* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        float* w = wts + (long) i * hist_size;
+        float a = (float) (mu * err[i]);
+        float acc = 0.0f;
+
+        for (int k = 0; k < order; k++) {
+            float* w_k = w + k * dim;
+            const float* xo = x_old[k];
+            const float* xn = x_new[k];
+            for (int j = 0; j < dim; j++) {
+                w_k[j] += a * xo[j];
+                acc += w_k[j] * xn[j];
+            }
+        }
+
+        pred[i] = (double) acc;
+    }
+}
+
+
+// Single-precision fused LMS kernel with double accumulation (portable scalar
+// version)
+static void kernel_lms32_mixed_scalar(
+    float* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const float* const* x_old, const float* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        float* w = wts + (long) i * hist_size;
+        float a = (float) (mu * err[i]);
+        double acc = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            float* w_k = w + k * dim;
+            const float* xo = x_old[k];
+            const float* xn = x_new[k];
+            for (int j = 0; j < dim; j++) {
+                w_k[j] += a * xo[j];
+                acc += (double) w_k[j] * (double) xn[j];
+            }
+        }
+
+        pred[i] = acc;
+    }
+}
+
+
+// Matrix-vector product kernel (portable scalar version)
+static void kernel_gemv_scalar(
+    const double* wts, int hist_size, int dim, int order,
+    const double* const* x, double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        const double* w = wts + (long) i * hist_size;
+        double acc = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            const double* w_k = w + k * dim;
+            const double* xk = x[k];
+            for (int j = 0; j < dim; j++) {
+                acc += w_k[j] * xk[j];
+            }
+        }
+
+        pred[i] = acc;
+    }
+}
+
+
+// Rank-1 LMS update kernel (portable scalar version)
+static void kernel_rank1_scalar(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        double* w = wts + (long) i * hist_size;
+        double a = mu * err[i];
+
+        for (int k = 0; k < order; k++) {
+            double* w_k = w + k * dim;
+            const double* xk = x[k];
+            for (int j = 0; j < dim; j++) {
+                w_k[j] += a * xk[j];
+            }
+        }
+    }
+}
+
+
+#ifdef KERNELS_X86
+
+// Sum of the four lanes of an AVX register
+__attribute__((target("avx2,fma")))
+static inline double hsum_avx2(__m256d v) {
+
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+
+// Body of fused LMS kernel (AVX2 + FMA version; inlined into generic and
+// fixed-geometry kernels, so constant dim and order can be folded in)
+__attribute__((target("avx2,fma")))
+static inline __attribute__((always_inline)) void lms_rows_avx2(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        double* w = wts + (long) i * hist_size;
+        double a = mu * err[i];
+        __m256d va = _mm256_set1_pd(a);
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+        double acc_s = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            double* w_k = w + k * dim;
+            const double* xo = x_old[k];
+            const double* xn = x_new[k];
+            int j = 0;
+            for (; j + 8 <= dim; j += 8) {
+                __m256d w0 = _mm256_loadu_pd(w_k + j);
+                __m256d w1 = _mm256_loadu_pd(w_k + j + 4);
+                w0 = _mm256_fmadd_pd(va, _mm256_loadu_pd(xo + j), w0);
+                w1 = _mm256_fmadd_pd(va, _mm256_loadu_pd(xo + j + 4), w1);
+                _mm256_storeu_pd(w_k + j, w0);
+                _mm256_storeu_pd(w_k + j + 4, w1);
+                acc0 = _mm256_fmadd_pd(w0, _mm256_loadu_pd(xn + j), acc0);
+                acc1 = _mm256_fmadd_pd(w1, _mm256_loadu_pd(xn + j + 4), acc1);
+            }
+            for (; j + 4 <= dim; j += 4) {
+                __m256d w0 = _mm256_loadu_pd(w_k + j);
+                w0 = _mm256_fmadd_pd(va, _mm256_loadu_pd(xo + j), w0);
+                _mm256_storeu_pd(w_k + j, w0);
+                acc0 = _mm256_fmadd_pd(w0, _mm256_loadu_pd(xn + j), acc0);
+            }
+            for (; j < dim; j++) {
+                w_k[j] += a * xo[j];
+                acc_s += w_k[j] * xn[j];
+            }
+        }
+
+        pred[i] = hsum_avx2(_mm256_add_pd(acc0, acc1)) + acc_s;
+    }
+}
+
+
+// Fused LMS kernel (AVX2 + FMA version)
+__attribute__((target("avx2,fma")))
+static void kernel_lms_avx2(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    lms_rows_avx2(wts, hist_size, dim, order, mu, err, x_old, x_new, pred, row_begin, row_end);
+}
+
+
+// Sparse-input fused LMS kernel (AVX2 + FMA version)
+__attribute__((target("avx2,fma")))
+static void kernel_lms_sparse_avx2(
+    double* wts, int dim, int order, double mu, const double* err,
+    const double* const* x_old, const int* const* nz_old, const int* n_nz_old,
+    const double* const* x_new, const int* const* nz_new, const int* n_nz_new,
+    double* pred, int row_begin, int row_end) {
+
+    // Update weight columns that multiply nonzero entries of old history
+    for (int k = 0; k < order; k++) {
+        for (int m = 0; m < n_nz_old[k]; m++) {
+            int j = nz_old[k][m];
+            double* w = wts + (long) (k * dim + j) * dim;
+            double a = mu * x_old[k][j];
+            __m256d va = _mm256_set1_pd(a);
+            int i = row_begin;
+            for (; i + 4 <= row_end; i += 4) {
+                __m256d w0 = _mm256_loadu_pd(w + i);
+                w0 = _mm256_fmadd_pd(va, _mm256_loadu_pd(err + i), w0);
+                _mm256_storeu_pd(w + i, w0);
+            }
+            for (; i < row_end; i++) {
+                w[i] += a * err[i];
+            }
+        }
+    }
+
+    // Accumulate prediction over columns that multiply nonzero entries of new
+    // history
+    for (int i = row_begin; i < row_end; i++) {
+        pred[i] = 0.0;
+    }
+    for (int k = 0; k < order; k++) {
+        for (int m = 0; m < n_nz_new[k]; m++) {
+            int j = nz_new[k][m];
+            const double* w = wts + (long) (k * dim + j) * dim;
+            double v = x_new[k][j];
+            __m256d vv = _mm256_set1_pd(v);
+            int i = row_begin;
+            for (; i + 4 <= row_end; i += 4) {
+                __m256d p0 = _mm256_loadu_pd(pred + i);
+                p0 = _mm256_fmadd_pd(vv, _mm256_loadu_pd(w + i), p0);
+                _mm256_storeu_pd(pred + i, p0);
+            }
+            for (; i < row_end; i++) {
+                pred[i] += v * w[i];
+            }
+        }
+    }
+}
+
+
+// Masked fused LMS kernel (AVX2 + FMA version)
+__attribute__((target("avx2,fma")))
+static void kernel_lms_masked_avx2(
+    double* wts, const int* row_ptr, const int* cols, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        int n = row_ptr[i + 1] - row_ptr[i];
+        const int* c = cols + row_ptr[i];
+        double* w = wts + (long) row_ptr[i] * order;
+        double a = mu * err[i];
+        __m256d va = _mm256_set1_pd(a);
+        __m256d acc0 = _mm256_setzero_pd();
+        double acc_s = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            double* w_k = w + k * n;
+            const double* xo = x_old[k];
+            const double* xn = x_new[k];
+            int m = 0;
+            for (; m + 4 <= n; m += 4) {
+                __m128i idx = _mm_loadu_si128((const __m128i*) (c + m));
+                __m256d w0 = _mm256_loadu_pd(w_k + m);
+                w0 = _mm256_fmadd_pd(va, _mm256_i32gather_pd(xo, idx, 8), w0);
+                _mm256_storeu_pd(w_k + m, w0);
+                acc0 = _mm256_fmadd_pd(w0, _mm256_i32gather_pd(xn, idx, 8), acc0);
+            }
+            for (; m < n; m++) {
+                w_k[m] += a * xo[c[m]];
+                acc_s += w_k[m] * xn[c[m]];
+            }
+        }
+
+        pred[i] = hsum_avx2(acc0) + acc_s;
+    }
+}
+
+
+// Single-precision fused LMS kernel (AVX2 + FMA version)
+__attribute__((target("avx2,fma")))
+static void kernel_lms32_avx2(
+    float* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const float* const* x_old, const float* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        float* w = wts + (long) i * hist_size;
+        float a = (float) (mu * err[i]);
+        __m256 va = _mm256_set1_ps(a);
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        float acc_s = 0.0f;
+
+        for (int k = 0; k < order; k++) {
+            float* w_k = w + k * dim;
+            const float* xo = x_old[k];
+            const float* xn = x_new[k];
+            int j = 0;
+            for (; j + 16 <= dim; j += 16) {
+                __m256 w0 = _mm256_loadu_ps(w_k + j);
+                __m256 w1 = _mm256_loadu_ps(w_k + j + 8);
+                w0 = _mm256_fmadd_ps(va, _mm256_loadu_ps(xo + j), w0);
+                w1 = _mm256_fmadd_ps(va, _mm256_loadu_ps(xo + j + 8), w1);
+                _mm256_storeu_ps(w_k + j, w0);
+                _mm256_storeu_ps(w_k + j + 8, w1);
+                acc0 = _mm256_fmadd_ps(w0, _mm256_loadu_ps(xn + j), acc0);
+                acc1 = _mm256_fmadd_ps(w1, _mm256_loadu_ps(xn + j + 8), acc1);
+            }
+            for (; j + 8 <= dim; j += 8) {
+                __m256 w0 = _mm256_loadu_ps(w_k + j);
+                w0 = _mm256_fmadd_ps(va, _mm256_loadu_ps(xo + j), w0);
+                _mm256_storeu_ps(w_k + j, w0);
+                acc0 = _mm256_fmadd_ps(w0, _mm256_loadu_ps(xn + j), acc0);
+            }
+            for (; j < dim; j++) {
+                w_k[j] += a * xo[j];
+                acc_s += w_k[j] * xn[j];
+            }
+        }
+
+        // Reduce accumulators in double
+        __m256 acc = _mm256_add_ps(acc0, acc1);
+        __m256d acc_d = _mm256_add_pd(
+            _mm256_cvtps_pd(_mm256_castps256_ps128(acc)),
+            _mm256_cvtps_pd(_mm256_extractf128_ps(acc, 1))
+        );
+        pred[i] = hsum_avx2(acc_d) + (double) acc_s;
+    }
+}
+
+
+// Single-precision fused LMS kernel with double accumulation (AVX2 + FMA
+// version)
+__attribute__((target("avx2,fma")))
+static void kernel_lms32_mixed_avx2(
+    float* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const float* const* x_old, const float* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        float* w = wts + (long) i * hist_size;
+        float a = (float) (mu * err[i]);
+        __m256 va = _mm256_set1_ps(a);
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+        double acc_s = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            float* w_k = w + k * dim;
+            const float* xo = x_old[k];
+            const float* xn = x_new[k];
+            int j = 0;
+            for (; j + 8 <= dim; j += 8) {
+                __m256 w0 = _mm256_loadu_ps(w_k + j);
+                w0 = _mm256_fmadd_ps(va, _mm256_loadu_ps(xo + j), w0);
+                _mm256_storeu_ps(w_k + j, w0);
+                __m256 x0 = _mm256_loadu_ps(xn + j);
+                acc0 = _mm256_fmadd_pd(
+                    _mm256_cvtps_pd(_mm256_castps256_ps128(w0)),
+                    _mm256_cvtps_pd(_mm256_castps256_ps128(x0)), acc0
+                );
+                acc1 = _mm256_fmadd_pd(
+                    _mm256_cvtps_pd(_mm256_extractf128_ps(w0, 1)),
+                    _mm256_cvtps_pd(_mm256_extractf128_ps(x0, 1)), acc1
+                );
+            }
+            for (; j < dim; j++) {
+                w_k[j] += a * xo[j];
+                acc_s += (double) w_k[j] * (double) xn[j];
+            }
+        }
+
+        pred[i] = hsum_avx2(_mm256_add_pd(acc0, acc1)) + acc_s;
+    }
+}
+
+
+// Matrix-vector product kernel (AVX2 + FMA version)
+__attribute__((target("avx2,fma")))
+static void kernel_gemv_avx2(
+    const double* wts, int hist_size, int dim, int order,
+    const double* const* x, double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        const double* w = wts + (long) i * hist_size;
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+        double acc_s = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            const double* w_k = w + k * dim;
+            const double* xk = x[k];
+            int j = 0;
+            for (; j + 8 <= dim; j += 8) {
+                acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(w_k + j), _mm256_loadu_pd(xk + j), acc0);
+                acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(w_k + j + 4), _mm256_loadu_pd(xk + j + 4), acc1);
+            }
+            for (; j < dim; j++) {
+                acc_s += w_k[j] * xk[j];
+            }
+        }
+
+        pred[i] = hsum_avx2(_mm256_add_pd(acc0, acc1)) + acc_s;
+    }
+}
+
+
+// Rank-1 LMS update kernel (AVX2 + FMA version)
+__attribute__((target("avx2,fma")))
+static void kernel_rank1_avx2(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        double* w = wts + (long) i * hist_size;
+        double a = mu * err[i];
+        __m256d va = _mm256_set1_pd(a);
+
+        for (int k = 0; k < order; k++) {
+            double* w_k = w + k * dim;
+            const double* xk = x[k];
+            int j = 0;
+            for (; j + 4 <= dim; j += 4) {
+                __m256d w0 = _mm256_fmadd_pd(va, _mm256_loadu_pd(xk + j), _mm256_loadu_pd(w_k + j));
+                _mm256_storeu_pd(w_k + j, w0);
+            }
+            for (; j < dim; j++) {
+                w_k[j] += a * xk[j];
+            }
+        }
+    }
+}
+
+
+// Body of fused LMS kernel (AVX-512 version; inlined into generic and
+// fixed-geometry kernels, so constant dim and order can be folded in)
+__attribute__((target("avx512f")))
+static inline __attribute__((always_inline)) void lms_rows_avx512(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        double* w = wts + (long) i * hist_size;
+        double a = mu * err[i];
+        __m512d va = _mm512_set1_pd(a);
+        __m512d acc0 = _mm512_setzero_pd();
+        __m512d acc1 = _mm512_setzero_pd();
+        double acc_s = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            double* w_k = w + k * dim;
+            const double* xo = x_old[k];
+            const double* xn = x_new[k];
+            int j = 0;
+            for (; j + 16 <= dim; j += 16) {
+                __m512d w0 = _mm512_loadu_pd(w_k + j);
+                __m512d w1 = _mm512_loadu_pd(w_k + j + 8);
+                w0 = _mm512_fmadd_pd(va, _mm512_loadu_pd(xo + j), w0);
+                w1 = _mm512_fmadd_pd(va, _mm512_loadu_pd(xo + j + 8), w1);
+                _mm512_storeu_pd(w_k + j, w0);
+                _mm512_storeu_pd(w_k + j + 8, w1);
+                acc0 = _mm512_fmadd_pd(w0, _mm512_loadu_pd(xn + j), acc0);
+                acc1 = _mm512_fmadd_pd(w1, _mm512_loadu_pd(xn + j + 8), acc1);
+            }
+            for (; j + 8 <= dim; j += 8) {
+                __m512d w0 = _mm512_loadu_pd(w_k + j);
+                w0 = _mm512_fmadd_pd(va, _mm512_loadu_pd(xo + j), w0);
+                _mm512_storeu_pd(w_k + j, w0);
+                acc0 = _mm512_fmadd_pd(w0, _mm512_loadu_pd(xn + j), acc0);
+            }
+            for (; j < dim; j++) {
+                w_k[j] += a * xo[j];
+                acc_s += w_k[j] * xn[j];
+            }
+        }
+
+        pred[i] = _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)) + acc_s;
+    }
+}
+
+
+// Fused LMS kernel (AVX-512 version)
+__attribute__((target("avx512f")))
+static void kernel_lms_avx512(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    lms_rows_avx512(wts, hist_size, dim, order, mu, err, x_old, x_new, pred, row_begin, row_end);
+}
+
+
+// Sparse-input fused LMS kernel (AVX-512 version)
+__attribute__((target("avx512f")))
+static void kernel_lms_sparse_avx512(
+    double* wts, int dim, int order, double mu, const double* err,
+    const double* const* x_old, const int* const* nz_old, const int* n_nz_old,
+    const double* const* x_new, const int* const* nz_new, const int* n_nz_new,
+    double* pred, int row_begin, int row_end) {
+
+    // Update weight columns that multiply nonzero entries of old history
+    for (int k = 0; k < order; k++) {
+        for (int m = 0; m < n_nz_old[k]; m++) {
+            int j = nz_old[k][m];
+            double* w = wts + (long) (k * dim + j) * dim;
+            double a = mu * x_old[k][j];
+            __m512d va = _mm512_set1_pd(a);
+            int i = row_begin;
+            for (; i + 8 <= row_end; i += 8) {
+                __m512d w0 = _mm512_loadu_pd(w + i);
+                w0 = _mm512_fmadd_pd(va, _mm512_loadu_pd(err + i), w0);
+                _mm512_storeu_pd(w + i, w0);
+            }
+            for (; i < row_end; i++) {
+                w[i] += a * err[i];
+            }
+        }
+    }
+
+    // Accumulate prediction over columns that multiply nonzero entries of new
+    // history
+    for (int i = row_begin; i < row_end; i++) {
+        pred[i] = 0.0;
+    }
+    for (int k = 0; k < order; k++) {
+        for (int m = 0; m < n_nz_new[k]; m++) {
+            int j = nz_new[k][m];
+            const double* w = wts + (long) (k * dim + j) * dim;
+            double v = x_new[k][j];
+            __m512d vv = _mm512_set1_pd(v);
+            int i = row_begin;
+            for (; i + 8 <= row_end; i += 8) {
+                __m512d p0 = _mm512_loadu_pd(pred + i);
+                p0 = _mm512_fmadd_pd(vv, _mm512_loadu_pd(w + i), p0);
+                _mm512_storeu_pd(pred + i, p0);
+            }
+            for (; i < row_end; i++) {
+                pred[i] += v * w[i];
+            }
+        }
+    }
+}
+
+
+
+// Masked fused LMS kernel (AVX-512 version)
+__attribute__((target("avx512f")))
+static void kernel_lms_masked_avx512(
+    double* wts, const int* row_ptr, const int* cols, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        int n = row_ptr[i + 1] - row_ptr[i];
+        const int* c = cols + row_ptr[i];
+        double* w = wts + (long) row_ptr[i] * order;
+        double a = mu * err[i];
+        __m512d va = _mm512_set1_pd(a);
+        __m512d acc0 = _mm512_setzero_pd();
+        double acc_s = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            double* w_k = w + k * n;
+            const double* xo = x_old[k];
+            const double* xn = x_new[k];
+            int m = 0;
+            for (; m + 8 <= n; m += 8) {
+                __m256i idx = _mm256_loadu_si256((const __m256i*) (c + m));
+                __m512d w0 = _mm512_loadu_pd(w_k + m);
+                w0 = _mm512_fmadd_pd(va, _mm512_i32gather_pd(idx, xo, 8), w0);
+                _mm512_storeu_pd(w_k + m, w0);
+                acc0 = _mm512_fmadd_pd(w0, _mm512_i32gather_pd(idx, xn, 8), acc0);
+            }
+            for (; m < n; m++) {
+                w_k[m] += a * xo[c[m]];
+                acc_s += w_k[m] * xn[c[m]];
+            }
+        }
+
+        pred[i] = _mm512_reduce_add_pd(acc0) + acc_s;
+    }
+}
+
+
+// Single-precision fused LMS kernel (AVX-512 version)
+__attribute__((target("avx512f")))
+static void kernel_lms32_avx512(
+    float* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const float* const* x_old, const float* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        float* w = wts + (long) i * hist_size;
+        float a = (float) (mu * err[i]);
+        __m512 va = _mm512_set1_ps(a);
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        float acc_s = 0.0f;
+
+        for (int k = 0; k < order; k++) {
+            float* w_k = w + k * dim;
+            const float* xo = x_old[k];
+            const float* xn = x_new[k];
+            int j = 0;
+            for (; j + 32 <= dim; j += 32) {
+                __m512 w0 = _mm512_loadu_ps(w_k + j);
+                __m512 w1 = _mm512_loadu_ps(w_k + j + 16);
+                w0 = _mm512_fmadd_ps(va, _mm512_loadu_ps(xo + j), w0);
+                w1 = _mm512_fmadd_ps(va, _mm512_loadu_ps(xo + j + 16), w1);
+                _mm512_storeu_ps(w_k + j, w0);
+                _mm512_storeu_ps(w_k + j + 16, w1);
+                acc0 = _mm512_fmadd_ps(w0, _mm512_loadu_ps(xn + j), acc0);
+                acc1 = _mm512_fmadd_ps(w1, _mm512_loadu_ps(xn + j + 16), acc1);
+            }
+            for (; j + 16 <= dim; j += 16) {
+                __m512 w0 = _mm512_loadu_ps(w_k + j);
+                w0 = _mm512_fmadd_ps(va, _mm512_loadu_ps(xo + j), w0);
+                _mm512_storeu_ps(w_k + j, w0);
+                acc0 = _mm512_fmadd_ps(w0, _mm512_loadu_ps(xn + j), acc0);
+            }
+            for (; j < dim; j++) {
+                w_k[j] += a * xo[j];
+                acc_s += w_k[j] * xn[j];
+            }
+        }
+
+        // Reduce accumulators in double
+        __m512 acc = _mm512_add_ps(acc0, acc1);
+        __m512d acc_d = _mm512_add_pd(
+            _mm512_cvtps_pd(_mm512_castps512_ps256(acc)),
+            _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(acc), 1)))
+        );
+        pred[i] = _mm512_reduce_add_pd(acc_d) + (double) acc_s;
+    }
+}
+
+
+// Single-precision fused LMS kernel with double accumulation (AVX-512
+// version)
+__attribute__((target("avx512f")))
+static void kernel_lms32_mixed_avx512(
+    float* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const float* const* x_old, const float* const* x_new,
+    double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        float* w = wts + (long) i * hist_size;
+        float a = (float) (mu * err[i]);
+        __m512 va = _mm512_set1_ps(a);
+        __m512d acc0 = _mm512_setzero_pd();
+        __m512d acc1 = _mm512_setzero_pd();
+        double acc_s = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            float* w_k = w + k * dim;
+            const float* xo = x_old[k];
+            const float* xn = x_new[k];
+            int j = 0;
+            for (; j + 16 <= dim; j += 16) {
+                __m512 w0 = _mm512_loadu_ps(w_k + j);
+                w0 = _mm512_fmadd_ps(va, _mm512_loadu_ps(xo + j), w0);
+                _mm512_storeu_ps(w_k + j, w0);
+                __m512 x0 = _mm512_loadu_ps(xn + j);
+                acc0 = _mm512_fmadd_pd(
+                    _mm512_cvtps_pd(_mm512_castps512_ps256(w0)),
+                    _mm512_cvtps_pd(_mm512_castps512_ps256(x0)), acc0
+                );
+                acc1 = _mm512_fmadd_pd(
+                    _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(w0), 1))),
+                    _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(x0), 1))), acc1
+                );
+            }
+            for (; j < dim; j++) {
+                w_k[j] += a * xo[j];
+                acc_s += (double) w_k[j] * (double) xn[j];
+            }
+        }
+
+        pred[i] = _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)) + acc_s;
+    }
+}
+
+
+// Matrix-vector product kernel (AVX-512 version)
+__attribute__((target("avx512f")))
+static void kernel_gemv_avx512(
+    const double* wts, int hist_size, int dim, int order,
+    const double* const* x, double* pred, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        const double* w = wts + (long) i * hist_size;
+        __m512d acc0 = _mm512_setzero_pd();
+        __m512d acc1 = _mm512_setzero_pd();
+        double acc_s = 0.0;
+
+        for (int k = 0; k < order; k++) {
+            const double* w_k = w + k * dim;
+            const double* xk = x[k];
+            int j = 0;
+            for (; j + 16 <= dim; j += 16) {
+                acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(w_k + j), _mm512_loadu_pd(xk + j), acc0);
+                acc1 = _mm512_fmadd_pd(_mm512_loadu_pd(w_k + j + 8), _mm512_loadu_pd(xk + j + 8), acc1);
+            }
+            for (; j + 8 <= dim; j += 8) {
+                acc0 = _mm512_fmadd_pd(_mm512_loadu_pd(w_k + j), _mm512_loadu_pd(xk + j), acc0);
+            }
+            for (; j < dim; j++) {
+                acc_s += w_k[j] * xk[j];
+            }
+        }
+
+        pred[i] = _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1)) + acc_s;
+    }
+}
+
+
+// Rank-1 LMS update kernel (AVX-512 version)
+__attribute__((target("avx512f")))
+static void kernel_rank1_avx512(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x, int row_begin, int row_end) {
+
+    for (int i = row_begin; i < row_end; i++) {
+
+        double* w = wts + (long) i * hist_size;
+        double a = mu * err[i];
+        __m512d va = _mm512_set1_pd(a);
+
+        for (int k = 0; k < order; k++) {
+            double* w_k = w + k * dim;
+            const double* xk = x[k];
+            int j = 0;
+            for (; j + 8 <= dim; j += 8) {
+                __m512d w0 = _mm512_fmadd_pd(va, _mm512_loadu_pd(xk + j), _mm512_loadu_pd(w_k + j));
+                _mm512_storeu_pd(w_k + j, w0);
+            }
+            for (; j < dim; j++) {
+                w_k[j] += a * xk[j];
+            }
+        }
+    }
+}
+
+#endif
+
+
+/* Fixed-geometry fused LMS kernels
+ *
+ * Our rigs record a few fixed channel counts, all with order 5, so for those
+ * geometries each instruction set gets a copy of the fused kernel with dim,
+ * order and hist_size passed to the inlined row loop as constants, so the
+ * compiler sees the trip counts of the loops over history blocks and over
+ * each block and can drop the remainder loops that dim never needs. The
+ * copies use the same unaligned loads and stores as the generic kernels (the
+ * newest sample comes straight from the caller's buffer, which has no
+ * alignment guarantee). kernel_lms_select_for() picks the copy matching the
+ * geometry received in the handshake.
+ */
+
+// Instantiate fixed-geometry kernel for instruction set isa (attributes in
+// LMS_TARGET_<isa>) with dimension D and order O
+#define LMS_TARGET_scalar
+#define LMS_TARGET_avx2 __attribute__((target("avx2,fma")))
+#define LMS_TARGET_avx512 __attribute__((target("avx512f")))
+#define DEFINE_LMS_FIXED(isa, D, O) \
+    LMS_TARGET_##isa \
+    static void kernel_lms_##isa##_##D##x##O( \
+        double* wts, int hist_size, int dim, int order, double mu, \
+        const double* err, const double* const* x_old, const double* const* x_new, \
+        double* pred, int row_begin, int row_end) { \
+        (void) hist_size; (void) dim; (void) order; \
+        lms_rows_##isa(wts, (D) * (O), D, O, mu, err, x_old, x_new, pred, row_begin, row_end); \
+    }
+
+// Instantiate kernels for geometry on every instruction set
+#ifdef KERNELS_X86
+#define DEFINE_LMS_FIXED_ALL(D, O) \
+    DEFINE_LMS_FIXED(scalar, D, O) \
+    DEFINE_LMS_FIXED(avx2, D, O) \
+    DEFINE_LMS_FIXED(avx512, D, O)
+#else
+#define DEFINE_LMS_FIXED_ALL(D, O) \
+    DEFINE_LMS_FIXED(scalar, D, O)
+#endif
+
+DEFINE_LMS_FIXED_ALL(64, 5)
+DEFINE_LMS_FIXED_ALL(128, 5)
+DEFINE_LMS_FIXED_ALL(384, 5)
+
+// Fixed-geometry kernel, with generic kernel of the same instruction set
+struct FixedKernelLMS {
+    int dim;
+    int order;
+    KernelLMS generic;
+    KernelLMS fixed;
+    const char* name;
+};
+
+// Table of fixed-geometry kernels
+#ifdef KERNELS_X86
+#define FIXED_LMS_ENTRIES(D, O) \
+    {D, O, kernel_lms_scalar, kernel_lms_scalar_##D##x##O, "scalar-" #D "x" #O}, \
+    {D, O, kernel_lms_avx2, kernel_lms_avx2_##D##x##O, "avx2-" #D "x" #O}, \
+    {D, O, kernel_lms_avx512, kernel_lms_avx512_##D##x##O, "avx512-" #D "x" #O},
+#else
+#define FIXED_LMS_ENTRIES(D, O) \
+    {D, O, kernel_lms_scalar, kernel_lms_scalar_##D##x##O, "scalar-" #D "x" #O},
+#endif
+static const struct FixedKernelLMS FIXED_LMS_KERNELS[] = {
+    FIXED_LMS_ENTRIES(64, 5)
+    FIXED_LMS_ENTRIES(128, 5)
+    FIXED_LMS_ENTRIES(384, 5)
+};
+
+// Number of fixed-geometry kernels
+#define N_FIXED_LMS_KERNELS (sizeof(FIXED_LMS_KERNELS) / sizeof(FIXED_LMS_KERNELS[0]))
+
+
+// Select fastest LMS kernel supported by this CPU
+KernelLMS kernel_lms_select(void) {
+
+    const char* isa = getenv("REALTIME_ISA");
+    if (isa != NULL && strcmp(isa, "scalar") == 0) {
+        return kernel_lms_scalar;
+    }
+
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    int has_avx512 = __builtin_cpu_supports("avx512f");
+    int has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+    if (isa != NULL && strcmp(isa, "avx2") == 0) {
+        has_avx512 = 0;
+    }
+    if (has_avx512) {
+        return kernel_lms_avx512;
+    }
+    if (has_avx2) {
+        return kernel_lms_avx2;
+    }
+#endif
+
+    return kernel_lms_scalar;
+}
+
+
+// Select fastest LMS kernel for geometry
+KernelLMS kernel_lms_select_for(int dim, int order) {
+
+    KernelLMS generic = kernel_lms_select();
+
+    // Setting REALTIME_FIXED to 0 keeps the generic kernel (for comparison)
+    const char* fixed = getenv("REALTIME_FIXED");
+    if (fixed != NULL && strcmp(fixed, "0") == 0) {
+        return generic;
+    }
+
+    for (int i = 0; i < (int) N_FIXED_LMS_KERNELS; i++) {
+        const struct FixedKernelLMS* fk = &FIXED_LMS_KERNELS[i];
+        if (fk->generic == generic && fk->dim == dim && fk->order == order) {
+            return fk->fixed;
+        }
+    }
+
+    return generic;
+}
+
+
+// Name of instruction set used by kernel
+const char* kernel_lms_name(KernelLMS kernel) {
+
+    for (int i = 0; i < (int) N_FIXED_LMS_KERNELS; i++) {
+        if (kernel == FIXED_LMS_KERNELS[i].fixed) {
+            return FIXED_LMS_KERNELS[i].name;
+        }
+    }
+
+#ifdef KERNELS_X86
+    if (kernel == kernel_lms_avx512) {
+        return "avx512";
+    }
+    if (kernel == kernel_lms_avx2) {
+        return "avx2";
+    }
+#endif
+    if (kernel == kernel_lms_scalar) {
+        return "scalar";
+    }
+
+    return "unknown";
+}
+
+
+// Select fastest sparse-input LMS kernel supported by this CPU
+KernelLMSSparse kernel_lms_sparse_select(void) {
+
+    // Use same instruction set as dense kernel
+    KernelLMS dense = kernel_lms_select();
+
+#ifdef KERNELS_X86
+    if (dense == kernel_lms_avx512) {
+        return kernel_lms_sparse_avx512;
+    }
+    if (dense == kernel_lms_avx2) {
+        return kernel_lms_sparse_avx2;
+    }
+#endif
+
+    return kernel_lms_sparse_scalar;
+}
+
+
+// Name of instruction set used by sparse-input kernel
+const char* kernel_lms_sparse_name(KernelLMSSparse kernel) {
+
+#ifdef KERNELS_X86
+    if (kernel == kernel_lms_sparse_avx512) {
+        return "avx512";
+    }
+    if (kernel == kernel_lms_sparse_avx2) {
+        return "avx2";
+    }
+#endif
+    if (kernel == kernel_lms_sparse_scalar) {
+        return "scalar";
+    }
+
+    return "unknown";
+}
+
+
+// Select fastest masked LMS kernel supported by this CPU
+KernelLMSMasked kernel_lms_masked_select(void) {
+
+    // Use same instruction set as dense kernel
+    KernelLMS dense = kernel_lms_select();
+
+#ifdef KERNELS_X86
+    if (dense == kernel_lms_avx512) {
+        return kernel_lms_masked_avx512;
+    }
+    if (dense == kernel_lms_avx2) {
+        return kernel_lms_masked_avx2;
+    }
+#endif
+
+    return kernel_lms_masked_scalar;
+}
+
+
+// Select fastest single-precision LMS kernel supported by this CPU
+KernelLMS32 kernel_lms32_select(int mixed) {
+
+    // Use same instruction set as double-precision kernel
+    KernelLMS dense = kernel_lms_select();
+
+#ifdef KERNELS_X86
+    if (dense == kernel_lms_avx512) {
+        return mixed ? kernel_lms32_mixed_avx512 : kernel_lms32_avx512;
+    }
+    if (dense == kernel_lms_avx2) {
+        return mixed ? kernel_lms32_mixed_avx2 : kernel_lms32_avx2;
+    }
+#endif
+
+    return mixed ? kernel_lms32_mixed_scalar : kernel_lms32_scalar;
+}
+
+
+// Select fastest matrix-vector product kernel supported by this CPU
+KernelGemv kernel_gemv_select(void) {
+
+    // Use same instruction set as fused kernel
+    KernelLMS dense = kernel_lms_select();
+
+#ifdef KERNELS_X86
+    if (dense == kernel_lms_avx512) {
+        return kernel_gemv_avx512;
+    }
+    if (dense == kernel_lms_avx2) {
+        return kernel_gemv_avx2;
+    }
+#endif
+
+    return kernel_gemv_scalar;
+}
+
+
+// Select fastest rank-1 LMS update kernel supported by this CPU
+KernelRank1 kernel_rank1_select(void) {
+
+    // Use same instruction set as fused kernel
+    KernelLMS dense = kernel_lms_select();
+
+#ifdef KERNELS_X86
+    if (dense == kernel_lms_avx512) {
+        return kernel_rank1_avx512;
+    }
+    if (dense == kernel_lms_avx2) {
+        return kernel_rank1_avx2;
+    }
+#endif
+
+    return kernel_rank1_scalar;
+}
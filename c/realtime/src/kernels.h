@@ -0,0 +1,135 @@
+/* Header file for compute kernels */
+
+
+#ifndef _KERNELS_H
+#define _KERNELS_H
+
+
+/* Fused LMS kernel
+ *
+ * For each weight row i in [row_begin, row_end), the kernel applies the LMS
+ * weight update and then computes the prediction for that row while the row
+ * is still in cache, so that the weight matrix is only streamed through memory
+ * once per time step:
+ *
+ *     w_i := w_i + mu * err[i] * x_old
+ *     pred[i] := w_i * x_new
+ *
+ * The history vectors x_old and x_new are passed as arrays of 'order' pointers
+ * to blocks of length 'dim', where block k holds the signal from k steps back.
+ * Block k of the history is multiplied by columns [k * dim, (k + 1) * dim) of
+ * the weight matrix, which is stored in row-major order with row length
+ * 'hist_size' (dim * order).
+ */
+typedef void (*KernelLMS)(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end
+);
+
+/* Sparse-input fused LMS kernel
+ *
+ * Same computation as a KernelLMS, but the weight matrix is stored in
+ * column-major order (column c at wts + c * dim), and each history block comes
+ * with a list of the indices of its nonzero entries (nz_old[k] holds
+ * n_nz_old[k] indices). Only the weight columns matching nonzero history
+ * entries are touched, and each of those is a contiguous vector, so for
+ * spike-count input, where most entries are zero, the work per step drops
+ * from dim * hist_size to dim times the number of nonzero history entries.
+ */
+typedef void (*KernelLMSSparse)(
+    double* wts, int dim, int order, double mu, const double* err,
+    const double* const* x_old, const int* const* nz_old, const int* n_nz_old,
+    const double* const* x_new, const int* const* nz_new, const int* n_nz_new,
+    double* pred, int row_begin, int row_end
+);
+
+/* Masked fused LMS kernel
+ *
+ * Same computation as a KernelLMS, but each row only has weights for the
+ * history of the channels it is connected to, stored in compressed sparse row
+ * form: row i is connected to the n_i = row_ptr[i + 1] - row_ptr[i] channels
+ * listed at cols + row_ptr[i], and its weights start at
+ * wts + row_ptr[i] * order, with the n_i weights for history block k at offset
+ * k * n_i. History entries of connected channels are gathered by index, so
+ * the work per step scales with the number of connections rather than with
+ * dim * hist_size.
+ */
+typedef void (*KernelLMSMasked)(
+    double* wts, const int* row_ptr, const int* cols, int order, double mu,
+    const double* err, const double* const* x_old, const double* const* x_new,
+    double* pred, int row_begin, int row_end
+);
+
+/* Single-precision fused LMS kernel
+ *
+ * Same computation as a KernelLMS, but with weights and history stored as
+ * float, which halves the memory traffic of the weight update. The step size,
+ * error, and prediction stay double. Depending on the variant, the dot
+ * product for the prediction is accumulated in float or in double.
+ */
+typedef void (*KernelLMS32)(
+    float* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const float* const* x_old, const float* const* x_new,
+    double* pred, int row_begin, int row_end
+);
+
+/* Split LMS kernels
+ *
+ * The two halves of a KernelLMS, for filters that update the weights
+ * somewhere other than where they predict: a matrix-vector product
+ *
+ *     pred[i] := w_i * x
+ *
+ * and a rank-1 update
+ *
+ *     w_i := w_i + mu * err[i] * x
+ *
+ * over rows [row_begin, row_end), with the weight matrix and history blocks
+ * laid out as for a KernelLMS.
+ */
+typedef void (*KernelGemv)(
+    const double* wts, int hist_size, int dim, int order,
+    const double* const* x, double* pred, int row_begin, int row_end
+);
+typedef void (*KernelRank1)(
+    double* wts, int hist_size, int dim, int order, double mu,
+    const double* err, const double* const* x, int row_begin, int row_end
+);
+
+// Select fastest LMS kernel supported by this CPU (the choice can be forced
+// by setting the REALTIME_ISA environment variable to 'scalar', 'avx2', or
+// 'avx512')
+KernelLMS kernel_lms_select(void);
+
+// Select fastest LMS kernel for filters of given dimension and order: a
+// kernel specialized for that geometry if there is one (64, 128 or 384
+// channels at order 5), and the generic kernel of kernel_lms_select()
+// otherwise (setting the REALTIME_FIXED environment variable to 0 forces the
+// generic kernel)
+KernelLMS kernel_lms_select_for(int dim, int order);
+
+// Name of instruction set used by kernel (e.g. 'avx2', or 'avx2-64x5' for a
+// fixed-geometry kernel)
+const char* kernel_lms_name(KernelLMS kernel);
+
+// Select fastest sparse-input LMS kernel supported by this CPU
+KernelLMSSparse kernel_lms_sparse_select(void);
+
+// Name of instruction set used by sparse-input kernel
+const char* kernel_lms_sparse_name(KernelLMSSparse kernel);
+
+// Select fastest masked LMS kernel supported by this CPU
+KernelLMSMasked kernel_lms_masked_select(void);
+
+// Select fastest single-precision LMS kernel supported by this CPU (mixed is
+// 1 to accumulate predictions in double, 0 to accumulate in float)
+KernelLMS32 kernel_lms32_select(int mixed);
+
+// Select fastest matrix-vector product and rank-1 update kernels supported by
+// this CPU
+KernelGemv kernel_gemv_select(void);
+KernelRank1 kernel_rank1_select(void);
+
+
+#endif
@@ -0,0 +1,142 @@
+/* Low-rank LMS filter */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "lowrank.h"
+
+
+// Seed of generator for initial values of V (fixed, so that runs repeat)
+#define LOWRANK_SEED 0x9e3779b97f4a7c15ULL
+
+
+// Return pseudo-random value uniform on [-1, 1) (xorshift64*)
+static double uniform_pm1(uint64_t* state) {
+
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    uint64_t r = *state * 0x2545f4914f6cdd1dULL;
+    return (double) (r >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+}
+
+
+// Constructor for FilterAutoLowRank object
+void FilterAutoLowRank_new(struct FilterAutoLowRank* flt, int dim, int order, int rank, double mu) {
+
+    // Populate fields
+    flt->dim = dim;
+    flt->order = order;
+    flt->hist_size = dim * order;
+    flt->rank = rank;
+    flt->mu = mu;
+    flt->head = 0;
+    flt->gemv = kernel_gemv_select();
+    flt->rank1 = kernel_rank1_select();
+    flt->n_steps = 0;
+    flt->sse = 0.0;
+
+    // Allocate arrays (U, history and prediction start at zero)
+    flt->x_pred = (double *) calloc(dim, sizeof(double));
+    flt->x_err = (double *) calloc(dim, sizeof(double));
+    flt->u = (double *) calloc((size_t) dim * rank, sizeof(double));
+    flt->v = (double *) malloc((size_t) rank * flt->hist_size * sizeof(double));
+    flt->z = (double *) calloc(rank, sizeof(double));
+    flt->g = (double *) calloc(rank, sizeof(double));
+    flt->x_hist = (double *) calloc(flt->hist_size, sizeof(double));
+    flt->blk_old = (const double **) malloc(order * sizeof(double*));
+    flt->blk_new = (const double **) malloc(order * sizeof(double*));
+
+    // Start V at small random values, scaled so that each entry of z is on
+    // the order of one history entry
+    uint64_t state = LOWRANK_SEED;
+    double scale = 1.0 / sqrt((double) flt->hist_size);
+    for (size_t j = 0; j < (size_t) rank * flt->hist_size; j++) {
+        flt->v[j] = scale * uniform_pm1(&state);
+    }
+}
+
+
+// Destructor for FilterAutoLowRank object
+void FilterAutoLowRank_delete(struct FilterAutoLowRank* flt) {
+
+    // Free allocated memory
+    free(flt->blk_new);
+    free(flt->blk_old);
+    free(flt->x_hist);
+    free(flt->g);
+    free(flt->z);
+    free(flt->v);
+    free(flt->u);
+    free(flt->x_err);
+    free(flt->x_pred);
+}
+
+
+// Update filter with new signal value and predict next value
+void FilterAutoLowRank_predict_next(struct FilterAutoLowRank* flt, double* x) {
+
+    int dim = flt->dim;
+    int rank = flt->rank;
+    double mu = flt->mu;
+
+    // Point kernels at history blocks (block k of the new history is block
+    // k - 1 of the old history, and block 0 is the new signal value)
+    for (int k = 0; k < flt->order; k++) {
+        flt->blk_old[k] = flt->x_hist + ((flt->head + k) % flt->order) * dim;
+        flt->blk_new[k] = (k == 0) ? x : flt->blk_old[k - 1];
+    }
+
+    // Compute error, project it back through U (before U is updated), and
+    // update U, in one pass over U
+    for (int j = 0; j < rank; j++) {
+        flt->g[j] = 0.0;
+    }
+    for (int i = 0; i < dim; i++) {
+        double e = x[i] - flt->x_pred[i];
+        double* u_i = flt->u + (size_t) i * rank;
+        flt->x_err[i] = e;
+        flt->sse += e * e;
+        for (int j = 0; j < rank; j++) {
+            flt->g[j] += u_i[j] * e;
+            u_i[j] += mu * e * flt->z[j];
+        }
+    }
+
+    // Update V with projected error and old history, then project new history
+    flt->rank1(flt->v, flt->hist_size, dim, flt->order, mu, flt->g, flt->blk_old, 0, rank);
+    flt->gemv(flt->v, flt->hist_size, dim, flt->order, flt->blk_new, flt->z, 0, rank);
+
+    // Add new signal value to history, overwriting oldest slot
+    flt->head = (flt->head + flt->order - 1) % flt->order;
+    memcpy(flt->x_hist + flt->head * dim, x, dim * sizeof(double));
+
+    // Predict next value from projection
+    for (int i = 0; i < dim; i++) {
+        const double* u_i = flt->u + (size_t) i * rank;
+        double acc = 0.0;
+        for (int j = 0; j < rank; j++) {
+            acc += u_i[j] * flt->z[j];
+        }
+        flt->x_pred[i] = acc;
+    }
+
+    flt->n_steps++;
+}
+
+
+// Print rank, number of weights, and mean squared prediction error
+void FilterAutoLowRank_print_stats(struct FilterAutoLowRank* flt) {
+
+    if (flt->n_steps == 0) {
+        return;
+    }
+
+    size_t n_wts = (size_t) flt->rank * (flt->dim + flt->hist_size);
+    size_t n_full = (size_t) flt->dim * flt->hist_size;
+    printf("Low-rank LMS: rank %d, %zu weights (%.1f%% of full rank), mean squared error %.6g\n",
+        flt->rank, n_wts, 100.0 * n_wts / n_full, flt->sse / ((double) flt->n_steps * flt->dim));
+}
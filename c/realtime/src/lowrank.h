@@ -0,0 +1,94 @@
+/* Header file for low-rank LMS filter */
+
+
+#ifndef _LOWRANK_H
+#define _LOWRANK_H
+
+#include "kernels.h"
+
+
+/* Low-rank autoregressive LMS filter
+ *
+ * Learns the weight matrix of FilterAutoLMS as a product W = U * V of a
+ * dim x rank matrix U and a rank x (dim * order) matrix V, so that the
+ * prediction goes through a rank-dimensional bottleneck:
+ *
+ *     z := V * x_hist
+ *     x_pred := U * z
+ *
+ * Both factors follow the gradient of the squared prediction error, with the
+ * error err = x - x_pred, z_old = V * x_hist_old from the last prediction, and
+ * g = U' * err:
+ *
+ *     U := U + mu * err * z_old'
+ *     V := V + mu * g * x_hist_old'
+ *
+ * Each step touches dim * rank + rank * dim * order weights instead of
+ * dim * dim * order, so for populations of thousands of neurons the weights
+ * stay in cache. U starts at zero and V at small pseudo-random values (both
+ * factors at zero would be a stationary point of the gradient).
+ */
+struct FilterAutoLowRank {
+
+    // Dimension of signal
+    int dim;
+
+    // Order of filter (number of signal vectors in history)
+    int order;
+
+    // Size of history (dim * order)
+    int hist_size;
+
+    // Rank of weight matrix
+    int rank;
+
+    // Step size used for filter updates
+    double mu;
+
+    // Filter prediction
+    double* x_pred;
+
+    // Filter error from last step
+    double* x_err;
+
+    // Factors of weight matrix (row-major; U is dim x rank, V is rank x
+    // hist_size)
+    double* u;
+    double* v;
+
+    // Projection of history used for last prediction (z = V * x_hist), and
+    // error projected back through U (g = U' * err)
+    double* z;
+    double* g;
+
+    // Signal history (circular buffer, as in FilterAutoLMS), and pointers to
+    // its blocks before (blk_old) and after (blk_new) adding the newest signal
+    // value
+    double* x_hist;
+    int head;
+    const double** blk_old;
+    const double** blk_new;
+
+    // Kernels selected for this CPU (applied to V)
+    KernelGemv gemv;
+    KernelRank1 rank1;
+
+    // Number of steps taken, and sum of squared prediction errors
+    long n_steps;
+    double sse;
+};
+
+// Constructor for filter object (rank must be at least 1)
+void FilterAutoLowRank_new(struct FilterAutoLowRank* flt, int dim, int order, int rank, double mu);
+
+// Destructor for filter object
+void FilterAutoLowRank_delete(struct FilterAutoLowRank* flt);
+
+// Update filter with new signal value and predict next value
+void FilterAutoLowRank_predict_next(struct FilterAutoLowRank* flt, double* x);
+
+// Print rank, number of weights, and mean squared prediction error
+void FilterAutoLowRank_print_stats(struct FilterAutoLowRank* flt);
+
+
+#endif
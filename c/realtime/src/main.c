@@ -12,6 +12,7 @@ for further analysis.
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h> 
+#include <math.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
@@ -20,7 +21,15 @@ for further analysis.
 #include "hdf5.h"
 
 #include "protocol.h"
-#include "filters.h"
+#include "autofilter.h"
+#include "server.h"
+#include "shard.h"
+#include "pipeline.h"
+#include "timing.h"
+#include "reader.h"
+#include "writer.h"
+#include "rtprofile.h"
+#include "checkpoint.h"
 
 
 // Size of buffer for args (host, port, input and output filenames)
@@ -32,276 +41,553 @@ for further analysis.
 // Filter learning rate
 #define FILTER_MU 0.01
 
-// Number of points to send for test
-#define N_PTS_SEND 10000
-
-
-// Get dimensions (num. time points, num. neurons) from input data
-int get_data_dims(char* in_fpath, int* n_pts, int* n_neurons) {
-
-    // Default values
-    *n_pts = 0;
-    *n_neurons = 0;
-
-    // Open file
-    hid_t file = H5Fopen(in_fpath, H5F_ACC_RDONLY, H5P_DEFAULT);
-    hid_t dset = H5Dopen(file, "spks", H5P_DEFAULT);
-    hid_t dspace = H5Dget_space(dset);
-
-    // Get dimensions
-    hsize_t data_dims[2];
-    int ndims = H5Sget_simple_extent_dims(dspace, data_dims, NULL);
-    if (ndims != 2) {
-        fprintf(stderr, "Input data not two-dimensional\n");
-        return 1;
+// Rank of weight matrix learned by low-rank filter
+#define FILTER_RANK 16
+
+// Number of nearest channels connected to each channel by masked filter
+#define FILTER_NEAREST 8
+
+// Default window of open-loop probe (frames)
+#define OPEN_LOOP_WINDOW 4096
+
+// Default number of frames between checkpoints
+#define CHECKPOINT_INTERVAL 10000
+
+// Default largest block of queued frames that processor filters at once (1,
+// so that catch-up blocks, which need a step size n times smaller to stay
+// stable, are only used when asked for with -M)
+#define PROC_MAX_BLOCK 1
+
+
+// Latency histograms kept by probe
+enum ProbeStage {
+    PROBE_SEND,
+    PROBE_RTT,
+    N_PROBE_STAGES
+};
+const char* PROBE_STAGE_NAMES[] = {"send", "rtt"};
+
+// Latency histograms kept by processor ('recv' includes time spent waiting
+// for the probe; 'one_way' is measured from the timestamp in the frame header,
+// so it needs synchronized clocks)
+enum ProcessorStage {
+    PROC_RECV,
+    PROC_CONVERT,
+    PROC_FILTER,
+    PROC_SEND,
+    PROC_ONE_WAY,
+    N_PROC_STAGES
+};
+const char* PROC_STAGE_NAMES[] = {"recv", "convert", "filter", "send", "one_way"};
+
+// Latency histograms kept by coordinator of shards ('shards' runs from
+// sending a frame to the shards to receiving the last of their predictions;
+// each shard's own latency is kept in a further histogram)
+enum CoordinatorStage {
+    COORD_RECV,
+    COORD_SHARDS,
+    COORD_SEND,
+    COORD_ONE_WAY,
+    N_COORD_STAGES
+};
+const char* COORD_STAGE_NAMES[] = {"recv", "shards", "send", "one_way"};
+
+// Length of name of shard's latency histogram
+#define SHARD_NAME_LEN 16
+
+// Latency histograms kept by offline replay
+enum ReplayStage {
+    REPLAY_CONVERT,
+    REPLAY_FILTER,
+    N_REPLAY_STAGES
+};
+const char* REPLAY_STAGE_NAMES[] = {"convert", "filter"};
+
+
+// Write latency histograms to 'timing' group of open HDF5 file (one dataset
+// of bucket counts per histogram, plus the smallest value of each bucket)
+int write_timing(hid_t file, struct Histogram* hists, const char** names, int n_hists) {
+
+    hid_t group = H5Gcreate(file, "timing", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    hsize_t dims[1];
+    dims[0] = HIST_N_BUCKETS;
+    hid_t dspace = H5Screate_simple(1, dims, NULL);
+
+    // Smallest value of each bucket (nanoseconds)
+    uint64_t bucket_ns[HIST_N_BUCKETS];
+    for (int b = 0; b < HIST_N_BUCKETS; b++) {
+        bucket_ns[b] = Histogram_bucket_value(b);
     }
-
-    // Write return values
-    *n_pts = data_dims[0];
-    *n_neurons = data_dims[1];
-
-    // Close file
-    H5Sclose(dspace);
+    hid_t dset = H5Dcreate(group, "bucket_ns", H5T_STD_U64LE, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    int status = H5Dwrite(dset, H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, bucket_ns);
     H5Dclose(dset);
-    H5Fclose(file);
 
-    return 0;
-}
-
-
-// Load spike counts from HDF5 file
-int load_data(char* in_fpath, int* data) {
+    // Counts of each histogram
+    for (int h = 0; h < n_hists && status == 0; h++) {
+        dset = H5Dcreate(group, names[h], H5T_STD_U64LE, dspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        status = H5Dwrite(dset, H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, hists[h].counts);
+        H5Dclose(dset);
+    }
 
-    // Open file
-    hid_t file = H5Fopen(in_fpath, H5F_ACC_RDONLY, H5P_DEFAULT);
-    hid_t dset = H5Dopen(file, "spks", H5P_DEFAULT);
+    H5Sclose(dspace);
+    H5Gclose(group);
 
-    int status = H5Dread(dset, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, data);
     if (status != 0) {
-        fprintf(stderr, "Failed to read input data\n");
+        fprintf(stderr, "Failed to write timing data\n");
         return 1;
     }
-
-    // Close file
-    H5Dclose(dset);
-    H5Fclose(file);
-
     return 0;
 }
 
 
-// Write filter predictions and round-trip times to HDF5 file
-int save_data(char* out_fpath, double* fpreds, double* rt_times, int n_pts, int n_neurons) {
+// Write latency histograms to new HDF5 file
+int save_timing(char* out_fpath, struct Histogram* hists, const char** names, int n_hists) {
 
-    // Create HDF5 file
     hid_t file = H5Fcreate(out_fpath, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    int status = write_timing(file, hists, names, n_hists);
+    H5Fclose(file);
+
+    return status;
+}
 
-    // Create dataspace for filter predictions
-    hsize_t dims_fp[2]; 
-    dims_fp[0] = n_pts;
-    dims_fp[1] = n_neurons;
-    hid_t dspace_fp = H5Screate_simple(2, dims_fp, NULL);
 
-    // Create dataset for filter predictions
-    hid_t dset_fp = H5Dcreate(file, "filter_preds", H5T_IEEE_F64LE, dspace_fp, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    
-    // Write filter predictions to file
-    int status_fp = H5Dwrite(dset_fp, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, fpreds);
-    if (status_fp != 0) {
-        fprintf(stderr, "Failed to write output data\n");
-        return 1;
+// Print summary of latency histograms
+void print_timing(struct Histogram* hists, const char** names, int n_hists) {
+
+    printf("Latencies (%s):\n", timing_clock_name());
+    for (int h = 0; h < n_hists; h++) {
+        Histogram_print(&hists[h], names[h]);
     }
+}
 
-    // Close dataspace and dataset
-    H5Sclose(dspace_fp);
-    H5Dclose(dset_fp);
 
-    // Create dataspace for round-trip times
-    hsize_t dims_rt[1]; 
-    dims_rt[0] = n_pts;
-    hid_t dspace_rt = H5Screate_simple(1, dims_rt, NULL);
+// Send frames one at a time, waiting for each prediction before sending the
+// next frame; returns 0 on success
+int probe_lockstep(struct ProbeConnection* conn, struct SpikeReader* rdr, struct ResultWriter* wr,
+    struct Histogram* hists, double* elapsed_s) {
 
-    // Create dataset for round-trip times
-    hid_t dset_rt = H5Dcreate(file, "rt_times_us", H5T_IEEE_F64LE, dspace_rt, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    
-    // Write round-trip times to file
-    int status_rt = H5Dwrite(dset_rt, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, rt_times);
-    if (status_rt != 0) {
-        fprintf(stderr, "Failed to write output data\n");
-        return 1;
-    }
+    // Buffer for predictions that don't fit in writer's queue
+    double* preds_dropped = (double *) malloc(conn->n_neurons * sizeof(double));
+    int status = 0;
 
-    // Close dataspace and dataset
-    H5Sclose(dspace_rt);
-    H5Dclose(dset_rt);
+    uint64_t st_all = timing_now();
 
-    // Close file
-    H5Fclose(file);
+    for (long k = 0; k < rdr->n_pts; k++) {
 
-    return 0;
-}
+        // Pointers to spikes and filter predictions for this time step
+        int* spks_k = SpikeReader_next(rdr);
+        double* filter_preds_k = ResultWriter_reserve(wr);
+        if (spks_k == NULL) {
+            fprintf(stderr, "Recording ended after %ld frames\n", k);
+            status = 1;
+            break;
+        }
 
+        // Start clock
+        uint64_t st = timing_now();
 
-// Compute the mean of a vector of values
-double compute_mean(double* vals, int nvals) {
+        // Send spike counts to processor
+        if (probe_send(conn, spks_k) != 0) {
+            fprintf(stderr, "probe_send() failed\n");
+            status = 1;
+            break;
+        }
+        uint64_t st_sent = timing_now();
+  
+        // Receive filter predictions from processor
+        if (probe_recv(conn, filter_preds_k ? filter_preds_k : preds_dropped) != 0) {
+            fprintf(stderr, "probe_recv() failed\n");
+            status = 1;
+            break;
+        }
+        if (conn->hdr_rx.seq != (uint64_t) k) {
+            fprintf(stderr, "Received predictions for frame %lu while waiting for frame %ld\n",
+                (unsigned long) conn->hdr_rx.seq, k);
+            status = 1;
+            break;
+        }
 
-    double acc;
-    for (int i = 0; i < nvals; i++) {
-        acc = acc + vals[i];
+        // Stop clock
+        uint64_t et = timing_now();
+
+        // Record time (microseconds)
+        if (filter_preds_k) {
+            ResultWriter_commit(wr, k, timing_ns(et - st) / 1e3);
+        }
+        Histogram_record(&hists[PROBE_SEND], timing_ns(st_sent - st));
+        Histogram_record(&hists[PROBE_RTT], timing_ns(et - st));
     }
 
-    return acc / nvals;
+    *elapsed_s = timing_ns(timing_now() - st_all) / 1e9;
+    free(preds_dropped);
+
+    return status;
 }
 
 
 // Probe mode
-int probe_mode(char* host, int port, char* in_fpath, char* out_fpath) {
-
-    printf("Loading data from '%s'...\n", in_fpath);
-
-    // Read number of data points and number of neurons from input file
-    int n_pts, n_neurons;
-    get_data_dims(in_fpath, &n_pts, &n_neurons);
-
-    // Load spike counts into memory
-    int* spks = (int *) malloc(n_pts * n_neurons * sizeof(int));
-    load_data(in_fpath, spks);
+int probe_mode(char* host, int port, char* in_fpath, char* out_fpath, enum Transport transport,
+    enum WireEncoding encoding, int window, double rate, int use_tsc, long max_pts, int compress_level, struct RtProfile* prof) {
 
-    printf("Done.\n");
+    // Start streaming spike counts from input file
+    printf("Opening '%s'...\n", in_fpath);
+    struct SpikeReader rdr;
+    if (SpikeReader_open(&rdr, in_fpath, max_pts) != 0) {
+        return 1;
+    }
+    long n_pts = rdr.n_pts;
+    int n_neurons = rdr.n_neurons;
+    printf("Streaming %ld time points of %d neurons in chunks of %d\n", n_pts, n_neurons, rdr.chunk_rows);
 
     // Connect to processor
     printf("Connecting to processor at %s:%d...\n", host, port);
     struct ProbeConnection conn;
-    if (probe_connect(host, port, n_neurons, &conn) != 0) {
+    if (probe_connect(host, port, n_neurons, transport, encoding, &conn) != 0) {
         fprintf(stderr, "Probe connection failed\n");
         return 1;
     }
     printf("Done.\n");
+    printf("Sending spikes in '%s' encoding\n", encoding_name(conn.encoding));
     
-    // Array for storing filter predictions
-    double* filter_preds = (double *) malloc(N_PTS_SEND * n_neurons * sizeof(double));
+    // Start writing filter predictions and round-trip times to output file
+    printf("Writing data to '%s'...\n", out_fpath);
+    struct ResultWriter wr;
+    if (ResultWriter_open(&wr, out_fpath, n_neurons, compress_level) != 0) {
+        return 1;
+    }
 
-    // Array for storing round-trip times (microseconds)
-    double* rt_times_us = (double *) malloc(N_PTS_SEND * sizeof(double));
+    // Latency histograms
+    timing_init(use_tsc);
+    struct Histogram* hists = (struct Histogram *) malloc(N_PROBE_STAGES * sizeof(struct Histogram));
+    for (int h = 0; h < N_PROBE_STAGES; h++) {
+        Histogram_reset(&hists[h]);
+    }
 
-    printf("Sending signal...\n");
-    for (int k = 0; k < N_PTS_SEND; k++) {
+    // Apply real-time profile now that background threads have started (a
+    // pipelined probe's sender shares the CPU with the receiver, so the
+    // receiver must not spin)
+    if (rate > 0 || window > 1) {
+        prof->spin_requested = 0;
+    }
+    rt_profile_apply(prof);
+    if (transport == TRANSPORT_TCP) {
+        rt_profile_socket(prof, conn.sock_id);
+    }
+    if (prof->enabled) {
+        rt_prefault(wr.preds, wr.capacity * n_neurons * sizeof(double));
+        prof->prefault_bytes += wr.capacity * n_neurons * sizeof(double);
+    }
+    rt_profile_print(prof);
 
-        // Pointers to spikes and filter predictions for this time step
-        int* spks_k = spks + (k * n_neurons);
-        double* filter_preds_k = filter_preds + (k * n_neurons);
+    // Time taken to send signal (seconds)
+    double elapsed_s;
+    int status = 0;
 
-        // Start clock
-        struct timeval st, et;
-        gettimeofday(&st, NULL);
+    printf("Sending signal...\n");
+    if (rate > 0) {
 
-        // Send spike counts to processor
-        if (probe_send(&conn, spks_k) != 0) {
-            fprintf(stderr, "probe_send() failed\n");
-            return 1;
+        // Send frames on fixed schedule
+        if (window < 1) {
+            window = OPEN_LOOP_WINDOW;
         }
-  
-        // Receive filter predictions from processor
-        if (probe_recv(&conn, filter_preds_k) != 0) {
-            fprintf(stderr, "probe_recv() failed\n");
-            return 1;
+        printf("Sending %f frames/s open-loop with window of %d frames\n", rate, window);
+        struct ProbePipeline pl;
+        status = pipeline_run(&pl, &conn, &rdr, window, (uint64_t) (1e9 / rate), &wr,
+            &hists[PROBE_SEND], &hists[PROBE_RTT]);
+        if (status != 0) {
+            fprintf(stderr, "Open-loop probe failed\n");
         }
-
-        // Stop clock
-        gettimeofday(&et, NULL);
-
-        // Compute time (microseconds)
-        rt_times_us[k] = (et.tv_sec - st.tv_sec) * 1e6 + (et.tv_usec - st.tv_usec);
+        elapsed_s = pl.elapsed_s;
+        printf("Dropped frames: %ld\n", pl.n_dropped);
+        printf("Late frames (predicted after next frame was due): %ld\n", pl.n_late);
+    }
+    else if (window > 1) {
+        printf("Using window of %d frames\n", window);
+        struct ProbePipeline pl;
+        status = pipeline_run(&pl, &conn, &rdr, window, 0, &wr, &hists[PROBE_SEND], &hists[PROBE_RTT]);
+        if (status != 0) {
+            fprintf(stderr, "Pipelined probe failed\n");
+        }
+        elapsed_s = pl.elapsed_s;
+    }
+    else {
+        status = probe_lockstep(&conn, &rdr, &wr, hists, &elapsed_s);
     }
     printf("Done.\n");
 
+    // Stop reading, and finish writing predictions (rows written so far are
+    // kept even if the run failed)
+    SpikeReader_close(&rdr);
+    if (ResultWriter_finish(&wr) != 0) {
+        status = 1;
+    }
+    if (wr.n_dropped > 0) {
+        printf("Rows dropped because writer fell behind: %ld\n", wr.n_dropped);
+    }
+
     // Compute mean latency
-    double rt_mean = compute_mean(rt_times_us, N_PTS_SEND);
-    printf("Mean round-trip latency: %f us\n", rt_mean);
+    long n_answered = (long) hists[PROBE_RTT].n;
+    printf("Mean round-trip latency: %f us\n", Histogram_mean(&hists[PROBE_RTT]) / 1e3);
+    printf("Throughput: %f frames/s\n", n_answered / elapsed_s);
+    if (conn.seq_tx > 0) {
+        printf("Mean spike payload: %.1f bytes/frame (%zu as int32)\n",
+            (double) conn.n_payload_bytes / conn.seq_tx, n_neurons * sizeof(int));
+    }
+    print_timing(hists, PROBE_STAGE_NAMES, N_PROBE_STAGES);
   
-    // Save output data
-    printf("Writing data to '%s'...\n", out_fpath);
-    save_data(out_fpath, filter_preds, rt_times_us, N_PTS_SEND, n_neurons);
-    printf("Done.\n");
+    // Save latency histograms next to predictions
+    if (write_timing(wr.file, hists, PROBE_STAGE_NAMES, N_PROBE_STAGES) != 0) {
+        status = 1;
+    }
+    ResultWriter_close(&wr);
+    printf("Wrote %ld rows.\n", wr.n_written);
 
     // Free allocated memory
-    free(rt_times_us);
-    free(filter_preds);
-    free(spks);
+    free(hists);
 
     // Close connection
     probe_disconnect(&conn);
 
-    return 0;
+    return status;
 }
 
 
 // Processor mode
-int processor_mode(char* host, int port, int use_lms) {
+int processor_mode(char* host, int port, char* out_fpath, enum FilterType filter_type,
+    struct FilterParams* params, int compare, enum Transport transport, int use_tsc, int max_block,
+    struct RtProfile* prof, const char* ckpt_fpath, long ckpt_interval, const char* warm_fpath) {
+
+    // Checkpoints hold the state of a single LMS filter
+    if ((ckpt_fpath != NULL || warm_fpath != NULL) && filter_type != FILTER_LMS
+            && filter_type != FILTER_LMS_SPARSE) {
+        fprintf(stderr, "Checkpoints are only supported by 'lms' and 'lms-sparse' filters\n");
+        return 1;
+    }
 
     // Connect to probe
     printf("Connecting to probe at %s:%d...\n", host, port);
     struct ProcessorConnection conn;
-    if (processor_connect(host, port, &conn) != 0) {
+    if (processor_connect(host, port, transport, &conn) != 0) {
         fprintf(stderr, "Processor connection failed\n");
         return 1;
     }
     printf("Done.\n");
 
-    // Create filter objects for LMS and echo filters (we only use one)
-    struct FilterAutoLMS flt_lms;
-    FilterAutoLMS_new(&flt_lms, conn.n_neurons, FILTER_ORDER, FILTER_MU);
-    struct FilterAutoEcho flt_echo;
-    FilterAutoEcho_new(&flt_echo, conn.n_neurons);
+    // Create filter object
+    struct FilterAuto flt;
+    if (FilterAuto_new(&flt, filter_type, conn.n_neurons, params) != 0) {
+        fprintf(stderr, "Filter creation failed\n");
+        return 1;
+    }
+    printf("Receiving spikes in '%s' encoding\n", encoding_name(conn.encoding));
+    printf("Using '%s' filter\n", FilterAuto_type_name(filter_type));
+    if (filter_type == FILTER_LMS) {
+        printf("Using %s LMS kernel\n", kernel_lms_name(flt.lms.kernel));
+    }
+    else if (filter_type == FILTER_LMS_SPARSE) {
+        printf("Using %s sparse LMS kernel\n", kernel_lms_sparse_name(flt.lms.kernel_sparse));
+    }
+    if (filter_type != FILTER_ECHO) {
+        printf("Using %d thread(s)\n", flt.use_engine ? flt.engine.n_threads
+            : (filter_type == FILTER_LMS_DELAYED) ? 2 : 1);
+    }
 
-    // Arrays for storing spikes as int and double
-    int* spks_int = (int*) malloc(conn.n_neurons * sizeof(int));
-    double* spks_double = (double*) malloc(conn.n_neurons * sizeof(double));
+    // Warm-start filter from checkpoint if one matches this probe; otherwise
+    // start from zero weights as usual
+    long n_steps = 0;
+    if (warm_fpath != NULL) {
+        if (FilterAutoLMS_load(&flt.lms, warm_fpath, &n_steps) == 0) {
+            printf("Warm-started filter from '%s' (%ld steps)\n", warm_fpath, n_steps);
+        }
+        else {
+            printf("Starting filter from zero weights\n");
+        }
+    }
+
+    // Write checkpoints in the background while filtering if requested
+    // (before applying real-time profile, which the writer shouldn't inherit)
+    struct Checkpointer ckpt;
+    if (ckpt_fpath != NULL) {
+        if (Checkpointer_new(&ckpt, &flt.lms, ckpt_fpath, ckpt_interval) != 0) {
+            fprintf(stderr, "Checkpointer creation failed\n");
+            return 1;
+        }
+        printf("Writing checkpoint to '%s' every %ld frames\n", ckpt_fpath, ckpt_interval);
+    }
+
+    // Create reference filter for comparison if requested
+    struct FilterCompare cmp;
+    if (compare) {
+        FilterCompare_new(&cmp, conn.n_neurons, params);
+    }
+
+    // Arrays for storing spikes as int, and block of frames as double, with
+    // predictions, sequence numbers and send times of block
+    int n_neurons = conn.n_neurons;
+    int* spks_int = (int*) malloc(n_neurons * sizeof(int));
+    double* spks_double = (double*) malloc((size_t) max_block * n_neurons * sizeof(double));
+    double* preds = (double*) malloc((size_t) max_block * n_neurons * sizeof(double));
+    uint64_t* seqs = (uint64_t*) malloc(max_block * sizeof(uint64_t));
+    uint64_t* t_sends = (uint64_t*) malloc(max_block * sizeof(uint64_t));
+    long n_blocks = 0;
+    long n_block_frames = 0;
+    long n_frames = 0;
+
+    // Latency histograms of each stage
+    timing_init(use_tsc);
+    struct Histogram* hists = (struct Histogram *) malloc(N_PROC_STAGES * sizeof(struct Histogram));
+    for (int h = 0; h < N_PROC_STAGES; h++) {
+        Histogram_reset(&hists[h]);
+    }
+
+    // Apply real-time profile and fault in filter
+    rt_profile_apply(prof);
+    if (transport == TRANSPORT_TCP) {
+        rt_profile_socket(prof, conn.sock_client_id);
+    }
+    if (prof->enabled) {
+        prof->prefault_bytes += FilterAuto_prefault(&flt);
+    }
+    rt_profile_print(prof);
 
     printf("Filtering signal...\n");
     while(1) {
 
-        // Receive spikes (int) from probe
-        if (processor_recv(&conn, spks_int) != 0) {
-            fprintf(stderr, "processor_recv() failed\n");
-            return 1;
-        }
+        // Receive spikes (int) from probe, and convert them to doubles; if
+        // more frames have already arrived (processor fell behind), take up
+        // to max_block of them as one block
+        uint64_t t0 = timing_now();
+        int nb = 0;
+        uint64_t ns_convert = 0;
+        int pending = 0;
+        do {
+            if (processor_recv(&conn, spks_int) != 0) {
+                fprintf(stderr, "processor_recv() failed\n");
+                return 1;
+            }
+
+            // If probe has disconnected, stop receiving
+            if (!conn.is_connected) {
+                break;
+            }
+            seqs[nb] = conn.hdr_rx.seq;
+            t_sends[nb] = conn.hdr_rx.t_send_ns;
+
+            uint64_t tc = timing_now();
+            double* x = spks_double + (size_t) nb * n_neurons;
+            for (int i = 0; i < n_neurons; i++) {
+                x[i] = (double) spks_int[i];
+            }
+            ns_convert += timing_ns(timing_now() - tc);
+            nb++;
+
+            if (nb == 1 && max_block > 1) {
+                pending = processor_pending(&conn);
+            }
+        } while (nb < max_block && nb <= pending);
 
         // If probe has disconnected, break out of loop and return
-        if (!conn.is_connected) {
+        if (nb == 0) {
             break;
         }
+        uint64_t t1 = timing_now();
 
-        // Convert spikes to doubles
-        for (int i = 0; i < conn.n_neurons; i++) {
-            spks_double[i] = (double) spks_int[i];
+        // Update filter
+        double* fpreds;
+        if (nb == 1) {
+            FilterAuto_predict_next(&flt, spks_double);
+            fpreds = flt.x_pred;
         }
-
-        // Update filter and send predictions back to probe
-        if (use_lms) {
-            FilterAutoLMS_predict_next(&flt_lms, spks_double);
-            if (processor_send(&conn, flt_lms.x_pred) != 0) {
+        else {
+            FilterAuto_predict_block(&flt, spks_double, nb, preds);
+            fpreds = preds;
+            n_blocks++;
+            n_block_frames += nb;
+        }
+        uint64_t t2 = timing_now();
+
+        // Send predictions back to probe, and record stage latencies (time
+        // spent on a block is shared evenly between its frames; one-way
+        // delay from probe can't be negative, but clocks of different
+        // machines may disagree)
+        uint64_t ns_recv = timing_ns(t1 - t0) - ns_convert;
+        uint64_t ns_filter = timing_ns(t2 - t1);
+        for (int t = 0; t < nb; t++) {
+            uint64_t t3 = timing_now();
+            if (processor_send_seq(&conn, seqs[t], fpreds + (size_t) t * n_neurons) != 0) {
                 fprintf(stderr, "processor_send() failed\n");
                 return 1;
             }
+            uint64_t t4 = timing_now();
+
+            Histogram_record(&hists[PROC_RECV], ns_recv / nb);
+            Histogram_record(&hists[PROC_CONVERT], ns_convert / nb);
+            Histogram_record(&hists[PROC_FILTER], ns_filter / nb);
+            Histogram_record(&hists[PROC_SEND], timing_ns(t4 - t3));
+            int64_t one_way = (int64_t) (frame_time_ns() - t_sends[t]);
+            Histogram_record(&hists[PROC_ONE_WAY], (one_way > 0) ? (uint64_t) one_way : 0);
         }
-        else {
-            FilterAutoEcho_predict_next(&flt_echo, spks_double);
-            if (processor_send(&conn, flt_echo.x_pred) != 0) {
-                fprintf(stderr, "processor_send() failed\n");
-                return 1;
+        n_frames += nb;
+
+        // Start checkpoint if one is due, after replies have been sent
+        if (ckpt_fpath != NULL) {
+            Checkpointer_step(&ckpt, &flt.lms, n_frames, n_steps + n_frames);
+        }
+
+        // Update reference filter after replies have been sent (this still
+        // delays handling of the next frame, so latencies measured while
+        // comparing overstate the cost of the filter)
+        if (compare) {
+            for (int t = 0; t < nb; t++) {
+                FilterCompare_update(&cmp, spks_double + (size_t) t * n_neurons, fpreds + (size_t) t * n_neurons);
             }
         }
+
+        // Stop once probe has disconnected
+        if (!conn.is_connected) {
+            break;
+        }
     }
     printf("Done.\n");
 
+    // Report stage latencies
+    print_timing(hists, PROC_STAGE_NAMES, N_PROC_STAGES);
+    if (out_fpath[0] != '\0') {
+        printf("Writing timing data to '%s'...\n", out_fpath);
+        save_timing(out_fpath, hists, PROC_STAGE_NAMES, N_PROC_STAGES);
+        printf("Done.\n");
+    }
+    free(hists);
+
+    // Report catch-up blocks, filter statistics and comparison against
+    // reference filter
+    if (n_blocks > 0) {
+        printf("Caught up on %ld frames in %ld blocks (up to %d frames each)\n",
+            n_block_frames, n_blocks, max_block);
+    }
+    FilterAuto_print_stats(&flt);
+    if (compare) {
+        FilterCompare_print(&cmp);
+        FilterCompare_delete(&cmp);
+    }
+
+    // Write final checkpoint
+    if (ckpt_fpath != NULL) {
+        printf("Writing final checkpoint to '%s'...\n", ckpt_fpath);
+        Checkpointer_finish(&ckpt, &flt.lms, n_steps + n_frames);
+        Checkpointer_print(&ckpt);
+        Checkpointer_delete(&ckpt);
+    }
+
     // Free memory
+    free(t_sends);
+    free(seqs);
+    free(preds);
     free(spks_int);
     free(spks_double);
 
     // Delete filter
-    FilterAutoEcho_delete(&flt_echo);
-    FilterAutoLMS_delete(&flt_lms);
+    FilterAuto_delete(&flt);
 
     // Close connection
     processor_disconnect(&conn);
@@ -310,10 +596,409 @@ int processor_mode(char* host, int port, int use_lms) {
 } 
 
 
+// Shard mode (processor predicting a block of rows for a coordinator)
+int shard_mode(char* host, int port, char* out_fpath, struct FilterParams* params, int use_tsc) {
+
+    // Wait for coordinator, which says which rows to predict
+    printf("Waiting for coordinator at %s:%d...\n", host, port);
+    struct ProcessorConnection conn;
+    if (processor_connect_shard(host, port, &conn) != 0) {
+        fprintf(stderr, "Shard connection failed\n");
+        return 1;
+    }
+    int n_neurons = conn.n_neurons;
+    int row_begin = conn.row_begin;
+    int n_rows = conn.n_preds;
+    printf("Done.\n");
+    printf("Predicting rows [%d, %d) of %d\n", row_begin, row_begin + n_rows, n_neurons);
+
+    // Create filter object
+    struct FilterAutoLMSShard flt;
+    FilterAutoLMSShard_new(&flt, n_neurons, params->order, params->mu, row_begin, row_begin + n_rows);
+    printf("Receiving spikes in '%s' encoding\n", encoding_name(conn.encoding));
+    printf("Using %s LMS kernel\n", kernel_lms_name(flt.kernel));
+
+    // Arrays for storing spikes as int and as double
+    int* spks_int = (int*) malloc(n_neurons * sizeof(int));
+    double* spks_double = (double*) malloc(n_neurons * sizeof(double));
+
+    // Latency histograms of each stage
+    timing_init(use_tsc);
+    struct Histogram* hists = (struct Histogram *) malloc(N_PROC_STAGES * sizeof(struct Histogram));
+    for (int h = 0; h < N_PROC_STAGES; h++) {
+        Histogram_reset(&hists[h]);
+    }
+
+    printf("Filtering signal...\n");
+    int status = 0;
+    while (1) {
+
+        // Receive spikes from coordinator, and convert them to doubles
+        uint64_t t0 = timing_now();
+        if (processor_recv(&conn, spks_int) != 0) {
+            fprintf(stderr, "processor_recv() failed\n");
+            status = 1;
+            break;
+        }
+        if (!conn.is_connected) {
+            break;
+        }
+        uint64_t t1 = timing_now();
+        for (int i = 0; i < n_neurons; i++) {
+            spks_double[i] = (double) spks_int[i];
+        }
+        uint64_t t2 = timing_now();
+
+        // Update filter
+        FilterAutoLMSShard_predict_next(&flt, spks_double);
+        uint64_t t3 = timing_now();
+
+        // Send predictions of owned rows back to coordinator
+        if (processor_send(&conn, flt.x_pred) != 0) {
+            fprintf(stderr, "processor_send() failed\n");
+            status = 1;
+            break;
+        }
+        uint64_t t4 = timing_now();
+
+        // Record stage latencies
+        Histogram_record(&hists[PROC_RECV], timing_ns(t1 - t0));
+        Histogram_record(&hists[PROC_CONVERT], timing_ns(t2 - t1));
+        Histogram_record(&hists[PROC_FILTER], timing_ns(t3 - t2));
+        Histogram_record(&hists[PROC_SEND], timing_ns(t4 - t3));
+        int64_t one_way = (int64_t) (frame_time_ns() - conn.hdr_rx.t_send_ns);
+        Histogram_record(&hists[PROC_ONE_WAY], (one_way > 0) ? (uint64_t) one_way : 0);
+    }
+    printf("Done.\n");
+
+    // Report stage latencies
+    print_timing(hists, PROC_STAGE_NAMES, N_PROC_STAGES);
+    if (out_fpath[0] != '\0') {
+        printf("Writing timing data to '%s'...\n", out_fpath);
+        save_timing(out_fpath, hists, PROC_STAGE_NAMES, N_PROC_STAGES);
+        printf("Done.\n");
+    }
+
+    // Free memory, delete filter, and close connection
+    free(hists);
+    free(spks_double);
+    free(spks_int);
+    FilterAutoLMSShard_delete(&flt);
+    processor_disconnect(&conn);
+
+    return status;
+}
+
+
+// Coordinator mode (processor fanning frames out to shards)
+int coordinator_mode(char* host, int port, char* out_fpath, const char* shard_addrs, enum Transport transport,
+    enum WireEncoding encoding, int use_tsc) {
+
+    // Connect to probe
+    printf("Connecting to probe at %s:%d...\n", host, port);
+    struct ProcessorConnection conn;
+    if (processor_connect(host, port, transport, &conn) != 0) {
+        fprintf(stderr, "Processor connection failed\n");
+        return 1;
+    }
+    int n_neurons = conn.n_neurons;
+    printf("Done.\n");
+    printf("Receiving spikes in '%s' encoding\n", encoding_name(conn.encoding));
+
+    // Connect to shards (timing clock must be set before their latencies are
+    // recorded)
+    timing_init(use_tsc);
+    struct ShardCoordinator crd;
+    if (coordinator_connect(&crd, shard_addrs, n_neurons, encoding) != 0) {
+        fprintf(stderr, "Connection to shards failed\n");
+        processor_disconnect(&conn);
+        return 1;
+    }
+    for (int k = 0; k < crd.n_shards; k++) {
+        printf("Shard %d at %s:%d predicts rows [%d, %d) ('%s' encoding)\n", k, crd.shards[k].host,
+            crd.shards[k].port, crd.row_begin[k], crd.row_begin[k] + crd.shards[k].n_preds,
+            encoding_name(crd.shards[k].encoding));
+    }
+
+    // Arrays for storing spikes and gathered predictions
+    int* spks = (int*) malloc(n_neurons * sizeof(int));
+    double* preds = (double*) malloc(n_neurons * sizeof(double));
+
+    // Latency histograms of each stage, followed by those of each shard
+    int n_hists = N_COORD_STAGES + crd.n_shards;
+    struct Histogram* hists = (struct Histogram *) malloc(n_hists * sizeof(struct Histogram));
+    for (int h = 0; h < N_COORD_STAGES; h++) {
+        Histogram_reset(&hists[h]);
+    }
+
+    printf("Filtering signal...\n");
+    int status = 0;
+    while (1) {
+
+        // Receive spikes from probe
+        uint64_t t0 = timing_now();
+        if (processor_recv(&conn, spks) != 0) {
+            fprintf(stderr, "processor_recv() failed\n");
+            status = 1;
+            break;
+        }
+        if (!conn.is_connected) {
+            break;
+        }
+        uint64_t t1 = timing_now();
+
+        // Fan frame out to shards and gather their predictions
+        if (coordinator_step(&crd, spks, preds) != 0) {
+            status = 1;
+            break;
+        }
+        uint64_t t2 = timing_now();
+
+        // Send predictions back to probe
+        if (processor_send(&conn, preds) != 0) {
+            fprintf(stderr, "processor_send() failed\n");
+            status = 1;
+            break;
+        }
+        uint64_t t3 = timing_now();
+
+        // Record stage latencies
+        Histogram_record(&hists[COORD_RECV], timing_ns(t1 - t0));
+        Histogram_record(&hists[COORD_SHARDS], timing_ns(t2 - t1));
+        Histogram_record(&hists[COORD_SEND], timing_ns(t3 - t2));
+        int64_t one_way = (int64_t) (frame_time_ns() - conn.hdr_rx.t_send_ns);
+        Histogram_record(&hists[COORD_ONE_WAY], (one_way > 0) ? (uint64_t) one_way : 0);
+    }
+    printf("Done.\n");
+
+    // Report stage latencies and latency of each shard
+    const char** names = (const char**) malloc(n_hists * sizeof(char*));
+    char* shard_names = (char*) malloc(crd.n_shards * SHARD_NAME_LEN);
+    for (int h = 0; h < N_COORD_STAGES; h++) {
+        names[h] = COORD_STAGE_NAMES[h];
+    }
+    for (int k = 0; k < crd.n_shards; k++) {
+        snprintf(shard_names + k * SHARD_NAME_LEN, SHARD_NAME_LEN, "shard%d", k);
+        names[N_COORD_STAGES + k] = shard_names + k * SHARD_NAME_LEN;
+        hists[N_COORD_STAGES + k] = crd.hists[k];
+    }
+    print_timing(hists, names, n_hists);
+    if (out_fpath[0] != '\0') {
+        printf("Writing timing data to '%s'...\n", out_fpath);
+        save_timing(out_fpath, hists, names, n_hists);
+        printf("Done.\n");
+    }
+
+    // Free memory, and close connections
+    free(shard_names);
+    free(names);
+    free(hists);
+    free(preds);
+    free(spks);
+    coordinator_disconnect(&crd);
+    processor_disconnect(&conn);
+
+    return status;
+}
+
+
+// Server mode (processor serving any number of probes)
+int server_mode(char* host, int port, enum FilterType filter_type, struct FilterParams* params,
+    int n_workers, int first_cpu) {
+
+    struct ProcessorServer srv;
+    if (server_start(&srv, host, port, n_workers, first_cpu, filter_type, params) != 0) {
+        fprintf(stderr, "Server startup failed\n");
+        return 1;
+    }
+    printf("Serving probes at %s:%d with '%s' filter (%d worker(s))...\n",
+        host, port, FilterAuto_type_name(filter_type), srv.n_workers);
+
+    return server_run(&srv);
+}
+
+
+// Replay mode (run filter over recording in-process, without a connection)
+int replay_mode(char* in_fpath, char* out_fpath, enum FilterType filter_type, struct FilterParams* params,
+    int compare, int use_tsc, long max_pts, int compress_level, int block) {
+
+    // Start streaming spike counts from input file
+    printf("Opening '%s'...\n", in_fpath);
+    struct SpikeReader rdr;
+    if (SpikeReader_open(&rdr, in_fpath, max_pts) != 0) {
+        return 1;
+    }
+    long n_pts = rdr.n_pts;
+    int n_neurons = rdr.n_neurons;
+    printf("Streaming %ld time points of %d neurons in chunks of %d\n", n_pts, n_neurons, rdr.chunk_rows);
+
+    // Create filter object
+    struct FilterAuto flt;
+    if (FilterAuto_new(&flt, filter_type, n_neurons, params) != 0) {
+        fprintf(stderr, "Filter creation failed\n");
+        SpikeReader_close(&rdr);
+        return 1;
+    }
+    printf("Using '%s' filter (order %d, mu %g)\n", FilterAuto_type_name(filter_type), params->order, params->mu);
+    if (filter_type == FILTER_LMS) {
+        printf("Using %s LMS kernel\n", kernel_lms_name(flt.lms.kernel));
+    }
+    else if (filter_type == FILTER_LMS_SPARSE) {
+        printf("Using %s sparse LMS kernel\n", kernel_lms_sparse_name(flt.lms.kernel_sparse));
+    }
+    if (filter_type != FILTER_ECHO) {
+        printf("Using %d thread(s)\n", flt.use_engine ? flt.engine.n_threads
+            : (filter_type == FILTER_LMS_DELAYED) ? 2 : 1);
+    }
+
+    // Create reference filter for comparison if requested
+    struct FilterCompare cmp;
+    if (compare) {
+        FilterCompare_new(&cmp, n_neurons, params);
+    }
+
+    // Start writing predictions to output file if one was given (rows are
+    // never dropped, so a slow disk slows the replay down)
+    struct ResultWriter wr;
+    int write = (out_fpath[0] != '\0');
+    if (write) {
+        printf("Writing data to '%s'...\n", out_fpath);
+        if (ResultWriter_open(&wr, out_fpath, n_neurons, compress_level) != 0) {
+            FilterAuto_delete(&flt);
+            SpikeReader_close(&rdr);
+            return 1;
+        }
+    }
+
+    // Block of spikes as doubles with predictions made after each, and
+    // prediction made on previous step
+    double* spks_double = (double*) malloc((size_t) block * n_neurons * sizeof(double));
+    double* preds = (double*) malloc((size_t) block * n_neurons * sizeof(double));
+    double* pred_prev = (double*) calloc(n_neurons, sizeof(double));
+    if (block > 1) {
+        printf("Filtering blocks of %d time points\n", block);
+    }
+
+    // Latency histograms of each stage
+    timing_init(use_tsc);
+    struct Histogram* hists = (struct Histogram *) malloc(N_REPLAY_STAGES * sizeof(struct Histogram));
+    for (int h = 0; h < N_REPLAY_STAGES; h++) {
+        Histogram_reset(&hists[h]);
+    }
+
+    printf("Filtering signal...\n");
+    int status = 0;
+    double sse = 0.0;
+    uint64_t st_all = timing_now();
+    long k = 0;
+    while (k < n_pts && status == 0) {
+
+        // Read and convert spikes to doubles, up to a block of them
+        int nb = 0;
+        uint64_t ns_convert = 0;
+        while (nb < block && k + nb < n_pts) {
+            int* spks_k = SpikeReader_next(&rdr);
+            if (spks_k == NULL) {
+                fprintf(stderr, "Recording ended after %ld frames\n", k + nb);
+                status = 1;
+                break;
+            }
+            uint64_t t0 = timing_now();
+            double* x = spks_double + (size_t) nb * n_neurons;
+            for (int i = 0; i < n_neurons; i++) {
+                x[i] = (double) spks_k[i];
+            }
+            ns_convert += timing_ns(timing_now() - t0);
+            nb++;
+        }
+        if (nb == 0) {
+            break;
+        }
+
+        // Update filter
+        uint64_t t1 = timing_now();
+        double* fpreds;
+        if (block == 1) {
+            FilterAuto_predict_next(&flt, spks_double);
+            fpreds = flt.x_pred;
+        }
+        else {
+            FilterAuto_predict_block(&flt, spks_double, nb, preds);
+            fpreds = preds;
+        }
+        uint64_t t2 = timing_now();
+        uint64_t ns_filter = timing_ns(t2 - t1);
+
+        for (int t = 0; t < nb; t++) {
+            double* x = spks_double + (size_t) t * n_neurons;
+            double* pred = fpreds + (size_t) t * n_neurons;
+
+            // Record latencies (time spent on a block is shared evenly between
+            // its time points)
+            Histogram_record(&hists[REPLAY_CONVERT], ns_convert / nb);
+            Histogram_record(&hists[REPLAY_FILTER], ns_filter / nb);
+
+            // Accumulate error of prediction made on previous step
+            for (int i = 0; i < n_neurons; i++) {
+                double e = x[i] - pred_prev[i];
+                sse += e * e;
+                pred_prev[i] = pred[i];
+            }
+            if (compare) {
+                FilterCompare_update(&cmp, x, pred);
+            }
+
+            // Queue predictions for writing, with filter latency
+            if (write) {
+                double* row = ResultWriter_reserve_wait(&wr);
+                memcpy(row, pred, n_neurons * sizeof(double));
+                ResultWriter_commit(&wr, k + t, ns_filter / nb / 1e3);
+            }
+        }
+        k += nb;
+    }
+    double elapsed_s = timing_ns(timing_now() - st_all) / 1e9;
+    printf("Done.\n");
+
+    // Report throughput (overall, and counting time spent in filter only)
+    printf("Throughput: %f samples/s\n", k / elapsed_s);
+    printf("Filter throughput: %f samples/s\n", k / (hists[REPLAY_FILTER].sum / 1e9));
+    printf("Prediction MSE: %g\n", (k > 0) ? sse / ((double) k * n_neurons) : 0.0);
+    print_timing(hists, REPLAY_STAGE_NAMES, N_REPLAY_STAGES);
+    FilterAuto_print_stats(&flt);
+    if (compare) {
+        FilterCompare_print(&cmp);
+        FilterCompare_delete(&cmp);
+    }
+
+    // Stop reading, and finish writing predictions and latency histograms
+    SpikeReader_close(&rdr);
+    if (write) {
+        if (ResultWriter_finish(&wr) != 0
+                || write_timing(wr.file, hists, REPLAY_STAGE_NAMES, N_REPLAY_STAGES) != 0) {
+            status = 1;
+        }
+        ResultWriter_close(&wr);
+        printf("Wrote %ld rows.\n", wr.n_written);
+    }
+
+    // Free memory
+    free(hists);
+    free(spks_double);
+    free(preds);
+    free(pred_prev);
+
+    // Delete filter
+    FilterAuto_delete(&flt);
+
+    return status;
+}
+
+
 // Print usage message
 void print_usage() {
 
-    puts("Usage: realtime [probe, processor]");
+    puts("Usage: realtime [probe, processor, server, replay, shard, coordinator]");
 
 }
 
@@ -332,16 +1017,27 @@ int main(int argc, char **argv) {
 
             // Variables for storing argument values
             int c;
-            int port;
-            char host[ARG_BUF_SIZE];
+            int port = -1;
+            char host[ARG_BUF_SIZE] = "";
             char in_fpath[ARG_BUF_SIZE];
             char out_fpath[ARG_BUF_SIZE];
+            enum Transport transport = TRANSPORT_TCP;
+            enum WireEncoding encoding = ENCODING_INT32;
+            int window = 0;
+            double rate = 0.0;
+            int use_tsc = 0;
+            long max_pts = 0;
+            int compress_level = 0;
+            int rt_cpu = -1;
+            int fifo_prio = 0;
+            struct RtProfile prof;
+            rt_profile_init(&prof);
 
             // Start parsing after subcommand
             optind = 2;
 
             // Use getopt to parse arguments
-			while((c = getopt(argc, argv, "a:p:i:o:")) != -1) {
+			while((c = getopt(argc, argv, "a:p:i:o:x:e:w:r:Tn:z:R:P:")) != -1) {
     			switch (c) {
       				case 'a':
 						strcpy(host, optarg);
@@ -354,6 +1050,51 @@ int main(int argc, char **argv) {
                         break;
                     case 'o':
                         strcpy(out_fpath, optarg);
+                        break;
+                    case 'x':
+                        if (transport_parse(optarg, &transport) != 0) {
+                            fprintf(stderr, "transport '%s' not supported\n", optarg);
+                            return 1;
+                        }
+                        break;
+                    case 'e':
+                        if (encoding_parse(optarg, &encoding) != 0) {
+                            fprintf(stderr, "encoding '%s' not supported\n", optarg);
+                            return 1;
+                        }
+                        break;
+                    case 'w':
+                        window = atoi(optarg);
+                        if (window < 1) {
+                            fprintf(stderr, "window must be at least 1\n");
+                            return 1;
+                        }
+                        break;
+                    case 'r':
+                        rate = atof(optarg);
+                        if (rate <= 0) {
+                            fprintf(stderr, "rate must be positive\n");
+                            return 1;
+                        }
+                        break;
+                    case 'T':
+                        use_tsc = 1;
+                        break;
+                    case 'n':
+                        max_pts = atol(optarg);
+                        break;
+                    case 'z':
+                        compress_level = atoi(optarg);
+                        if (compress_level < 0 || compress_level > 9) {
+                            fprintf(stderr, "compression level must be between 0 and 9\n");
+                            return 1;
+                        }
+                        break;
+                    case 'R':
+                        rt_cpu = atoi(optarg);
+                        break;
+                    case 'P':
+                        fifo_prio = atoi(optarg);
                         break;
       				case '?':
 						return 1;
@@ -362,7 +1103,16 @@ int main(int argc, char **argv) {
 				}
       		}
 
-            return probe_mode(host, port, in_fpath, out_fpath);
+            if (host[0] == '\0' || port < 0) {
+                fprintf(stderr, "probe needs an address and port (-a host -p port)\n");
+                return 1;
+            }
+            if (rt_cpu >= 0) {
+                rt_profile_enable(&prof, rt_cpu, fifo_prio);
+            }
+
+            return probe_mode(host, port, in_fpath, out_fpath, transport, encoding, window, rate, use_tsc,
+                max_pts, compress_level, &prof);
         }
 
         // Processor mode
@@ -370,17 +1120,37 @@ int main(int argc, char **argv) {
 
             // Variables for storing argument values
             int c;
-            int port;
-            int use_lms;
-            char host[ARG_BUF_SIZE];
-            char out_fpath[ARG_BUF_SIZE];
-            char filter_type[ARG_BUF_SIZE];
+            int port = -1;
+            enum FilterType filter_type = FILTER_LMS;
+            struct FilterParams params;
+            params.order = FILTER_ORDER;
+            params.mu = FILTER_MU;
+            params.n_threads = 1;
+            params.first_cpu = -1;
+            params.bank_spec = NULL;
+            params.bank_blend = 0;
+            params.rank = FILTER_RANK;
+            params.mask_fpath = NULL;
+            params.n_nearest = FILTER_NEAREST;
+            int compare = 0;
+            enum Transport transport = TRANSPORT_TCP;
+            int use_tsc = 0;
+            char host[ARG_BUF_SIZE] = "";
+            char out_fpath[ARG_BUF_SIZE] = "";
+            int max_block = PROC_MAX_BLOCK;
+            int rt_cpu = -1;
+            int fifo_prio = 0;
+            struct RtProfile prof;
+            rt_profile_init(&prof);
+            char* ckpt_fpath = NULL;
+            long ckpt_interval = CHECKPOINT_INTERVAL;
+            char* warm_fpath = NULL;
 
             // Start parsing after subcommand
             optind = 2;
 
             // Use getopt to parse arguments
-			while((c = getopt(argc, argv, "a:p:f:")) != -1) {
+			while((c = getopt(argc, argv, "a:p:o:f:n:c:B:br:g:G:M:Dx:TR:P:K:E:k:")) != -1) {
     			switch (c) {
       				case 'a':
 						strcpy(host, optarg);
@@ -389,16 +1159,80 @@ int main(int argc, char **argv) {
                         port = atoi(optarg);
                         break;
                     case 'f':
-                        if (strcmp(optarg, "lms") == 0) {
-                            use_lms = 1;
+                        if (FilterAuto_parse_type(optarg, &filter_type) != 0) {
+                            fprintf(stderr, "filter type '%s' not supported\n", optarg);
+                            return 1;
                         }
-                        else if (strcmp(optarg, "echo") == 0) {
-                            use_lms = 0;
+                        break;
+                    case 'n':
+                        params.n_threads = atoi(optarg);
+                        break;
+                    case 'c':
+                        params.first_cpu = atoi(optarg);
+                        break;
+                    case 'B':
+                        params.bank_spec = optarg;
+                        break;
+                    case 'b':
+                        params.bank_blend = 1;
+                        break;
+                    case 'r':
+                        params.rank = atoi(optarg);
+                        if (params.rank < 1) {
+                            fprintf(stderr, "rank must be at least 1\n");
+                            return 1;
                         }
-                        else {
-                            fprintf(stderr, "filter type '%s' not supported\n", optarg);
+                        break;
+                    case 'g':
+                        params.n_nearest = atoi(optarg);
+                        if (params.n_nearest < 0) {
+                            fprintf(stderr, "number of nearest channels must not be negative\n");
                             return 1;
                         }
+                        break;
+                    case 'G':
+                        params.mask_fpath = optarg;
+                        break;
+                    case 'M':
+                        max_block = atoi(optarg);
+                        if (max_block < 1) {
+                            fprintf(stderr, "block size must be at least 1\n");
+                            return 1;
+                        }
+                        break;
+                    case 'D':
+                        compare = 1;
+                        break;
+                    case 'x':
+                        if (transport_parse(optarg, &transport) != 0) {
+                            fprintf(stderr, "transport '%s' not supported\n", optarg);
+                            return 1;
+                        }
+                        break;
+                    case 'o':
+                        strcpy(out_fpath, optarg);
+                        break;
+                    case 'T':
+                        use_tsc = 1;
+                        break;
+                    case 'R':
+                        rt_cpu = atoi(optarg);
+                        break;
+                    case 'P':
+                        fifo_prio = atoi(optarg);
+                        break;
+                    case 'K':
+                        ckpt_fpath = optarg;
+                        break;
+                    case 'E':
+                        ckpt_interval = atol(optarg);
+                        if (ckpt_interval < 1) {
+                            fprintf(stderr, "checkpoint interval must be at least 1 frame\n");
+                            return 1;
+                        }
+                        break;
+                    case 'k':
+                        warm_fpath = optarg;
                         break;
       				case '?':
 						return 1;
@@ -406,8 +1240,303 @@ int main(int argc, char **argv) {
 						return 1;
 				}
       		}
+            if (host[0] == '\0' || port < 0) {
+                fprintf(stderr, "processor needs an address and port (-a host -p port)\n");
+                return 1;
+            }
+            if (rt_cpu >= 0) {
+                rt_profile_enable(&prof, rt_cpu, fifo_prio);
+            }
+
+            return processor_mode(host, port, out_fpath, filter_type, &params, compare, transport, use_tsc,
+                max_block, &prof, ckpt_fpath, ckpt_interval, warm_fpath);
+        }
+
+        // Shard mode
+        else if (strcmp(argv[1], "shard") == 0) {
+
+            // Variables for storing argument values
+            int c;
+            int port = -1;
+            char host[ARG_BUF_SIZE] = "";
+            char out_fpath[ARG_BUF_SIZE] = "";
+            struct FilterParams params;
+            params.order = FILTER_ORDER;
+            params.mu = FILTER_MU;
+            int use_tsc = 0;
+
+            // Start parsing after subcommand
+            optind = 2;
+
+            // Use getopt to parse arguments
+            while((c = getopt(argc, argv, "a:p:o:T")) != -1) {
+                switch (c) {
+                    case 'a':
+                        strcpy(host, optarg);
+                        break;
+                    case 'p':
+                        port = atoi(optarg);
+                        break;
+                    case 'o':
+                        strcpy(out_fpath, optarg);
+                        break;
+                    case 'T':
+                        use_tsc = 1;
+                        break;
+                    case '?':
+                        return 1;
+                    default:
+                        return 1;
+                }
+            }
+
+            if (host[0] == '\0' || port < 0) {
+                fprintf(stderr, "shard needs an address and port (-a host -p port)\n");
+                return 1;
+            }
+            return shard_mode(host, port, out_fpath, &params, use_tsc);
+        }
+
+        // Coordinator mode
+        else if (strcmp(argv[1], "coordinator") == 0) {
+
+            // Variables for storing argument values
+            int c;
+            int port = -1;
+            char host[ARG_BUF_SIZE] = "";
+            char out_fpath[ARG_BUF_SIZE] = "";
+            char shard_addrs[ARG_BUF_SIZE] = "";
+            enum Transport transport = TRANSPORT_TCP;
+            enum WireEncoding encoding = ENCODING_INT32;
+            int use_tsc = 0;
+
+            // Start parsing after subcommand
+            optind = 2;
+
+            // Use getopt to parse arguments
+            while((c = getopt(argc, argv, "a:p:o:s:x:e:T")) != -1) {
+                switch (c) {
+                    case 'a':
+                        strcpy(host, optarg);
+                        break;
+                    case 'p':
+                        port = atoi(optarg);
+                        break;
+                    case 'o':
+                        strcpy(out_fpath, optarg);
+                        break;
+                    case 's':
+                        strcpy(shard_addrs, optarg);
+                        break;
+                    case 'x':
+                        if (transport_parse(optarg, &transport) != 0) {
+                            fprintf(stderr, "transport '%s' not supported\n", optarg);
+                            return 1;
+                        }
+                        break;
+                    case 'e':
+                        if (encoding_parse(optarg, &encoding) != 0) {
+                            fprintf(stderr, "encoding '%s' not supported\n", optarg);
+                            return 1;
+                        }
+                        break;
+                    case 'T':
+                        use_tsc = 1;
+                        break;
+                    case '?':
+                        return 1;
+                    default:
+                        return 1;
+                }
+            }
+            if (host[0] == '\0' || port < 0) {
+                fprintf(stderr, "coordinator needs an address and port (-a host -p port)\n");
+                return 1;
+            }
+            if (shard_addrs[0] == '\0') {
+                fprintf(stderr, "coordinator needs shard addresses (-s host:port,...)\n");
+                return 1;
+            }
+
+            return coordinator_mode(host, port, out_fpath, shard_addrs, transport, encoding, use_tsc);
+        }
+
+        // Server mode
+        else if (strcmp(argv[1], "server") == 0) {
+
+            // Variables for storing argument values
+            int c;
+            int port = -1;
+            char host[ARG_BUF_SIZE] = "";
+            enum FilterType filter_type = FILTER_LMS;
+            struct FilterParams params;
+            params.order = FILTER_ORDER;
+            params.mu = FILTER_MU;
+            params.n_threads = 1;
+            params.first_cpu = -1;
+            params.bank_spec = NULL;
+            params.bank_blend = 0;
+            params.rank = FILTER_RANK;
+            params.mask_fpath = NULL;
+            params.n_nearest = FILTER_NEAREST;
+            int n_workers = 1;
+            int first_cpu = -1;
+
+            // Start parsing after subcommand
+            optind = 2;
+
+            // Use getopt to parse arguments
+            while((c = getopt(argc, argv, "a:p:f:w:c:")) != -1) {
+                switch (c) {
+                    case 'a':
+                        strcpy(host, optarg);
+                        break;
+                    case 'p':
+                        port = atoi(optarg);
+                        break;
+                    case 'f':
+                        if (FilterAuto_parse_type(optarg, &filter_type) != 0) {
+                            fprintf(stderr, "filter type '%s' not supported\n", optarg);
+                            return 1;
+                        }
+                        break;
+                    case 'w':
+                        n_workers = atoi(optarg);
+                        break;
+                    case 'c':
+                        first_cpu = atoi(optarg);
+                        break;
+                    case '?':
+                        return 1;
+                    default:
+                        return 1;
+                }
+            }
+
+            if (host[0] == '\0' || port < 0) {
+                fprintf(stderr, "server needs an address and port (-a host -p port)\n");
+                return 1;
+            }
+            return server_mode(host, port, filter_type, &params, n_workers, first_cpu);
+        }
+
+        // Replay mode
+        else if (strcmp(argv[1], "replay") == 0) {
+
+            // Variables for storing argument values
+            int c;
+            enum FilterType filter_type = FILTER_LMS;
+            struct FilterParams params;
+            params.order = FILTER_ORDER;
+            params.mu = FILTER_MU;
+            params.n_threads = 1;
+            params.first_cpu = -1;
+            params.bank_spec = NULL;
+            params.bank_blend = 0;
+            params.rank = FILTER_RANK;
+            params.mask_fpath = NULL;
+            params.n_nearest = FILTER_NEAREST;
+            int compare = 0;
+            int use_tsc = 0;
+            long max_pts = 0;
+            int compress_level = 0;
+            int max_block = 1;
+            char in_fpath[ARG_BUF_SIZE] = "";
+            char out_fpath[ARG_BUF_SIZE] = "";
+
+            // Start parsing after subcommand
+            optind = 2;
+
+            // Use getopt to parse arguments
+            while((c = getopt(argc, argv, "i:o:f:k:m:n:c:B:br:g:G:M:DTN:z:")) != -1) {
+                switch (c) {
+                    case 'i':
+                        strcpy(in_fpath, optarg);
+                        break;
+                    case 'o':
+                        strcpy(out_fpath, optarg);
+                        break;
+                    case 'f':
+                        if (FilterAuto_parse_type(optarg, &filter_type) != 0) {
+                            fprintf(stderr, "filter type '%s' not supported\n", optarg);
+                            return 1;
+                        }
+                        break;
+                    case 'k':
+                        params.order = atoi(optarg);
+                        if (params.order < 1) {
+                            fprintf(stderr, "order must be at least 1\n");
+                            return 1;
+                        }
+                        break;
+                    case 'm':
+                        params.mu = atof(optarg);
+                        break;
+                    case 'n':
+                        params.n_threads = atoi(optarg);
+                        break;
+                    case 'c':
+                        params.first_cpu = atoi(optarg);
+                        break;
+                    case 'B':
+                        params.bank_spec = optarg;
+                        break;
+                    case 'b':
+                        params.bank_blend = 1;
+                        break;
+                    case 'r':
+                        params.rank = atoi(optarg);
+                        if (params.rank < 1) {
+                            fprintf(stderr, "rank must be at least 1\n");
+                            return 1;
+                        }
+                        break;
+                    case 'g':
+                        params.n_nearest = atoi(optarg);
+                        if (params.n_nearest < 0) {
+                            fprintf(stderr, "number of nearest channels must not be negative\n");
+                            return 1;
+                        }
+                        break;
+                    case 'G':
+                        params.mask_fpath = optarg;
+                        break;
+                    case 'M':
+                        max_block = atoi(optarg);
+                        if (max_block < 1) {
+                            fprintf(stderr, "block size must be at least 1\n");
+                            return 1;
+                        }
+                        break;
+                    case 'D':
+                        compare = 1;
+                        break;
+                    case 'T':
+                        use_tsc = 1;
+                        break;
+                    case 'N':
+                        max_pts = atol(optarg);
+                        break;
+                    case 'z':
+                        compress_level = atoi(optarg);
+                        if (compress_level < 0 || compress_level > 9) {
+                            fprintf(stderr, "compression level must be between 0 and 9\n");
+                            return 1;
+                        }
+                        break;
+                    case '?':
+                        return 1;
+                    default:
+                        return 1;
+                }
+            }
+            if (in_fpath[0] == '\0') {
+                fprintf(stderr, "replay needs an input file (-i)\n");
+                return 1;
+            }
 
-            return processor_mode(host, port, use_lms);
+            return replay_mode(in_fpath, out_fpath, filter_type, &params, compare, use_tsc, max_pts,
+                compress_level, max_block);
         }
 
         // Invalid mode
@@ -0,0 +1,214 @@
+/* Masked LMS filter */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "masked.h"
+
+
+// Connect each channel to itself and its n_nearest nearest channels by index
+// (a window of n_nearest + 1 channels around it, shifted inward at the edges)
+static void mask_nearest(struct FilterAutoLMSMasked* flt, int n_nearest) {
+
+    int dim = flt->dim;
+    int size = (n_nearest + 1 < dim) ? n_nearest + 1 : dim;
+
+    flt->row_ptr = (int *) malloc((dim + 1) * sizeof(int));
+    flt->cols = (int *) malloc((size_t) dim * size * sizeof(int));
+    for (int i = 0; i < dim; i++) {
+        int lo = i - n_nearest / 2;
+        if (lo > dim - size) {
+            lo = dim - size;
+        }
+        if (lo < 0) {
+            lo = 0;
+        }
+        flt->row_ptr[i] = i * size;
+        for (int m = 0; m < size; m++) {
+            flt->cols[i * size + m] = lo + m;
+        }
+    }
+    flt->row_ptr[dim] = dim * size;
+}
+
+
+// Compare ints (for qsort)
+static int compare_int(const void* a, const void* b) {
+
+    int x = *(const int*) a;
+    int y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+
+// Read connections from mask file, and connect each channel to itself;
+// returns 0 on success and 1 on error
+static int mask_read(struct FilterAutoLMSMasked* flt, const char* fpath) {
+
+    int dim = flt->dim;
+
+    FILE* fp = fopen(fpath, "r");
+    if (fp == NULL) {
+        perror("Cannot open mask file");
+        return 1;
+    }
+
+    // Read 'row col' pairs
+    int n_pairs = 0;
+    int cap = 1024;
+    int* pairs = (int *) malloc(2 * cap * sizeof(int));
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_no++;
+        char* p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+        int row, col;
+        if (sscanf(p, "%d %d", &row, &col) != 2 || row < 0 || row >= dim || col < 0 || col >= dim) {
+            fprintf(stderr, "Malformed mask file '%s' at line %d (expected 'row col' with channels below %d)\n",
+                fpath, line_no, dim);
+            free(pairs);
+            fclose(fp);
+            return 1;
+        }
+        if (n_pairs == cap) {
+            cap *= 2;
+            pairs = (int *) realloc(pairs, 2 * cap * sizeof(int));
+        }
+        pairs[2 * n_pairs] = row;
+        pairs[2 * n_pairs + 1] = col;
+        n_pairs++;
+    }
+    fclose(fp);
+
+    // Lay out rows, with room for each channel's own history
+    flt->row_ptr = (int *) calloc(dim + 1, sizeof(int));
+    for (int i = 0; i < dim; i++) {
+        flt->row_ptr[i + 1] = 1;
+    }
+    for (int p = 0; p < n_pairs; p++) {
+        flt->row_ptr[pairs[2 * p] + 1]++;
+    }
+    for (int i = 0; i < dim; i++) {
+        flt->row_ptr[i + 1] += flt->row_ptr[i];
+    }
+
+    // Fill rows
+    int* fill = (int *) malloc(dim * sizeof(int));
+    flt->cols = (int *) malloc(flt->row_ptr[dim] * sizeof(int));
+    for (int i = 0; i < dim; i++) {
+        flt->cols[flt->row_ptr[i]] = i;
+        fill[i] = flt->row_ptr[i] + 1;
+    }
+    for (int p = 0; p < n_pairs; p++) {
+        flt->cols[fill[pairs[2 * p]]++] = pairs[2 * p + 1];
+    }
+
+    // Sort each row and drop repeated connections, compacting rows in place
+    int n = 0;
+    for (int i = 0; i < dim; i++) {
+        int begin = flt->row_ptr[i];
+        int end = flt->row_ptr[i + 1];
+        qsort(flt->cols + begin, end - begin, sizeof(int), compare_int);
+        flt->row_ptr[i] = n;
+        for (int m = begin; m < end; m++) {
+            if (m == begin || flt->cols[m] != flt->cols[m - 1]) {
+                flt->cols[n++] = flt->cols[m];
+            }
+        }
+    }
+    flt->row_ptr[dim] = n;
+
+    free(fill);
+    free(pairs);
+    return 0;
+}
+
+
+// Constructor for FilterAutoLMSMasked object
+int FilterAutoLMSMasked_new(struct FilterAutoLMSMasked* flt, int dim, int order, double mu,
+    const char* mask_fpath, int n_nearest) {
+
+    // Populate fields
+    flt->dim = dim;
+    flt->order = order;
+    flt->mu = mu;
+    flt->head = 0;
+    flt->kernel = kernel_lms_masked_select();
+
+    // Build connectivity mask
+    if (mask_fpath != NULL) {
+        if (mask_read(flt, mask_fpath) != 0) {
+            return 1;
+        }
+    }
+    else {
+        mask_nearest(flt, n_nearest);
+    }
+    flt->n_conn = flt->row_ptr[dim];
+
+    // Allocate arrays (weights and history start at zero)
+    flt->x_pred = (double *) calloc(dim, sizeof(double));
+    flt->x_err = (double *) calloc(dim, sizeof(double));
+    flt->wts = (double *) calloc((size_t) flt->n_conn * order, sizeof(double));
+    flt->x_hist = (double *) calloc((size_t) dim * order, sizeof(double));
+    flt->blk_old = (const double **) malloc(order * sizeof(double*));
+    flt->blk_new = (const double **) malloc(order * sizeof(double*));
+
+    return 0;
+}
+
+
+// Destructor for FilterAutoLMSMasked object
+void FilterAutoLMSMasked_delete(struct FilterAutoLMSMasked* flt) {
+
+    // Free allocated memory
+    free(flt->blk_new);
+    free(flt->blk_old);
+    free(flt->x_hist);
+    free(flt->wts);
+    free(flt->x_err);
+    free(flt->x_pred);
+    free(flt->cols);
+    free(flt->row_ptr);
+}
+
+
+// Update filter with new signal value and predict next value
+void FilterAutoLMSMasked_predict_next(struct FilterAutoLMSMasked* flt, double* x) {
+
+    int dim = flt->dim;
+
+    // Point kernel at history blocks (block k of the new history is block
+    // k - 1 of the old history, and block 0 is the new signal value)
+    for (int k = 0; k < flt->order; k++) {
+        flt->blk_old[k] = flt->x_hist + ((flt->head + k) % flt->order) * dim;
+        flt->blk_new[k] = (k == 0) ? x : flt->blk_old[k - 1];
+    }
+
+    // Compute error of last prediction
+    for (int i = 0; i < dim; i++) {
+        flt->x_err[i] = x[i] - flt->x_pred[i];
+    }
+
+    // Update connected weights and predict in one pass
+    flt->kernel(
+        flt->wts, flt->row_ptr, flt->cols, flt->order, flt->mu,
+        flt->x_err, flt->blk_old, flt->blk_new, flt->x_pred, 0, dim
+    );
+
+    // Add new signal value to history, overwriting oldest slot
+    flt->head = (flt->head + flt->order - 1) % flt->order;
+    memcpy(flt->x_hist + flt->head * dim, x, dim * sizeof(double));
+}
+
+
+// Print size of connectivity mask
+void FilterAutoLMSMasked_print_stats(struct FilterAutoLMSMasked* flt) {
+
+    printf("Masked LMS: %d connections (%.1f per channel, %.1f%% of full weights)\n",
+        flt->n_conn, (double) flt->n_conn / flt->dim, 100.0 * flt->n_conn / ((double) flt->dim * flt->dim));
+}
@@ -0,0 +1,78 @@
+/* Header file for masked LMS filter */
+
+
+#ifndef _MASKED_H
+#define _MASKED_H
+
+#include "kernels.h"
+
+
+/* Masked autoregressive LMS filter
+ *
+ * Same as FilterAutoLMS, but the prediction for each channel only uses the
+ * history of the channels it is connected to in a connectivity mask, and only
+ * those weights are stored and updated (in compressed sparse row form, see
+ * KernelLMSMasked). Every channel is connected to its own history. The rest of
+ * the mask is either its n_nearest nearest channels by index (neighbors on the
+ * probe), or is read from a text file with one 'row col' pair per line, which
+ * connects the prediction for channel row to the history of channel col
+ * (blank lines and lines starting with '#' are skipped).
+ */
+struct FilterAutoLMSMasked {
+
+    // Dimension of signal
+    int dim;
+
+    // Order of filter (number of signal vectors in history)
+    int order;
+
+    // Step size used for filter updates
+    double mu;
+
+    // Connectivity mask (channels connected to row i are listed at
+    // cols + row_ptr[i], in increasing order), and total number of
+    // connections (row_ptr[dim])
+    int* row_ptr;
+    int* cols;
+    int n_conn;
+
+    // Filter prediction
+    double* x_pred;
+
+    // Filter error from last step
+    double* x_err;
+
+    // Weights of connections (n_conn * order, laid out as for
+    // KernelLMSMasked)
+    double* wts;
+
+    // Signal history (circular buffer, as in FilterAutoLMS), and pointers to
+    // its blocks before (blk_old) and after (blk_new) adding the newest signal
+    // value
+    double* x_hist;
+    int head;
+    const double** blk_old;
+    const double** blk_new;
+
+    // Masked kernel selected for this CPU
+    KernelLMSMasked kernel;
+};
+
+// Constructor for filter object; connects each channel to its n_nearest
+// nearest channels if mask_fpath is NULL, and to the channels listed in the
+// file otherwise; returns 0 on success and 1 if the file can't be read or is
+// malformed
+int FilterAutoLMSMasked_new(struct FilterAutoLMSMasked* flt, int dim, int order, double mu,
+    const char* mask_fpath, int n_nearest);
+
+// Destructor for filter object
+void FilterAutoLMSMasked_delete(struct FilterAutoLMSMasked* flt);
+
+// Update filter with new signal value and predict next value
+void FilterAutoLMSMasked_predict_next(struct FilterAutoLMSMasked* flt, double* x);
+
+// Print size of connectivity mask
+void FilterAutoLMSMasked_print_stats(struct FilterAutoLMSMasked* flt);
+
+
+#endif
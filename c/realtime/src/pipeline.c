@@ -0,0 +1,219 @@
+/* Pipelined probe */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/prctl.h>
+
+#include "pipeline.h"
+
+
+// Current time (nanoseconds, monotonic clock; the open-loop schedule is kept
+// with clock_nanosleep(), so the pipeline always uses this clock rather than
+// timing_now())
+static uint64_t now_ns(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+// Sleep until given time (nanoseconds, monotonic clock)
+static void sleep_until_ns(uint64_t t) {
+
+    struct timespec ts;
+    ts.tv_sec = t / 1000000000ull;
+    ts.tv_nsec = t % 1000000000ull;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        continue;
+    }
+}
+
+
+// Wait on semaphore, retrying if interrupted
+static void sem_wait_retry(sem_t* sem) {
+
+    while (sem_wait(sem) != 0 && errno == EINTR) {
+        continue;
+    }
+}
+
+
+// Main loop of sender thread
+static void* pipeline_sender_run(void* arg) {
+
+    struct ProbePipeline* pl = (struct ProbePipeline*) arg;
+
+    // Wake up as close to the due time as the kernel allows (default timer
+    // slack of 50 us is a large fraction of a typical period)
+    if (pl->period_ns > 0) {
+        prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+    }
+    uint64_t t_start = now_ns();
+
+    long n_sent = 0;
+    for (long k = 0; k < pl->n_pts && !atomic_load(&pl->failed); k++) {
+
+        // Get frame from reader before it is due
+        int* spks_k = SpikeReader_next(pl->rdr);
+        if (spks_k == NULL) {
+            fprintf(stderr, "Recording ended after %ld frames\n", k);
+            atomic_store(&pl->failed, 1);
+            break;
+        }
+
+        uint64_t t_send;
+        if (pl->period_ns > 0) {
+
+            // Wait until frame is due, and drop it if window is full
+            t_send = t_start + k * pl->period_ns;
+            sleep_until_ns(t_send);
+            if (sem_trywait(&pl->window_free) != 0) {
+                pl->n_dropped++;
+                continue;
+            }
+        }
+        else {
+
+            // Wait until window has room for another frame
+            sem_wait_retry(&pl->window_free);
+            t_send = now_ns();
+        }
+        if (atomic_load(&pl->failed)) {
+            break;
+        }
+
+        // Record frame before sending it, so receiver can find it as soon as
+        // the prediction comes back (sequence number is index of frame, so
+        // dropped frames leave gaps)
+        struct PipelineFrame* frame = &pl->frames[n_sent % pl->window];
+        frame->seq = k;
+        frame->t_send_ns = t_send;
+        atomic_store(&pl->n_sent, ++n_sent);
+        sem_post(&pl->in_flight);
+
+        pl->conn->seq_tx = k;
+        uint64_t t0 = now_ns();
+        if (probe_send(pl->conn, spks_k) != 0) {
+            fprintf(stderr, "probe_send() failed\n");
+            atomic_store(&pl->failed, 1);
+            break;
+        }
+        Histogram_record(pl->hist_send, now_ns() - t0);
+    }
+
+    // Wake receiver once more, so it sees that no more frames are coming
+    sem_post(&pl->in_flight);
+
+    return NULL;
+}
+
+
+// Send frames with several in flight
+int pipeline_run(struct ProbePipeline* pl, struct ProbeConnection* conn, struct SpikeReader* rdr,
+    int window, uint64_t period_ns, struct ResultWriter* wr,
+    struct Histogram* hist_send, struct Histogram* hist_rtt) {
+
+    int n_neurons = conn->n_neurons;
+
+    // Populate fields
+    pl->conn = conn;
+    pl->rdr = rdr;
+    pl->n_pts = rdr->n_pts;
+    pl->wr = wr;
+    pl->hist_send = hist_send;
+    pl->hist_rtt = hist_rtt;
+    pl->window = (window < 1) ? 1 : window;
+    pl->period_ns = period_ns;
+    pl->frames = (struct PipelineFrame *) malloc(pl->window * sizeof(struct PipelineFrame));
+    pl->n_dropped = 0;
+    pl->n_late = 0;
+    pl->n_recv = 0;
+    pl->elapsed_s = 0.0;
+    sem_init(&pl->window_free, 0, pl->window);
+    sem_init(&pl->in_flight, 0, 0);
+    atomic_init(&pl->n_sent, 0);
+    atomic_init(&pl->failed, 0);
+
+    // Buffer for predictions that don't fit in writer's queue
+    double* preds_dropped = (double *) malloc(n_neurons * sizeof(double));
+
+    // Start sender
+    int status = 0;
+    if (pthread_create(&pl->sender, NULL, pipeline_sender_run, pl) != 0) {
+        perror("Could not create sender thread");
+        status = 1;
+        goto cleanup;
+    }
+
+    // Receive predictions on calling thread; the sender posts once per frame
+    // it sends and once more when it is done, so the receiver never blocks
+    // waiting for a frame that was dropped (the last post is the only one
+    // that finds every sent frame already received)
+    uint64_t t_first = 0;
+    while (1) {
+
+        sem_wait_retry(&pl->in_flight);
+        if (atomic_load(&pl->failed)) {
+            status = 1;
+            break;
+        }
+        if (pl->n_recv == atomic_load(&pl->n_sent)) {
+            break;
+        }
+
+        // Receive straight into writer's queue
+        double* preds = ResultWriter_reserve(wr);
+        if (probe_recv(conn, preds ? preds : preds_dropped) != 0) {
+            fprintf(stderr, "probe_recv() failed\n");
+            status = 1;
+            break;
+        }
+        uint64_t t_recv = now_ns();
+
+        // Match prediction to frame by sequence number
+        struct PipelineFrame* frame = &pl->frames[pl->n_recv % pl->window];
+        if (conn->hdr_rx.seq != frame->seq) {
+            fprintf(stderr, "Received predictions for frame %lu while waiting for frame %lu\n",
+                (unsigned long) conn->hdr_rx.seq, (unsigned long) frame->seq);
+            status = 1;
+            break;
+        }
+        uint64_t rtt = t_recv - frame->t_send_ns;
+        if (preds) {
+            ResultWriter_commit(wr, frame->seq, rtt / 1e3);
+        }
+        Histogram_record(hist_rtt, rtt);
+        if (period_ns > 0 && rtt > period_ns) {
+            pl->n_late++;
+        }
+        if (pl->n_recv == 0) {
+            t_first = frame->t_send_ns;
+        }
+        pl->elapsed_s = (t_recv - t_first) / 1e9;
+
+        pl->n_recv++;
+        sem_post(&pl->window_free);
+    }
+
+    // Stop sender if receiving failed, and wait for it to finish
+    if (status != 0) {
+        atomic_store(&pl->failed, 1);
+        sem_post(&pl->window_free);
+    }
+    pthread_join(pl->sender, NULL);
+    if (atomic_load(&pl->failed)) {
+        status = 1;
+    }
+
+cleanup:
+    sem_destroy(&pl->window_free);
+    sem_destroy(&pl->in_flight);
+    free(preds_dropped);
+    free(pl->frames);
+
+    return status;
+}
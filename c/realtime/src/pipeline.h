@@ -0,0 +1,118 @@
+/* Header file for pipelined probe */
+
+
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#include "protocol.h"
+#include "timing.h"
+#include "reader.h"
+#include "writer.h"
+
+
+/* Pipelined probe
+ *
+ * Drives a probe connection with separate sender and receiver threads, so
+ * that up to 'window' frames can be in flight at once. The receiver matches
+ * each prediction to its frame by sequence number (which is the index of the
+ * frame in the signal).
+ *
+ * In closed-loop mode (period of 0), the sender sends frames as long as fewer
+ * than 'window' of them are unanswered. With a window of 1 this behaves like
+ * the lock-step probe; larger windows show how many frames per second the
+ * processor can sustain, and how it behaves when the next frame arrives
+ * before the previous prediction has gone out.
+ *
+ * In open-loop mode, the sender behaves like a real probe: frame k is due at
+ * a fixed time k periods after the start, on an absolute schedule, whether or
+ * not earlier frames have been answered. A frame that is due while 'window'
+ * frames are unanswered is dropped (as by a probe whose buffer is full), so
+ * it never gets a row in the results. Latency is measured from the time each
+ * frame was due rather than the time it went out, so a sender held up by a
+ * slow processor doesn't hide the queueing delay (coordinated omission). A
+ * frame is late if its prediction arrives after the next frame was due.
+ */
+
+// Frame in flight
+struct PipelineFrame {
+
+    // Sequence number of frame
+    uint64_t seq;
+
+    // Time from which latency of frame is measured: time it was due in
+    // open-loop mode, time it was sent in closed-loop mode (nanoseconds,
+    // monotonic clock)
+    uint64_t t_send_ns;
+};
+
+// Pipeline object
+struct ProbePipeline {
+
+    // Connection with processor
+    struct ProbeConnection* conn;
+
+    // Reader supplying spike counts, and number of frames to send
+    struct SpikeReader* rdr;
+    long n_pts;
+
+    // Writer taking predictions and round-trip times
+    struct ResultWriter* wr;
+
+    // Histograms of time spent sending frames (updated by sender) and of
+    // round-trip times (updated by receiver)
+    struct Histogram* hist_send;
+    struct Histogram* hist_rtt;
+
+    // Maximum number of frames in flight
+    int window;
+
+    // Time between frames in open-loop mode (nanoseconds; 0 for closed loop)
+    uint64_t period_ns;
+
+    // Frames in flight, in order of sending ('window' entries, indexed by
+    // number of frames sent; predictions come back in the same order)
+    struct PipelineFrame* frames;
+
+    // Number of frames sent
+    atomic_long n_sent;
+
+    // Free places in window (sender waits on it, receiver posts it), and
+    // frames sent but not yet waited for by the receiver (plus one final post
+    // when the sender is done)
+    sem_t window_free;
+    sem_t in_flight;
+
+    // Set if either thread fails (tells the other one to stop)
+    atomic_int failed;
+
+    // Sender thread
+    pthread_t sender;
+
+    // Number of frames dropped and number of late predictions (open-loop
+    // mode only)
+    long n_dropped;
+    long n_late;
+
+    // Number of predictions received
+    long n_recv;
+
+    // Time from first send to last receive (seconds)
+    double elapsed_s;
+};
+
+// Send every frame of spikes supplied by reader over connection with at most
+// 'window' frames in flight, passing predictions and round-trip times to the
+// writer and recording time spent in probe_send() and round-trip times in the
+// given histograms; if period_ns is nonzero, frames are sent open-loop, one
+// every period_ns nanoseconds; returns 0 on success
+int pipeline_run(struct ProbePipeline* pl, struct ProbeConnection* conn, struct SpikeReader* rdr,
+    int window, uint64_t period_ns, struct ResultWriter* wr,
+    struct Histogram* hist_send, struct Histogram* hist_rtt);
+
+
+#endif
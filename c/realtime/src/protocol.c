@@ -3,19 +3,389 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h> 
+#include <errno.h>
+#include <time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "protocol.h"
+#include "cpu.h"
 
 
 // Code processor sends to probe to acknowledge header
 const int ACK_CODE = 1;
 
 
-// Create TCP connection with processor
-int probe_connect(char* host, int port, int n_neurons, struct ProbeConnection* conn) {
+/* Framing helpers */
+
+// Advance buffers past n bytes that have been transferred
+static void iov_advance(struct iovec** iov, int* iovcnt, size_t n) {
+
+    while (*iovcnt > 0 && n >= (*iov)->iov_len) {
+        n -= (*iov)->iov_len;
+        (*iov)++;
+        (*iovcnt)--;
+    }
+    if (*iovcnt > 0) {
+        (*iov)->iov_base = (char*) (*iov)->iov_base + n;
+        (*iov)->iov_len -= n;
+    }
+}
+
+// Write buffers to socket, calling writev() until every byte has been written
+// (iov is modified; a non-blocking socket is spun on); returns 0 on success
+static int write_exact(int sock, struct iovec* iov, int iovcnt) {
+
+    while (iovcnt > 0) {
+        ssize_t n = writev(sock, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                cpu_relax();
+                continue;
+            }
+            perror("send failed");
+            return 1;
+        }
+        iov_advance(&iov, &iovcnt, n);
+    }
+
+    return 0;
+}
+
+// Fill buffers from socket, calling recvmsg() until every byte has been read
+// (iov is modified; a non-blocking socket is spun on); returns 0 on success,
+// -1 if the peer closed the connection before sending anything, and 1 on
+// error
+static int read_exact(int sock, struct iovec* iov, int iovcnt) {
+
+    size_t n_read = 0;
+    while (iovcnt > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        ssize_t n = recvmsg(sock, &msg, MSG_WAITALL);
+        if (n == 0) {
+            if (n_read == 0) {
+                return -1;
+            }
+            fprintf(stderr, "Connection closed in the middle of a frame\n");
+            return 1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                cpu_relax();
+                continue;
+            }
+            perror("recv failed");
+            return 1;
+        }
+        n_read += n;
+        iov_advance(&iov, &iovcnt, n);
+    }
+
+    return 0;
+}
+
+// Send single int (used for connection header)
+static int send_int(int sock, int val) {
+
+    struct iovec iov = {&val, sizeof(int)};
+    return write_exact(sock, &iov, 1);
+}
+
+// Receive single int (used for connection header)
+static int recv_int(int sock, int* val) {
+
+    struct iovec iov = {val, sizeof(int)};
+    if (read_exact(sock, &iov, 1) != 0) {
+        fprintf(stderr, "Connection header not received\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// Send frames as soon as they are written (each frame is written with a
+// single call, so Nagle's algorithm could only hold a frame back until the
+// peer's delayed ACK arrives, which stalls pipelined and open-loop probes)
+static void set_nodelay(int sock) {
+
+    int one = 1;
+    if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0) {
+        perror("Could not set TCP_NODELAY");
+    }
+}
+
+
+// Current time used for frame timestamps
+uint64_t frame_time_ns(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Fill in header of frame
+void frame_header_init(struct FrameHeader* hdr, uint64_t seq, size_t len) {
+
+    hdr->magic = FRAME_MAGIC;
+    hdr->version = FRAME_VERSION;
+    hdr->flags = 0;
+    hdr->seq = seq;
+    hdr->t_send_ns = frame_time_ns();
+    hdr->payload_len = (uint32_t) len;
+    hdr->reserved = 0;
+}
+
+// Write header and payload of frame to socket in one call
+int frame_write(int sock, const struct FrameHeader* hdr, const void* payload, size_t len) {
+
+    struct iovec iov[2] = {
+        {(void*) hdr, sizeof(struct FrameHeader)},
+        {(void*) payload, len}
+    };
+    return write_exact(sock, iov, 2);
+}
+
+// Read header and shortest payload of frame from socket in one call, and
+// rest of payload in another if frame is longer
+int frame_read(int sock, struct FrameHeader* hdr, void* payload, size_t min_len, size_t max_len) {
+
+    struct iovec iov[2] = {
+        {hdr, sizeof(struct FrameHeader)},
+        {payload, min_len}
+    };
+    int status = read_exact(sock, iov, 2);
+    if (status != 0) {
+        return status;
+    }
+    if (frame_check(hdr, min_len, max_len) != 0) {
+        return 1;
+    }
+
+    if (hdr->payload_len > min_len) {
+        struct iovec rest = {(char*) payload + min_len, hdr->payload_len - min_len};
+        if (read_exact(sock, &rest, 1) != 0) {
+            fprintf(stderr, "Connection closed in the middle of a frame\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Check that header is valid
+int frame_check(const struct FrameHeader* hdr, size_t min_len, size_t max_len) {
+
+    if (hdr->magic != FRAME_MAGIC) {
+        fprintf(stderr, "Bad frame magic number 0x%08x\n", hdr->magic);
+        return 1;
+    }
+    if (hdr->version != FRAME_VERSION) {
+        fprintf(stderr, "Unsupported frame version %d\n", hdr->version);
+        return 1;
+    }
+    if (hdr->payload_len < min_len || hdr->payload_len > max_len) {
+        if (min_len == max_len) {
+            fprintf(stderr, "Frame payload is %u bytes, expected %zu\n", hdr->payload_len, min_len);
+        }
+        else {
+            fprintf(stderr, "Frame payload is %u bytes, expected %zu to %zu\n",
+                hdr->payload_len, min_len, max_len);
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// Names of encodings (indexed by enum WireEncoding)
+static const char* ENCODING_NAMES[] = {"int32", "uint8", "sparse"};
+
+// Look up encoding by name
+int encoding_parse(const char* name, enum WireEncoding* encoding) {
+
+    for (int i = 0; i < N_ENCODINGS; i++) {
+        if (strcmp(name, ENCODING_NAMES[i]) == 0) {
+            *encoding = (enum WireEncoding) i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Name of encoding
+const char* encoding_name(enum WireEncoding encoding) {
+
+    return ENCODING_NAMES[encoding];
+}
+
+// Encode spike counts
+size_t spikes_encode(enum WireEncoding encoding, const int* spks, int n, void* buf, uint16_t* flags) {
+
+    // Find which encodings can hold frame
+    int n_nz = 0;
+    int max_count = 0;
+    int negative = 0;
+    if (encoding != ENCODING_INT32) {
+        for (int i = 0; i < n; i++) {
+            n_nz += (spks[i] != 0);
+            max_count = (spks[i] > max_count) ? spks[i] : max_count;
+            negative |= (spks[i] < 0);
+        }
+    }
+    int fits_uint8 = !negative && max_count <= UINT8_MAX;
+    int fits_sparse = !negative && max_count <= UINT16_MAX;
+
+    // Sparse, unless a dense encoding is shorter
+    size_t len_sparse = n_nz * sizeof(struct SparseSpike);
+    if (encoding == ENCODING_SPARSE && fits_sparse
+            && len_sparse < (fits_uint8 ? n * sizeof(uint8_t) : n * sizeof(int))) {
+        struct SparseSpike* out = (struct SparseSpike*) buf;
+        int k = 0;
+        for (int i = 0; i < n; i++) {
+            if (spks[i] != 0) {
+                out[k].idx = (uint16_t) i;
+                out[k].count = (uint16_t) spks[i];
+                k++;
+            }
+        }
+        *flags = ENCODING_SPARSE;
+        return len_sparse;
+    }
+
+    // One byte per count
+    if (encoding != ENCODING_INT32 && fits_uint8) {
+        uint8_t* out = (uint8_t*) buf;
+        for (int i = 0; i < n; i++) {
+            out[i] = (uint8_t) spks[i];
+        }
+        *flags = ENCODING_UINT8;
+        return n * sizeof(uint8_t);
+    }
+
+    memcpy(buf, spks, n * sizeof(int));
+    *flags = ENCODING_INT32;
+    return n * sizeof(int);
+}
+
+// Decode spike counts
+int spikes_decode(uint16_t flags, const void* payload, size_t len, int n, int* spks) {
+
+    switch (flags & FRAME_ENCODING_MASK) {
+        case ENCODING_INT32:
+            if (len != n * sizeof(int)) {
+                break;
+            }
+            memcpy(spks, payload, len);
+            return 0;
+        case ENCODING_UINT8:
+            if (len != n * sizeof(uint8_t)) {
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                spks[i] = ((const uint8_t*) payload)[i];
+            }
+            return 0;
+        case ENCODING_SPARSE:
+            if (len % sizeof(struct SparseSpike) != 0) {
+                break;
+            }
+            memset(spks, 0, n * sizeof(int));
+            for (size_t k = 0; k < len / sizeof(struct SparseSpike); k++) {
+                const struct SparseSpike* e = (const struct SparseSpike*) payload + k;
+                if (e->idx >= n) {
+                    fprintf(stderr, "Sparse frame has index %d out of range\n", e->idx);
+                    return 1;
+                }
+                spks[e->idx] = e->count;
+            }
+            return 0;
+    }
+
+    fprintf(stderr, "Bad %u-byte payload in encoding %d\n", (unsigned) len, flags & FRAME_ENCODING_MASK);
+    return 1;
+}
+
+// Shortest payload of spike frame
+size_t spikes_min_len(enum WireEncoding encoding, int n) {
+
+    switch (encoding) {
+        case ENCODING_UINT8:
+            return n * sizeof(uint8_t);
+        case ENCODING_SPARSE:
+            return 0;
+        default:
+            return n * sizeof(int);
+    }
+}
+
+
+// Read a frame from a shared-memory channel (slots are copied whole, so the
+// payload buffer must have room for max_len bytes)
+static int shm_read_frame(struct ShmChannel* shm, struct FrameHeader* hdr, void* payload,
+    size_t min_len, size_t max_len) {
+
+    struct iovec iov[2] = {
+        {hdr, sizeof(struct FrameHeader)},
+        {payload, max_len}
+    };
+    if (shm_recv(shm, iov, 2) != 0) {
+        return -1;
+    }
+
+    return frame_check(hdr, min_len, max_len);
+}
+
+// Write a frame to a shared-memory channel
+static int shm_write_frame(struct ShmChannel* shm, const struct FrameHeader* hdr, const void* payload, size_t len) {
+
+    struct iovec iov[2] = {
+        {(void*) hdr, sizeof(struct FrameHeader)},
+        {(void*) payload, len}
+    };
+    return shm_send(shm, iov, 2);
+}
+
+
+// Look up transport by name
+int transport_parse(const char* name, enum Transport* transport) {
+
+    if (strcmp(name, "tcp") == 0) {
+        *transport = TRANSPORT_TCP;
+    }
+    else if (strcmp(name, "shm") == 0) {
+        *transport = TRANSPORT_SHM;
+    }
+    else if (strcmp(name, "shm-poll") == 0) {
+        *transport = TRANSPORT_SHM_POLL;
+    }
+    else {
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// Create TCP connection with processor and exchange header (for a shard,
+// rows is [row_begin, row_end), and NULL otherwise)
+static int probe_connect_tcp(char* host, int port, int n_neurons, const int* rows, enum WireEncoding encoding,
+    struct ProbeConnection* conn) {
 
 	// Create socket
   	int sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -31,63 +401,167 @@ int probe_connect(char* host, int port, int n_neurons, struct ProbeConnection* c
   	server.sin_port = htons(port);
   	if (connect(sock, (struct sockaddr *)&server, sizeof(server)) < 0) {
     	perror("Cannot connect to processor");
+        close(sock);
     	return 1;
   	}
 
-    // Send header
-    if (send(sock, &n_neurons, sizeof(int), 0) < 0) {
-        perror("Send failed");
+    set_nodelay(sock);
+
+    // Send header (number of neurons and encoding asked for, followed by rows
+    // asked for if connecting to a shard)
+    if (send_int(sock, n_neurons) != 0 || send_int(sock, encoding) != 0) {
+        close(sock);
+        return 1;
+    }
+    if (rows != NULL && (send_int(sock, rows[0]) != 0 || send_int(sock, rows[1]) != 0)) {
+        close(sock);
         return 1;
     }
 
-    // Receive ACK
+    // Receive ACK and encoding accepted
     int hdr_resp;
-    if (recv(sock, &hdr_resp, sizeof(int), 0) < 0) {
-        perror("recv failed");
+    int encoding_resp;
+    if (recv_int(sock, &hdr_resp) != 0) {
+        close(sock);
         return 1;
     }
     if (hdr_resp != ACK_CODE) {
-        perror("Response to header not ACK");
+        fprintf(stderr, "Response to header not ACK (%d)\n", hdr_resp);
+        close(sock);
+        return 1;
+    }
+    if (recv_int(sock, &encoding_resp) != 0) {
+        close(sock);
+        return 1;
+    }
+    if (encoding_resp < 0 || encoding_resp >= N_ENCODINGS) {
+        fprintf(stderr, "Processor accepted unknown encoding %d\n", encoding_resp);
+        close(sock);
         return 1;
     }
 
     // Populate struct
     conn->host = host;
     conn->port = port;
+    conn->transport = TRANSPORT_TCP;
     conn->sock_id = sock;
     conn->n_neurons = n_neurons;
+    conn->n_preds = (rows != NULL) ? rows[1] - rows[0] : n_neurons;
+    conn->encoding = (enum WireEncoding) encoding_resp;
+    conn->tx_buf = (char *) malloc(n_neurons * sizeof(int));
+    conn->seq_tx = 0;
+    conn->n_payload_bytes = 0;
+    memset(&conn->hdr_rx, 0, sizeof(conn->hdr_rx));
     conn->is_connected = 1;
 
     return 0;
 }
 
+// Create TCP connection with processor
+int probe_connect(char* host, int port, int n_neurons, enum Transport transport, enum WireEncoding encoding,
+    struct ProbeConnection* conn) {
+
+    // Set up shared-memory channel instead of socket if requested (processor
+    // learns number of neurons from segment header)
+    if (transport != TRANSPORT_TCP) {
+        if (shm_create(port, n_neurons,
+                sizeof(struct FrameHeader) + n_neurons * sizeof(int),
+                sizeof(struct FrameHeader) + n_neurons * sizeof(double),
+                transport == TRANSPORT_SHM_POLL, &conn->shm) != 0) {
+            return 1;
+        }
+        conn->host = host;
+        conn->port = port;
+        conn->transport = transport;
+        conn->sock_id = -1;
+        conn->n_neurons = n_neurons;
+        conn->n_preds = n_neurons;
+        conn->encoding = ENCODING_INT32;
+        conn->tx_buf = NULL;
+        conn->seq_tx = 0;
+        conn->n_payload_bytes = 0;
+        memset(&conn->hdr_rx, 0, sizeof(conn->hdr_rx));
+        conn->is_connected = 1;
+        return 0;
+    }
+
+    return probe_connect_tcp(host, port, n_neurons, NULL, encoding, conn);
+}
+
+
+// Connect to shard as its coordinator
+int probe_connect_shard(char* host, int port, int n_neurons, int row_begin, int row_end,
+    enum WireEncoding encoding, struct ProbeConnection* conn) {
+
+    int rows[2] = {row_begin, row_end};
+    return probe_connect_tcp(host, port, n_neurons, rows, encoding, conn);
+}
+
+
 // Close TCP connection with processor
 int probe_disconnect(struct ProbeConnection* conn) {
 
+    if (conn->transport != TRANSPORT_TCP) {
+        shm_close(&conn->shm);
+        return 0;
+    }
+
     close(conn->sock_id);
+    free(conn->tx_buf);
     return 0;
 }
 
 // Send spikes across socket
 int probe_send(struct ProbeConnection* conn, int* spks) {
-    
-    if (send(conn->sock_id, spks, conn->n_neurons * sizeof(int), 0) < 0) {
-        perror("send failed");
+
+    // Encode spikes unless they are sent as they are
+    const void* payload = spks;
+    size_t len = conn->n_neurons * sizeof(int);
+    uint16_t flags = ENCODING_INT32;
+    if (conn->encoding != ENCODING_INT32) {
+        len = spikes_encode(conn->encoding, spks, conn->n_neurons, conn->tx_buf, &flags);
+        payload = conn->tx_buf;
+    }
+    struct FrameHeader hdr;
+    frame_header_init(&hdr, conn->seq_tx, len);
+    hdr.flags = flags;
+
+    int status;
+    if (conn->transport != TRANSPORT_TCP) {
+        status = shm_write_frame(&conn->shm, &hdr, payload, len);
+    }
+    else {
+        status = frame_write(conn->sock_id, &hdr, payload, len);
+    }
+    if (status != 0) {
         return 1;
     }
 
+    conn->seq_tx++;
+    conn->n_payload_bytes += len;
     return 0;
 }
 
 // Receive filter predictions from socket
 int probe_recv(struct ProbeConnection* conn, double* fpreds) {
-    
-    if (recv(conn->sock_id, fpreds, conn->n_neurons * sizeof(double), 0) < 0) {
-        perror("recv failed");
+
+    size_t len = conn->n_preds * sizeof(double);
+    int status;
+    if (conn->transport != TRANSPORT_TCP) {
+        status = shm_read_frame(&conn->shm, &conn->hdr_rx, fpreds, len, len);
+    }
+    else {
+        status = frame_read(conn->sock_id, &conn->hdr_rx, fpreds, len, len);
+    }
+
+    // Processor never closes connection first
+    if (status < 0) {
+        fprintf(stderr, "Processor closed connection\n");
+        conn->is_connected = 0;
         return 1;
     }
 
-    return 0;
+    return status;
 }
 
 
@@ -97,8 +571,8 @@ int probe_recv(struct ProbeConnection* conn, double* fpreds) {
  * using a ProcessorConnection object.
  */
 
-// Connect to probe
-int processor_connect(char* host, int port, struct ProcessorConnection* conn) {
+// Create socket listening for probes
+int processor_listen(int port, int* sock_listen) {
 
     // Create socket
     int sock_desc = socket(AF_INET, SOCK_STREAM, 0);
@@ -114,75 +588,227 @@ int processor_connect(char* host, int port, struct ProcessorConnection* conn) {
     server.sin_port = htons(port);
     if (bind(sock_desc, (struct sockaddr*)&server, sizeof(server)) < 0) {
         perror("bind failed");
+        close(sock_desc);
         return 1;
     }
   
     // Listen to the socket
     listen(sock_desc, 3);
-  
+
+    *sock_listen = sock_desc;
+    return 0;
+}
+
+// Accept connection on listening socket and exchange header (shard is 1 if
+// the header must ask for rows, as sent by a coordinator)
+static int accept_header(int sock_listen, char* host, int port, int shard, struct ProcessorConnection* conn) {
+
     // Accept connection from incoming client
     struct sockaddr_in client; 
     int c = sizeof(struct sockaddr_in);
-    int sock_client = accept(sock_desc, (struct sockaddr*)&client, (socklen_t*)&c);
+    int sock_client = accept(sock_listen, (struct sockaddr*)&client, (socklen_t*)&c);
     if (sock_client < 0) {
         perror("accept failed");
         return 1;
     }
 
+    set_nodelay(sock_client);
+
     // Receive header
     int n_neurons;
-    if (recv(sock_client, &n_neurons, sizeof(int), 0) < 0) {
-        perror("recv failed");
+    int encoding;
+    if (recv_int(sock_client, &n_neurons) != 0 || recv_int(sock_client, &encoding) != 0) {
+        close(sock_client);
         return 1;
     }
 
-    // Send ACK
-    if (send(sock_client, &ACK_CODE, sizeof(int), 0) < 0) {
-        perror("Send failed");
+    // Receive rows asked for by coordinator
+    int row_begin = 0;
+    int row_end = n_neurons;
+    if (shard) {
+        if (recv_int(sock_client, &row_begin) != 0 || recv_int(sock_client, &row_end) != 0) {
+            close(sock_client);
+            return 1;
+        }
+        if (row_begin < 0 || row_end > n_neurons || row_begin >= row_end) {
+            fprintf(stderr, "Coordinator asked for rows [%d, %d) of %d\n", row_begin, row_end, n_neurons);
+            close(sock_client);
+            return 1;
+        }
+    }
+
+    // Accept encoding asked for if it can be used (sparse indices are 16 bits)
+    if (encoding < 0 || encoding >= N_ENCODINGS) {
+        encoding = ENCODING_INT32;
+    }
+    if (encoding == ENCODING_SPARSE && n_neurons > SPARSE_MAX_NEURONS) {
+        encoding = ENCODING_UINT8;
+    }
+
+    // Send ACK and encoding accepted
+    if (send_int(sock_client, ACK_CODE) != 0 || send_int(sock_client, encoding) != 0) {
+        close(sock_client);
         return 1;
     }
 
-    // Populate struct
+    // Populate struct (listening socket is owned by caller)
     conn->host = host;
     conn->port = port;
-    conn->sock_desc_id = sock_desc;
+    conn->sock_desc_id = -1;
     conn->sock_client_id = sock_client;
+    conn->transport = TRANSPORT_TCP;
     conn->n_neurons = n_neurons;
+    conn->row_begin = row_begin;
+    conn->n_preds = row_end - row_begin;
+    conn->encoding = (enum WireEncoding) encoding;
+    conn->rx_buf = (char *) malloc(n_neurons * sizeof(int));
+    memset(&conn->hdr_rx, 0, sizeof(conn->hdr_rx));
     conn->is_connected = 1;
 
     return 0;
 }
 
+// Accept connection from probe on listening socket and exchange header
+int processor_accept(int sock_listen, char* host, int port, struct ProcessorConnection* conn) {
+
+    return accept_header(sock_listen, host, port, 0, conn);
+}
+
+
+// Listen on port and accept one connection (see accept_header())
+static int listen_accept(char* host, int port, int shard, struct ProcessorConnection* conn) {
+
+    int sock_desc;
+    if (processor_listen(port, &sock_desc) != 0) {
+        return 1;
+    }
+
+    // Stop listening once the connection is accepted (or failed), so later
+    // clients are refused instead of waiting in the backlog
+    int ret = accept_header(sock_desc, host, port, shard, conn);
+    close(sock_desc);
+
+    return ret;
+}
+
+
+// Connect to probe
+int processor_connect(char* host, int port, enum Transport transport, struct ProcessorConnection* conn) {
+
+    // Attach to shared-memory channel instead of listening if requested
+    if (transport != TRANSPORT_TCP) {
+        if (shm_attach(port, transport == TRANSPORT_SHM_POLL, &conn->shm) != 0) {
+            return 1;
+        }
+        conn->host = host;
+        conn->port = port;
+        conn->sock_desc_id = -1;
+        conn->sock_client_id = -1;
+        conn->transport = transport;
+        conn->n_neurons = conn->shm.hdr->n_neurons;
+        conn->row_begin = 0;
+        conn->n_preds = conn->n_neurons;
+        conn->encoding = ENCODING_INT32;
+        conn->rx_buf = NULL;
+        memset(&conn->hdr_rx, 0, sizeof(conn->hdr_rx));
+        conn->is_connected = 1;
+        return 0;
+    }
+
+    return listen_accept(host, port, 0, conn);
+}
+
+
+// Wait for coordinator and exchange shard header
+int processor_connect_shard(char* host, int port, struct ProcessorConnection* conn) {
+
+    return listen_accept(host, port, 1, conn);
+}
+
 int processor_disconnect(struct ProcessorConnection* conn) {
 
-    close(conn->sock_desc_id);
+    if (conn->transport != TRANSPORT_TCP) {
+        shm_close(&conn->shm);
+        return 0;
+    }
+
+    if (conn->sock_desc_id >= 0) {
+        close(conn->sock_desc_id);
+    }
     close(conn->sock_client_id);
+    free(conn->rx_buf);
 
     return 0;
 }
 
 
 int processor_send(struct ProcessorConnection* conn, double* fpreds) {
-    
-    if (send(conn->sock_client_id, fpreds, conn->n_neurons * sizeof(double), 0) < 0) {
-        perror("send failed");
-        return 1;
+
+    return processor_send_seq(conn, conn->hdr_rx.seq, fpreds);
+}
+
+
+int processor_send_seq(struct ProcessorConnection* conn, uint64_t seq, double* fpreds) {
+
+    size_t len = conn->n_preds * sizeof(double);
+    struct FrameHeader hdr;
+    frame_header_init(&hdr, seq, len);
+
+    if (conn->transport != TRANSPORT_TCP) {
+        return shm_write_frame(&conn->shm, &hdr, fpreds, len);
     }
-    
-    return 0;
+
+    return frame_write(conn->sock_client_id, &hdr, fpreds, len);
 }
 
 
 int processor_recv(struct ProcessorConnection* conn, int* spks) {
-    
-    int read_size = recv(conn->sock_client_id, spks, conn->n_neurons * sizeof(int), 0);
-    if (read_size == 0) {
+
+    // Read int32 frames straight into spikes, and other encodings into buffer
+    // to be decoded
+    size_t max_len = conn->n_neurons * sizeof(int);
+    size_t min_len = spikes_min_len(conn->encoding, conn->n_neurons);
+    void* payload = (conn->encoding == ENCODING_INT32) ? (void*) spks : (void*) conn->rx_buf;
+    int status;
+    if (conn->transport != TRANSPORT_TCP) {
+        status = shm_read_frame(&conn->shm, &conn->hdr_rx, payload, min_len, max_len);
+    }
+    else {
+        status = frame_read(conn->sock_client_id, &conn->hdr_rx, payload, min_len, max_len);
+    }
+
+    // Probe closing connection between frames is the normal end of a session
+    if (status < 0) {
         conn->is_connected = 0;
+        return 0;
     }
-    else if (read_size == -1) {
-        perror("recv failed");
-        return 1;
+    if (status != 0) {
+        return status;
     }
 
-    return 0;
+    if (conn->encoding == ENCODING_INT32) {
+        if ((conn->hdr_rx.flags & FRAME_ENCODING_MASK) != ENCODING_INT32) {
+            fprintf(stderr, "Frame not in negotiated int32 encoding\n");
+            return 1;
+        }
+        return 0;
+    }
+    return spikes_decode(conn->hdr_rx.flags, conn->rx_buf, conn->hdr_rx.payload_len, conn->n_neurons, spks);
+}
+
+
+int processor_pending(struct ProcessorConnection* conn) {
+
+    if (conn->transport != TRANSPORT_TCP) {
+        return (int) shm_pending(&conn->shm);
+    }
+
+    // Count bytes as frames of the longest kind, so that a frame counted is
+    // always complete (reading a frame that the probe hasn't finished sending
+    // could wait for a reply the probe is itself waiting for)
+    int n_bytes;
+    if (ioctl(conn->sock_client_id, FIONREAD, &n_bytes) != 0) {
+        return 0;
+    }
+    return n_bytes / (int) (sizeof(struct FrameHeader) + conn->n_neurons * sizeof(int));
 }
@@ -3,6 +3,154 @@
 #ifndef _PROTOCOL_H
 #define _PROTOCOL_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shm.h"
+
+
+/* Transports
+ *
+ * Frames travel over TCP by default. When probe and processor run on the
+ * same machine, they can use a shared-memory channel instead (see shm.h),
+ * either waiting adaptively ('shm') or busy polling ('shm-poll'). Both sides
+ * must use the same transport; the host address is ignored for shared memory.
+ */
+enum Transport {
+    TRANSPORT_TCP,
+    TRANSPORT_SHM,
+    TRANSPORT_SHM_POLL
+};
+
+// Look up transport by name ('tcp', 'shm', 'shm-poll'); returns 0 on success
+// and 1 if name is not recognized
+int transport_parse(const char* name, enum Transport* transport);
+
+
+/* Framing
+ *
+ * After the connection header, every frame in either direction is a fixed
+ * FrameHeader followed by payload_len bytes of payload (spike counts from
+ * probe to processor, predictions from processor to probe). The probe numbers
+ * its frames from 0, and the processor echoes the number of the frame it is
+ * answering, so predictions can be matched to their inputs even when several
+ * frames are in flight. Each side stamps the time it sent the frame, which
+ * gives the one-way delay when the clocks of both machines are synchronized.
+ * Fields are in host byte order (probe and processor are assumed to share it).
+ *
+ * Frames are written with a single writev() call covering header and
+ * payload, and read with recvmsg() into both at once; both calls are repeated
+ * until the whole frame has been transferred, so short reads and writes under
+ * load can't corrupt the stream. When the payload length varies (see
+ * encodings below), the reader asks for the header and the shortest possible
+ * payload in one call, and for the rest of the payload in a second call only
+ * if the frame is longer.
+ */
+
+// Magic number ('RTF1') and version at start of every frame
+#define FRAME_MAGIC 0x31465452
+#define FRAME_VERSION 2
+
+// Header of frame
+struct FrameHeader {
+
+    // FRAME_MAGIC and FRAME_VERSION
+    uint32_t magic;
+    uint16_t version;
+
+    // Flags (encoding of payload in bits FRAME_ENCODING_MASK, for spike
+    // frames; 0 otherwise)
+    uint16_t flags;
+
+    // Sequence number of frame (for replies, of the frame being answered)
+    uint64_t seq;
+
+    // Time at which frame was sent (nanoseconds since Unix epoch)
+    uint64_t t_send_ns;
+
+    // Number of bytes of payload following header
+    uint32_t payload_len;
+
+    // Padding (0)
+    uint32_t reserved;
+};
+
+// Current time used for frame timestamps (nanoseconds since Unix epoch)
+uint64_t frame_time_ns(void);
+
+// Fill in header of frame with given sequence number and len bytes of
+// payload, stamping it with the current time
+void frame_header_init(struct FrameHeader* hdr, uint64_t seq, size_t len);
+
+// Write header and payload of frame to socket; returns 0 on success
+int frame_write(int sock, const struct FrameHeader* hdr, const void* payload, size_t len);
+
+// Read frame with between min_len and max_len bytes of payload from socket
+// into hdr and payload; returns 0 on success, -1 if the peer closed the
+// connection before the first byte of the frame, and 1 on error
+int frame_read(int sock, struct FrameHeader* hdr, void* payload, size_t min_len, size_t max_len);
+
+// Check that header is valid and announces between min_len and max_len bytes
+// of payload; returns 0 if it does
+int frame_check(const struct FrameHeader* hdr, size_t min_len, size_t max_len);
+
+
+/* Encodings of spike counts
+ *
+ * Spike counts are small and mostly zero, so sending them as int32 wastes
+ * most of the bandwidth. The probe asks for an encoding in the connection
+ * header and the processor answers with the one it accepts:
+ *
+ *   int32   n_neurons 4-byte counts
+ *   uint8   n_neurons 1-byte counts
+ *   sparse  one SparseSpike (2-byte index, 2-byte count) per nonzero count
+ *
+ * The negotiated encoding is the one the probe prefers, but each frame is
+ * sent in whichever encoding can hold it, and its header's flags say which:
+ * a frame with a count over 255 falls back from uint8 to int32, and a dense
+ * frame falls back from sparse to uint8 (or int32) when that is shorter. The
+ * payload is never longer than in int32. Frames over shared memory always use
+ * int32.
+ */
+enum WireEncoding {
+    ENCODING_INT32,
+    ENCODING_UINT8,
+    ENCODING_SPARSE,
+    N_ENCODINGS
+};
+
+// Bits of FrameHeader.flags holding encoding of payload
+#define FRAME_ENCODING_MASK 0x3
+
+// Largest number of neurons that sparse encoding can index
+#define SPARSE_MAX_NEURONS 65536
+
+// Nonzero spike count in sparse encoding
+struct SparseSpike {
+    uint16_t idx;
+    uint16_t count;
+};
+
+// Look up encoding by name ('int32', 'uint8', 'sparse'); returns 0 on success
+// and 1 if name is not recognized
+int encoding_parse(const char* name, enum WireEncoding* encoding);
+
+// Name of encoding
+const char* encoding_name(enum WireEncoding encoding);
+
+// Encode n spike counts into buf (n * sizeof(int) bytes), using preferred
+// encoding if it can hold them; sets flags of frame, and returns length of
+// payload
+size_t spikes_encode(enum WireEncoding encoding, const int* spks, int n, void* buf, uint16_t* flags);
+
+// Decode payload of len bytes, in encoding given by flags, into n spike
+// counts; returns 0 on success and 1 if payload is malformed
+int spikes_decode(uint16_t flags, const void* payload, size_t len, int n, int* spks);
+
+// Shortest payload of n spike counts that a frame can have when encoding was
+// negotiated
+size_t spikes_min_len(enum WireEncoding encoding, int n);
+
 
 /* Connection interface for 'probe'
  *
@@ -10,7 +158,8 @@
  * 'processor' mode by creating a ProbeConnection struct and calling 
  * probe_connect() to populate its members. This struct allows it to use the
  * probe_send() and probe_receive() functions, and can be closed using the
- * probe_disconnect() function.
+ * probe_disconnect() function. One thread may send while another receives on
+ * the same connection.
  */
 
 // Connection object for 'probe' mode
@@ -22,29 +171,64 @@ struct ProbeConnection {
     // Port
     int port;
 
-    // Socket ID
+    // Transport used by connection
+    enum Transport transport;
+
+    // Socket ID (TCP only)
     int sock_id;
+
+    // Shared-memory channel (shared-memory transports only)
+    struct ShmChannel shm;
     
     // Number of neurons whose data is being sent across the connection (this
     // is the length of the spike and filter prediction vectors)
     int n_neurons;
 
+    // Number of predictions in each reply (n_neurons, or number of rows owned
+    // by a shard)
+    int n_preds;
+
+    // Encoding of spike counts negotiated with processor, and buffer frames
+    // are encoded into
+    enum WireEncoding encoding;
+    char* tx_buf;
+
+    // Sequence number of next frame to send
+    uint64_t seq_tx;
+
+    // Bytes of spike payload sent so far
+    uint64_t n_payload_bytes;
+
+    // Header of last frame received (its sequence number says which spike
+    // frame the last predictions answer)
+    struct FrameHeader hdr_rx;
+
     // Connection status (0 for disconnected, 1 for connected)
     int is_connected;
 };
 
-// Connect to processor ('constructor' function for ProbeConnection)
-int probe_connect(char* host, int port, int n_neurons, struct ProbeConnection* conn);
+// Connect to processor, asking for spikes to be sent in given encoding
+// ('constructor' function for ProbeConnection; conn->encoding holds the
+// encoding the processor accepted)
+int probe_connect(char* host, int port, int n_neurons, enum Transport transport, enum WireEncoding encoding,
+    struct ProbeConnection* conn);
 
 // Disconnect from processor ('destructor' function for ProbeConnection)
 int probe_disconnect(struct ProbeConnection* conn);
 
-// Send array of spikes to processor
+// Send array of spikes to processor as next frame
 int probe_send(struct ProbeConnection* conn, int* spks);
 
-// Receive array of filter predictions from processor
+// Receive array of filter predictions from processor (conn->hdr_rx.seq
+// tells which frame they answer)
 int probe_recv(struct ProbeConnection* conn, double* fpreds);
 
+// Connect to shard (over TCP) as its coordinator, asking it to predict rows
+// [row_begin, row_end) of n_neurons; replies then hold row_end - row_begin
+// predictions ('constructor' function for ProbeConnection)
+int probe_connect_shard(char* host, int port, int n_neurons, int row_begin, int row_end,
+    enum WireEncoding encoding, struct ProbeConnection* conn);
+
 
 /* Connection interface for 'processor'
  *
@@ -64,30 +248,73 @@ struct ProcessorConnection {
     // Port
     int port;
 
-    // Socket ID used to listen for incoming connections
+    // Socket ID used to listen for incoming connections (-1 if the listening
+    // socket is not owned by this connection, e.g. because it was closed once
+    // the connection was accepted, or belongs to a server)
     int sock_desc_id;
 
     // Socket ID for connection with probe
     int sock_client_id;
 
+    // Transport used by connection
+    enum Transport transport;
+
+    // Shared-memory channel (shared-memory transports only)
+    struct ShmChannel shm;
+
     // Number of neurons whose data is being sent across the connection (this
     // is the length of the spike and filter prediction vectors)
     int n_neurons;
 
+    // Rows predicted in replies (first row, and number of rows; all n_neurons
+    // rows unless connected to a coordinator as a shard)
+    int row_begin;
+    int n_preds;
+
+    // Encoding of spike counts negotiated with probe, and buffer payloads are
+    // received into before being decoded
+    enum WireEncoding encoding;
+    char* rx_buf;
+
+    // Header of last frame received (processor_send() answers this frame)
+    struct FrameHeader hdr_rx;
+
     // Connection status (0 for disconnected, 1 for connected)
     int is_connected;
 };
 
 // Connect to probe ('constructor' function for ProcessorConnection)
-int processor_connect(char* host, int port, struct ProcessorConnection* conn);
+int processor_connect(char* host, int port, enum Transport transport, struct ProcessorConnection* conn);
+
+// Create socket listening for probes on port (used with processor_accept()
+// by processors that serve more than one probe)
+int processor_listen(int port, int* sock_listen);
+
+// Accept connection from probe on a socket created by processor_listen() and
+// exchange header ('constructor' function for ProcessorConnection; the
+// listening socket stays open)
+int processor_accept(int sock_listen, char* host, int port, struct ProcessorConnection* conn);
+
+// Wait for coordinator on port and exchange shard header, which adds the rows
+// this shard predicts to the probe's header; shards only accept coordinators
+// ('constructor' function for ProcessorConnection)
+int processor_connect_shard(char* host, int port, struct ProcessorConnection* conn);
 
 // Disconnect from probe('destructor' function for ProcessorConnection)
 int processor_disconnect(struct ProcessorConnection* conn);
 
-// Send array of filter predictions to probe
+// Send array of filter predictions to probe, answering last frame received
 int processor_send(struct ProcessorConnection* conn, double* fpreds);
+
+// Send array of filter predictions to probe, answering frame seq (for
+// processors that receive several frames before answering them)
+int processor_send_seq(struct ProcessorConnection* conn, uint64_t seq, double* fpreds);
     
 // Receive array of spikes from probe
 int processor_recv(struct ProcessorConnection* conn, int* spks);
 
+// Number of frames from probe that have fully arrived and wait to be received
+// (a lower bound for TCP when frames vary in length)
+int processor_pending(struct ProcessorConnection* conn);
+
 #endif
@@ -0,0 +1,218 @@
+/* Streaming spike reader */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "reader.h"
+
+
+// Target size of a chunk (bytes)
+#define READER_CHUNK_BYTES (4 << 20)
+
+
+pthread_mutex_t hdf5_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// Read time points [row0, row0 + rows) into buffer; returns 0 on success
+static int reader_read_chunk(struct SpikeReader* rdr, int* buf, long row0, int rows) {
+
+    hsize_t start[2] = {(hsize_t) row0, 0};
+    hsize_t count[2] = {(hsize_t) rows, (hsize_t) rdr->n_neurons};
+
+    pthread_mutex_lock(&hdf5_lock);
+    hid_t mspace = H5Screate_simple(2, count, NULL);
+    H5Sselect_hyperslab(rdr->dspace, H5S_SELECT_SET, start, NULL, count, NULL);
+    herr_t status = H5Dread(rdr->dset, H5T_NATIVE_INT, mspace, rdr->dspace, H5P_DEFAULT, buf);
+    H5Sclose(mspace);
+    pthread_mutex_unlock(&hdf5_lock);
+
+    if (status < 0) {
+        fprintf(stderr, "Failed to read input data\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+// Main loop of background thread
+static void* reader_run(void* arg) {
+
+    struct SpikeReader* rdr = (struct SpikeReader*) arg;
+
+    for (long c = 0; ; c++) {
+
+        // Wait for buffer to be released by consumer
+        int b = c % 2;
+        pthread_mutex_lock(&rdr->lock);
+        while (rdr->state[b] == READER_BUFFER_FULL && !rdr->stop) {
+            pthread_cond_wait(&rdr->cond, &rdr->lock);
+        }
+        int stop = rdr->stop;
+        pthread_mutex_unlock(&rdr->lock);
+        if (stop) {
+            break;
+        }
+
+        // Read chunk (an empty chunk marks the end)
+        long row0 = c * rdr->chunk_rows;
+        int rows = (row0 < rdr->n_pts) ? rdr->chunk_rows : 0;
+        if (row0 + rows > rdr->n_pts) {
+            rows = (int) (rdr->n_pts - row0);
+        }
+        int error = 0;
+        if (rows > 0 && reader_read_chunk(rdr, rdr->bufs[b], row0, rows) != 0) {
+            error = 1;
+            rows = 0;
+        }
+
+        // Hand chunk to consumer
+        pthread_mutex_lock(&rdr->lock);
+        rdr->rows_in[b] = rows;
+        rdr->state[b] = READER_BUFFER_FULL;
+        rdr->error = error;
+        pthread_cond_broadcast(&rdr->cond);
+        pthread_mutex_unlock(&rdr->lock);
+        if (rows == 0) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+
+// Open recording and start reading ahead
+int SpikeReader_open(struct SpikeReader* rdr, const char* path, long max_pts) {
+
+    // Open dataset
+    rdr->file = H5Fopen(path, H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (rdr->file < 0) {
+        fprintf(stderr, "Cannot open '%s'\n", path);
+        return 1;
+    }
+    rdr->dset = H5Dopen(rdr->file, "spks", H5P_DEFAULT);
+    if (rdr->dset < 0) {
+        fprintf(stderr, "No 'spks' dataset in '%s'\n", path);
+        H5Fclose(rdr->file);
+        return 1;
+    }
+    rdr->dspace = H5Dget_space(rdr->dset);
+
+    // Get dimensions
+    hsize_t data_dims[2];
+    int ndims = H5Sget_simple_extent_ndims(rdr->dspace);
+    if (ndims != 2) {
+        fprintf(stderr, "Input data not two-dimensional\n");
+        H5Sclose(rdr->dspace);
+        H5Dclose(rdr->dset);
+        H5Fclose(rdr->file);
+        return 1;
+    }
+    H5Sget_simple_extent_dims(rdr->dspace, data_dims, NULL);
+    rdr->n_pts = (long) data_dims[0];
+    rdr->n_neurons = (int) data_dims[1];
+    if (max_pts > 0 && max_pts < rdr->n_pts) {
+        rdr->n_pts = max_pts;
+    }
+
+    // Allocate chunk buffers
+    rdr->chunk_rows = READER_CHUNK_BYTES / (rdr->n_neurons * (int) sizeof(int));
+    if (rdr->chunk_rows < 1) {
+        rdr->chunk_rows = 1;
+    }
+    if (rdr->chunk_rows > rdr->n_pts && rdr->n_pts > 0) {
+        rdr->chunk_rows = (int) rdr->n_pts;
+    }
+    for (int b = 0; b < 2; b++) {
+        rdr->bufs[b] = (int *) malloc((size_t) rdr->chunk_rows * rdr->n_neurons * sizeof(int));
+        rdr->state[b] = READER_BUFFER_EMPTY;
+        rdr->rows_in[b] = 0;
+    }
+
+    // Populate remaining fields
+    pthread_mutex_init(&rdr->lock, NULL);
+    pthread_cond_init(&rdr->cond, NULL);
+    rdr->stop = 0;
+    rdr->error = 0;
+    rdr->n_chunks_taken = 0;
+    rdr->cur = -1;
+    rdr->cur_rows = 0;
+    rdr->pos = 0;
+    rdr->done = 0;
+
+    // Start background thread
+    if (pthread_create(&rdr->thread, NULL, reader_run, rdr) != 0) {
+        perror("Could not create reader thread");
+        free(rdr->bufs[0]);
+        free(rdr->bufs[1]);
+        H5Sclose(rdr->dspace);
+        H5Dclose(rdr->dset);
+        H5Fclose(rdr->file);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// Next time point of recording
+int* SpikeReader_next(struct SpikeReader* rdr) {
+
+    if (rdr->done) {
+        return NULL;
+    }
+
+    // Move to next chunk once current one is used up
+    if (rdr->pos == rdr->cur_rows) {
+
+        pthread_mutex_lock(&rdr->lock);
+
+        // Release current buffer to background thread
+        if (rdr->cur >= 0) {
+            rdr->state[rdr->cur] = READER_BUFFER_EMPTY;
+            pthread_cond_broadcast(&rdr->cond);
+        }
+
+        // Wait for next chunk
+        rdr->cur = rdr->n_chunks_taken % 2;
+        while (rdr->state[rdr->cur] != READER_BUFFER_FULL) {
+            pthread_cond_wait(&rdr->cond, &rdr->lock);
+        }
+        rdr->cur_rows = rdr->rows_in[rdr->cur];
+        pthread_mutex_unlock(&rdr->lock);
+
+        rdr->n_chunks_taken++;
+        rdr->pos = 0;
+        if (rdr->cur_rows == 0) {
+            rdr->done = 1;
+            return NULL;
+        }
+    }
+
+    return rdr->bufs[rdr->cur] + (size_t) (rdr->pos++) * rdr->n_neurons;
+}
+
+
+// Stop reading and close recording
+void SpikeReader_close(struct SpikeReader* rdr) {
+
+    // Stop background thread
+    pthread_mutex_lock(&rdr->lock);
+    rdr->stop = 1;
+    pthread_cond_broadcast(&rdr->cond);
+    pthread_mutex_unlock(&rdr->lock);
+    pthread_join(rdr->thread, NULL);
+
+    // Close dataset
+    pthread_mutex_lock(&hdf5_lock);
+    H5Sclose(rdr->dspace);
+    H5Dclose(rdr->dset);
+    H5Fclose(rdr->file);
+    pthread_mutex_unlock(&hdf5_lock);
+
+    // Free allocated memory
+    pthread_mutex_destroy(&rdr->lock);
+    pthread_cond_destroy(&rdr->cond);
+    free(rdr->bufs[0]);
+    free(rdr->bufs[1]);
+}
@@ -0,0 +1,91 @@
+/* Header file for streaming spike reader */
+
+
+#ifndef _READER_H
+#define _READER_H
+
+#include <pthread.h>
+
+#include "hdf5.h"
+
+
+/* Streaming reader
+ *
+ * Reads the 'spks' dataset of a recording in chunks of consecutive time
+ * points (hyperslabs of whole rows), on a background thread, into two
+ * buffers: while the caller sends the time points of one chunk, the next
+ * chunk is read into the other buffer. Memory use is two chunks whatever the
+ * length of the recording, and sending can start as soon as the first chunk
+ * has been read.
+ *
+ * While a reader is open, its thread may call into HDF5 at any time, so
+ * other threads must not use HDF5 unless they hold hdf5_lock (the HDF5
+ * library is not necessarily built thread-safe).
+ */
+
+// Lock serializing calls into HDF5 made while a reader is open
+extern pthread_mutex_t hdf5_lock;
+
+// State of a chunk buffer
+enum ReaderBufferState {
+    READER_BUFFER_EMPTY,
+    READER_BUFFER_FULL
+};
+
+// Reader object
+struct SpikeReader {
+
+    // Open dataset and its dataspace
+    hid_t file;
+    hid_t dset;
+    hid_t dspace;
+
+    // Number of time points that will be read (all of them, or the limit
+    // given when opening), and number of neurons
+    long n_pts;
+    int n_neurons;
+
+    // Number of time points per chunk
+    int chunk_rows;
+
+    // Chunk buffers, their states, and number of time points in each (0 marks
+    // the end of the recording)
+    int* bufs[2];
+    enum ReaderBufferState state[2];
+    int rows_in[2];
+
+    // Lock and condition guarding buffer states
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Background thread, and flag telling it to stop
+    pthread_t thread;
+    int stop;
+
+    // Set if reading failed
+    int error;
+
+    // Consumer position: chunks taken so far, buffer being read (-1 before
+    // the first chunk), number of time points in it, and next time point in
+    // it; done is set at end of recording
+    long n_chunks_taken;
+    int cur;
+    int cur_rows;
+    int pos;
+    int done;
+};
+
+// Open recording and start reading ahead; reads at most max_pts time points
+// (all of them if max_pts <= 0); returns 0 on success
+int SpikeReader_open(struct SpikeReader* rdr, const char* path, long max_pts);
+
+// Next time point of recording (n_neurons spike counts), or NULL at the end
+// of the recording or if reading failed (check 'error'); stays valid until
+// the following call
+int* SpikeReader_next(struct SpikeReader* rdr);
+
+// Stop reading and close recording
+void SpikeReader_close(struct SpikeReader* rdr);
+
+
+#endif
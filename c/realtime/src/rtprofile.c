@@ -0,0 +1,170 @@
+/* Real-time execution profile */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "rtprofile.h"
+#include "cpu.h"
+
+
+// Default busy-poll time of sockets (microseconds)
+#define RT_BUSY_POLL_US 50
+
+// Stack pre-faulted by hot thread (bytes)
+#define RT_STACK_PREFAULT (256 << 10)
+
+
+// Initialize profile
+void rt_profile_init(struct RtProfile* prof) {
+
+    memset(prof, 0, sizeof(*prof));
+    prof->cpu = -1;
+}
+
+
+// Enable profile
+void rt_profile_enable(struct RtProfile* prof, int cpu, int fifo_prio) {
+
+    prof->enabled = 1;
+    prof->cpu = cpu;
+    prof->fifo_prio = fifo_prio;
+    prof->busy_poll_us = RT_BUSY_POLL_US;
+    prof->spin_requested = 1;
+}
+
+
+// Touch every page of stack region below caller
+static void __attribute__((noinline)) prefault_stack(void) {
+
+    volatile char stack[RT_STACK_PREFAULT];
+    long page = sysconf(_SC_PAGESIZE);
+    for (long i = 0; i < RT_STACK_PREFAULT; i += page) {
+        stack[i] = 0;
+    }
+    (void) stack[0];
+}
+
+
+// Apply profile to calling thread
+void rt_profile_apply(struct RtProfile* prof) {
+
+    if (!prof->enabled) {
+        return;
+    }
+
+    // Pin thread
+    prof->err_pin = cpu_pin_thread(prof->cpu);
+    prof->pinned = (prof->err_pin == 0);
+
+    // Request SCHED_FIFO
+    if (prof->fifo_prio > 0) {
+        struct sched_param sp;
+        memset(&sp, 0, sizeof(sp));
+        sp.sched_priority = prof->fifo_prio;
+        prof->err_fifo = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+        prof->fifo = (prof->err_fifo == 0);
+    }
+
+    // Lock current and future memory, then fault in stack
+    prof->locked = (mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+    prof->err_lock = prof->locked ? 0 : errno;
+    prefault_stack();
+    prof->prefault_bytes += RT_STACK_PREFAULT;
+}
+
+
+// Set busy polling on socket and make it non-blocking
+void rt_profile_socket(struct RtProfile* prof, int sock) {
+
+    if (!prof->enabled || sock < 0) {
+        return;
+    }
+    prof->has_socket = 1;
+
+    // Busy-poll device queue when socket is read (raising it above the
+    // system default needs CAP_NET_ADMIN)
+    int us = prof->busy_poll_us;
+    prof->busy_poll = (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) == 0);
+    prof->err_busy_poll = prof->busy_poll ? 0 : errno;
+
+    // Spin on socket instead of sleeping in recv()
+    if (!prof->spin_requested) {
+        return;
+    }
+    int flags = fcntl(sock, F_GETFL, 0);
+    prof->spin = (flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0);
+    prof->err_spin = prof->spin ? 0 : errno;
+}
+
+
+// Touch every page of buffer
+void rt_prefault(void* buf, size_t bytes) {
+
+    // Write each page back unchanged (reading alone could map the shared zero
+    // page)
+    volatile char* p = (volatile char*) buf;
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < bytes; i += page) {
+        p[i] = p[i];
+    }
+    if (bytes > 0) {
+        p[bytes - 1] = p[bytes - 1];
+    }
+}
+
+
+// Print whether setting was granted
+static void print_setting(const char* name, int granted, int err, const char* detail) {
+
+    if (granted) {
+        printf("  %-14s granted%s\n", name, detail);
+    }
+    else {
+        printf("  %-14s denied (%s)\n", name, strerror(err));
+    }
+}
+
+
+// Print settings that were granted
+void rt_profile_print(struct RtProfile* prof) {
+
+    if (!prof->enabled) {
+        return;
+    }
+
+    char detail[64];
+    printf("Real-time profile:\n");
+    snprintf(detail, sizeof(detail), " (CPU %d)", prof->cpu);
+    print_setting("CPU pinning", prof->pinned, prof->err_pin, detail);
+    if (prof->fifo_prio > 0) {
+        snprintf(detail, sizeof(detail), " (priority %d)", prof->fifo_prio);
+        print_setting("SCHED_FIFO", prof->fifo, prof->err_fifo, detail);
+    }
+    else {
+        printf("  %-14s not requested\n", "SCHED_FIFO");
+    }
+    print_setting("mlockall", prof->locked, prof->err_lock, "");
+    printf("  %-14s %.1f MB\n", "pre-faulted", prof->prefault_bytes / (double) (1 << 20));
+    if (!prof->has_socket) {
+        printf("  %-14s not used\n", "sockets");
+        return;
+    }
+    printf("  %-14s on\n", "TCP_NODELAY");
+    snprintf(detail, sizeof(detail), " (%d us)", prof->busy_poll_us);
+    print_setting("SO_BUSY_POLL", prof->busy_poll, prof->err_busy_poll, detail);
+    if (prof->spin_requested) {
+        print_setting("spin on recv", prof->spin, prof->err_spin, "");
+    }
+    else {
+        printf("  %-14s not requested\n", "spin on recv");
+    }
+}
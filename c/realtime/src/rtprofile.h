@@ -0,0 +1,85 @@
+/* Header file for real-time execution profile */
+
+
+#ifndef _RTPROFILE_H
+#define _RTPROFILE_H
+
+#include <stddef.h>
+
+
+/* Real-time profile
+ *
+ * Settings that keep the hot thread of the probe or processor off the slow
+ * paths of the kernel: the thread is pinned to one CPU (no migrations) and
+ * optionally runs under SCHED_FIFO (not preempted by ordinary processes), all
+ * memory is locked and pre-faulted (no page faults once frames flow), and
+ * sockets busy-poll the device queue (SO_BUSY_POLL) and are read without
+ * blocking, spinning until data arrives (no scheduler wakeup per frame).
+ *
+ * Each setting may be refused (most need privileges), which isn't an error:
+ * the profile records what was actually granted, and rt_profile_print()
+ * reports it. Spinning under SCHED_FIFO starves every other thread on the
+ * same CPU, so the hot thread should have a CPU of its own.
+ */
+struct RtProfile {
+
+    // Set if profile is in use
+    int enabled;
+
+    // CPU that hot thread is pinned to
+    int cpu;
+
+    // SCHED_FIFO priority requested (0 to keep default scheduling)
+    int fifo_prio;
+
+    // Busy-poll time requested for sockets (microseconds)
+    int busy_poll_us;
+
+    // Set if sockets should be made non-blocking and spun on (cleared when
+    // another thread needs the CPU that the hot thread would spin on)
+    int spin_requested;
+
+    // Set once a socket has been configured
+    int has_socket;
+
+    // Settings granted (errno of failure is kept for the report)
+    int pinned;
+    int err_pin;
+    int fifo;
+    int err_fifo;
+    int locked;
+    int err_lock;
+    int busy_poll;
+    int err_busy_poll;
+    int spin;
+    int err_spin;
+
+    // Bytes of memory pre-faulted
+    size_t prefault_bytes;
+};
+
+// Initialize profile (disabled)
+void rt_profile_init(struct RtProfile* prof);
+
+// Enable profile, pinning hot thread to cpu, with SCHED_FIFO priority
+// fifo_prio (0 for default scheduling)
+void rt_profile_enable(struct RtProfile* prof, int cpu, int fifo_prio);
+
+// Apply profile to calling thread: pin it, set its scheduling policy, lock all
+// memory of the process, and pre-fault the stack (threads created afterwards
+// inherit the pinning and policy, so background threads should be started
+// first)
+void rt_profile_apply(struct RtProfile* prof);
+
+// Set busy polling on socket and make it non-blocking (reads and writes on it
+// then spin)
+void rt_profile_socket(struct RtProfile* prof, int sock);
+
+// Touch every page of buffer, so that it is mapped before it is used
+void rt_prefault(void* buf, size_t bytes);
+
+// Print settings that were granted
+void rt_profile_print(struct RtProfile* prof);
+
+
+#endif
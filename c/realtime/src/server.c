@@ -0,0 +1,355 @@
+/* Multi-session processor */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "server.h"
+#include "cpu.h"
+
+
+// Maximum number of events handled per call to epoll_wait()
+#define MAX_EVENTS 64
+
+// Time allowed for a new probe to send its header (seconds)
+#define HEADER_TIMEOUT_S 1
+
+
+// Close session and free its resources
+static void server_close_session(struct ServerWorker* wkr, struct ServerSession* ses) {
+
+    epoll_ctl(wkr->epoll_fd, EPOLL_CTL_DEL, ses->conn.sock_client_id, NULL);
+    printf("Session %d closed after %ld frames (reading paused %ld times for slow replies)\n", ses->id,
+        ses->n_frames, ses->n_paused);
+
+    processor_disconnect(&ses->conn);
+    FilterAuto_delete(&ses->flt);
+    free(ses->replies);
+    free(ses->spks_int);
+    free(ses->spks_double);
+    free(ses->frame);
+    free(ses);
+}
+
+
+// Accept new probe, set up its session, and hand it to a worker (runs on
+// acceptor thread, so that workers never wait for a header exchange or for a
+// filter to be created)
+static void server_accept(struct ProcessorServer* srv) {
+
+    struct ServerSession* ses = (struct ServerSession *) malloc(sizeof(struct ServerSession));
+    if (processor_accept(srv->sock_listen, srv->host, srv->port, &ses->conn) != 0) {
+        free(ses);
+        return;
+    }
+
+    // Create filter for session
+    if (FilterAuto_new(&ses->flt, srv->filter_type, ses->conn.n_neurons, &srv->params) != 0) {
+        fprintf(stderr, "Filter creation failed\n");
+        processor_disconnect(&ses->conn);
+        free(ses);
+        return;
+    }
+
+    // Allocate frame buffers
+    ses->frame = (char *) malloc(sizeof(struct FrameHeader) + ses->conn.n_neurons * sizeof(int));
+    ses->spks_int = (int *) malloc(ses->conn.n_neurons * sizeof(int));
+    ses->spks_double = (double *) malloc(ses->conn.n_neurons * sizeof(double));
+    ses->reply_len = sizeof(struct FrameHeader) + ses->conn.n_preds * sizeof(double);
+    ses->replies = (char *) malloc((size_t) SERVER_REPLY_QUEUE_LEN * ses->reply_len);
+    ses->reply_head = 0;
+    ses->n_replies = 0;
+    ses->reply_sent = 0;
+    ses->events = EPOLLIN;
+    ses->n_bytes = 0;
+    ses->n_frames = 0;
+    ses->n_paused = 0;
+    ses->id = srv->n_sessions++;
+
+    // Hand session to next worker (epoll_ctl() is safe to call while the
+    // worker waits on its epoll instance; the session belongs to the worker
+    // from then on, so report it first)
+    struct ServerWorker* wkr = &srv->workers[ses->id % srv->n_workers];
+    printf("Session %d opened (%d neurons, %s encoding, worker %d)\n",
+        ses->id, ses->conn.n_neurons, encoding_name(ses->conn.encoding), (int) (wkr - srv->workers));
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = ses;
+    if (epoll_ctl(wkr->epoll_fd, EPOLL_CTL_ADD, ses->conn.sock_client_id, &ev) != 0) {
+        perror("epoll_ctl failed");
+        server_close_session(wkr, ses);
+    }
+}
+
+
+// Register socket of session for the events its reply queue calls for
+// (reading unless queue is full, writing while it isn't empty); returns 0 on
+// success
+static int server_update_events(struct ServerWorker* wkr, struct ServerSession* ses) {
+
+    uint32_t events = 0;
+    if (ses->n_replies < SERVER_REPLY_QUEUE_LEN) {
+        events |= EPOLLIN;
+    }
+    if (ses->n_replies > 0) {
+        events |= EPOLLOUT;
+    }
+    if (events == ses->events) {
+        return 0;
+    }
+    if (!(events & EPOLLIN)) {
+        ses->n_paused++;
+    }
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = ses;
+    if (epoll_ctl(wkr->epoll_fd, EPOLL_CTL_MOD, ses->conn.sock_client_id, &ev) != 0) {
+        perror("epoll_ctl failed");
+        return 1;
+    }
+    ses->events = events;
+    return 0;
+}
+
+
+// Send as many queued replies as socket takes without blocking, oldest first;
+// returns 0 on success
+static int server_flush_replies(struct ServerWorker* wkr, struct ServerSession* ses) {
+
+    while (ses->n_replies > 0) {
+        const char* reply = ses->replies + (size_t) ses->reply_head * ses->reply_len;
+        ssize_t n = send(
+            ses->conn.sock_client_id, reply + ses->reply_sent,
+            ses->reply_len - ses->reply_sent, MSG_DONTWAIT | MSG_NOSIGNAL
+        );
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            perror("send failed");
+            return 1;
+        }
+        ses->reply_sent += n;
+        if (ses->reply_sent == ses->reply_len) {
+            ses->reply_head = (ses->reply_head + 1) % SERVER_REPLY_QUEUE_LEN;
+            ses->n_replies--;
+            ses->reply_sent = 0;
+        }
+    }
+
+    return server_update_events(wkr, ses);
+}
+
+
+// Queue predictions of session in reply to frame just received, and send what
+// the socket takes (the queue has room, since the session isn't read while it
+// is full); returns 0 on success
+static int server_send_reply(struct ServerWorker* wkr, struct ServerSession* ses, double* fpreds) {
+
+    int slot = (ses->reply_head + ses->n_replies) % SERVER_REPLY_QUEUE_LEN;
+    char* reply = ses->replies + (size_t) slot * ses->reply_len;
+    size_t len = ses->conn.n_preds * sizeof(double);
+    struct FrameHeader hdr;
+    frame_header_init(&hdr, ses->conn.hdr_rx.seq, len);
+    memcpy(reply, &hdr, sizeof(hdr));
+    memcpy(reply + sizeof(hdr), fpreds, len);
+    ses->n_replies++;
+
+    return server_flush_replies(wkr, ses);
+}
+
+
+// Read available data for session, and filter frame once it is complete
+static void server_handle_session(struct ServerWorker* wkr, struct ServerSession* ses) {
+
+    // Read as much of current frame as is available without blocking (up to
+    // the shortest payload until the header says how long the frame is)
+    int header_size = sizeof(struct FrameHeader);
+    int min_payload = (int) spikes_min_len(ses->conn.encoding, ses->conn.n_neurons);
+    int max_payload = ses->conn.n_neurons * sizeof(int);
+    int frame_size = header_size + min_payload;
+    if (ses->n_bytes >= header_size) {
+        frame_size = header_size + ses->conn.hdr_rx.payload_len;
+    }
+    ssize_t r = recv(
+        ses->conn.sock_client_id, ses->frame + ses->n_bytes,
+        frame_size - ses->n_bytes, MSG_DONTWAIT
+    );
+    if (r == 0) {
+        if (ses->n_bytes > 0) {
+            fprintf(stderr, "Session %d closed in the middle of a frame\n", ses->id);
+        }
+        server_close_session(wkr, ses);
+        return;
+    }
+    if (r < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            perror("recv failed");
+            server_close_session(wkr, ses);
+        }
+        return;
+    }
+    ses->n_bytes += r;
+
+    // Check header as soon as it is complete (reply answers this frame)
+    if (ses->n_bytes - r < header_size && ses->n_bytes >= header_size) {
+        memcpy(&ses->conn.hdr_rx, ses->frame, sizeof(struct FrameHeader));
+        if (frame_check(&ses->conn.hdr_rx, min_payload, max_payload) != 0) {
+            server_close_session(wkr, ses);
+            return;
+        }
+        frame_size = header_size + ses->conn.hdr_rx.payload_len;
+    }
+    if (ses->n_bytes < frame_size) {
+        return;
+    }
+    ses->n_bytes = 0;
+
+    // Decode spikes
+    if (spikes_decode(ses->conn.hdr_rx.flags, ses->frame + header_size, ses->conn.hdr_rx.payload_len,
+            ses->conn.n_neurons, ses->spks_int) != 0) {
+        server_close_session(wkr, ses);
+        return;
+    }
+
+    // Convert spikes to doubles
+    for (int i = 0; i < ses->conn.n_neurons; i++) {
+        ses->spks_double[i] = (double) ses->spks_int[i];
+    }
+
+    // Update filter and send predictions back to probe
+    FilterAuto_predict_next(&ses->flt, ses->spks_double);
+    if (server_send_reply(wkr, ses, ses->flt.x_pred) != 0) {
+        server_close_session(wkr, ses);
+        return;
+    }
+    ses->n_frames++;
+}
+
+
+// Event loop of worker
+static void* server_worker_run(void* arg) {
+
+    struct ServerWorker* wkr = (struct ServerWorker*) arg;
+
+    if (wkr->cpu >= 0 && cpu_pin_thread(wkr->cpu) != 0) {
+        fprintf(stderr, "Could not pin server worker to CPU %d\n", wkr->cpu);
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (1) {
+
+        int n = epoll_wait(wkr->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            return NULL;
+        }
+
+        // Send queued replies before reading next frame, and only read a
+        // frame if its reply has room in the queue (a hangup or error is
+        // reported even while reading is paused, and is found by the send)
+        for (int e = 0; e < n; e++) {
+            struct ServerSession* ses = (struct ServerSession*) events[e].data.ptr;
+            if ((events[e].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && ses->n_replies > 0
+                    && server_flush_replies(wkr, ses) != 0) {
+                server_close_session(wkr, ses);
+                continue;
+            }
+            if ((events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    && ses->n_replies < SERVER_REPLY_QUEUE_LEN) {
+                server_handle_session(wkr, ses);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+// Start listening for probes and start worker threads
+int server_start(struct ProcessorServer* srv, char* host, int port, int n_workers, int first_cpu,
+    enum FilterType filter_type, struct FilterParams* params) {
+
+    if (n_workers < 1) {
+        n_workers = 1;
+    }
+
+    // Populate fields (sessions are already spread over workers, so each
+    // session's filter runs on a single thread)
+    srv->host = host;
+    srv->port = port;
+    srv->filter_type = filter_type;
+    srv->params = *params;
+    srv->params.n_threads = 1;
+    srv->n_workers = n_workers;
+    srv->n_sessions = 0;
+
+    // Create listening socket; accepted sockets inherit the receive timeout,
+    // which bounds how long a probe can stall the header exchange
+    if (processor_listen(port, &srv->sock_listen) != 0) {
+        return 1;
+    }
+    struct timeval tv;
+    tv.tv_sec = HEADER_TIMEOUT_S;
+    tv.tv_usec = 0;
+    setsockopt(srv->sock_listen, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // Create workers
+    int n_cpus = cpu_count();
+    srv->workers = (struct ServerWorker *) malloc(n_workers * sizeof(struct ServerWorker));
+    for (int w = 0; w < n_workers; w++) {
+        struct ServerWorker* wkr = &srv->workers[w];
+        wkr->srv = srv;
+        wkr->cpu = (first_cpu >= 0) ? (first_cpu + w) % n_cpus : -1;
+        wkr->epoll_fd = epoll_create1(0);
+        if (wkr->epoll_fd < 0) {
+            perror("epoll_create1 failed");
+            return 1;
+        }
+    }
+
+    // Start worker threads (calling thread accepts probes)
+    for (int w = 0; w < n_workers; w++) {
+        if (pthread_create(&srv->workers[w].thread, NULL, server_worker_run, &srv->workers[w]) != 0) {
+            perror("Could not create server worker");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+// Accept probes on calling thread and hand their sessions to workers
+int server_run(struct ProcessorServer* srv) {
+
+    // Wait for a probe before accepting it (the listening socket's receive
+    // timeout would otherwise make an idle accept() fail every second)
+    struct pollfd pfd;
+    pfd.fd = srv->sock_listen;
+    pfd.events = POLLIN;
+    while (1) {
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll() on listening socket failed");
+            return 1;
+        }
+        server_accept(srv);
+    }
+    return 1;
+}
@@ -0,0 +1,132 @@
+/* Header file for multi-session processor */
+
+
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "protocol.h"
+#include "autofilter.h"
+
+
+/* Event-driven processor serving many probes
+ *
+ * A ProcessorServer accepts any number of probe connections on one port.
+ * Each connection becomes a session with its own filter. New probes are
+ * accepted on the thread that calls server_run(), which also exchanges headers
+ * with them and creates their filters, so neither a probe that is slow to send
+ * its header nor the allocation of a large filter holds up running sessions.
+ * Finished sessions are spread round-robin over a fixed set of workers, each
+ * of which runs an epoll loop over its sessions on its own (optionally pinned)
+ * thread, so a slow session only delays other sessions on the same worker.
+ *
+ * Workers never block on a socket. Frames are read with non-blocking receives
+ * into a per-session buffer, so a frame that arrives in pieces never stalls
+ * the worker. Replies are sent the same way: replies that don't fit in the
+ * socket's send buffer wait in a short per-session queue and are sent when the
+ * socket becomes writable. Every frame gets its reply, in order, as the
+ * protocol promises; once the queue is full, the worker stops reading frames
+ * from that session until the probe has taken some replies, so a probe that
+ * stops reading only holds up itself.
+ */
+
+// Number of replies that can wait to be sent for each session
+#define SERVER_REPLY_QUEUE_LEN 8
+
+// State of a session with one probe
+struct ServerSession {
+
+    // Connection with probe
+    struct ProcessorConnection conn;
+
+    // Filter for this session
+    struct FilterAuto flt;
+
+    // Buffer for frame being received (header followed by payload), and
+    // number of bytes received
+    char* frame;
+    int n_bytes;
+
+    // Spikes decoded from payload of received frame
+    int* spks_int;
+
+    // Spikes converted to double
+    double* spks_double;
+
+    // Queue of replies waiting to be sent (SERVER_REPLY_QUEUE_LEN slots of
+    // reply_len bytes, each a header followed by predictions), slot of oldest
+    // reply, number of replies queued, and number of bytes of oldest reply
+    // sent so far
+    char* replies;
+    int reply_len;
+    int reply_head;
+    int n_replies;
+    int reply_sent;
+
+    // Events the session's socket is registered for (EPOLLIN unless the
+    // reply queue is full, EPOLLOUT while replies are queued)
+    uint32_t events;
+
+    // Number of frames processed, and number of times reading was paused
+    // because the reply queue was full
+    long n_frames;
+    long n_paused;
+
+    // Session ID (in order of connection)
+    int id;
+};
+
+// Worker running an event loop over a subset of sessions
+struct ServerWorker {
+
+    // Server that owns worker
+    struct ProcessorServer* srv;
+
+    // Epoll instance of worker
+    int epoll_fd;
+
+    // Thread running worker
+    pthread_t thread;
+
+    // CPU that worker is pinned to (-1 if not pinned)
+    int cpu;
+};
+
+// Server object
+struct ProcessorServer {
+
+    // IP address
+    char* host;
+
+    // Port
+    int port;
+
+    // Socket ID used to listen for incoming connections
+    int sock_listen;
+
+    // Filter used for every session
+    enum FilterType filter_type;
+    struct FilterParams params;
+
+    // Workers
+    int n_workers;
+    struct ServerWorker* workers;
+
+    // Number of sessions accepted so far
+    int n_sessions;
+};
+
+// Start listening for probes and start worker threads (worker i is pinned to
+// CPU first_cpu + i, or left unpinned if first_cpu is negative); returns 0 on
+// success
+int server_start(struct ProcessorServer* srv, char* host, int port, int n_workers, int first_cpu,
+    enum FilterType filter_type, struct FilterParams* params);
+
+// Accept probes on calling thread and hand their sessions to workers (does
+// not return unless an error occurs)
+int server_run(struct ProcessorServer* srv);
+
+
+#endif
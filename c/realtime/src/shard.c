@@ -0,0 +1,200 @@
+/* Sharded processing */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "shard.h"
+
+
+// Constructor for FilterAutoLMSShard object
+void FilterAutoLMSShard_new(struct FilterAutoLMSShard* flt, int dim, int order, double mu, int row_begin,
+    int row_end) {
+
+    // Populate fields
+    flt->dim = dim;
+    flt->order = order;
+    flt->hist_size = dim * order;
+    flt->mu = mu;
+    flt->row_begin = row_begin;
+    flt->n_rows = row_end - row_begin;
+    flt->head = 0;
+    flt->kernel = kernel_lms_select_for(dim, order);
+
+    // Allocate arrays (weights, history and predictions start at zero)
+    flt->x_pred = (double *) calloc(flt->n_rows, sizeof(double));
+    flt->x_err = (double *) calloc(flt->n_rows, sizeof(double));
+    flt->wts = (double *) calloc((size_t) flt->n_rows * flt->hist_size, sizeof(double));
+    flt->x_hist = (double *) calloc(flt->hist_size, sizeof(double));
+    flt->blk_old = (const double **) malloc(order * sizeof(double*));
+    flt->blk_new = (const double **) malloc(order * sizeof(double*));
+}
+
+
+// Destructor for FilterAutoLMSShard object
+void FilterAutoLMSShard_delete(struct FilterAutoLMSShard* flt) {
+
+    // Free allocated memory
+    free(flt->blk_new);
+    free(flt->blk_old);
+    free(flt->x_hist);
+    free(flt->wts);
+    free(flt->x_err);
+    free(flt->x_pred);
+}
+
+
+// Update filter with new signal value and predict next value of owned rows
+void FilterAutoLMSShard_predict_next(struct FilterAutoLMSShard* flt, double* x) {
+
+    int dim = flt->dim;
+
+    // Point kernel at history blocks (block k of the new history is block
+    // k - 1 of the old history, and block 0 is the new signal value)
+    for (int k = 0; k < flt->order; k++) {
+        flt->blk_old[k] = flt->x_hist + ((flt->head + k) % flt->order) * dim;
+        flt->blk_new[k] = (k == 0) ? x : flt->blk_old[k - 1];
+    }
+
+    // Compute error of owned rows
+    for (int i = 0; i < flt->n_rows; i++) {
+        flt->x_err[i] = x[flt->row_begin + i] - flt->x_pred[i];
+    }
+
+    // Update owned rows and predict in a single pass over them (row i of the
+    // kernel's matrix is row row_begin + i of the full matrix)
+    flt->kernel(
+        flt->wts, flt->hist_size, dim, flt->order, flt->mu,
+        flt->x_err, flt->blk_old, flt->blk_new, flt->x_pred, 0, flt->n_rows
+    );
+
+    // Add new signal value to history, overwriting oldest slot
+    flt->head = (flt->head + flt->order - 1) % flt->order;
+    memcpy(flt->x_hist + flt->head * dim, x, dim * sizeof(double));
+}
+
+
+// Rows of shard k of n_shards
+void shard_rows(int dim, int n_shards, int k, int* row_begin, int* row_end) {
+
+    *row_begin = (int) ((long) dim * k / n_shards);
+    *row_end = (int) ((long) dim * (k + 1) / n_shards);
+}
+
+
+// Connect to shards
+int coordinator_connect(struct ShardCoordinator* crd, const char* addrs, int n_neurons,
+    enum WireEncoding encoding) {
+
+    // Count shards
+    int n = 1;
+    for (const char* p = addrs; *p != '\0'; p++) {
+        if (*p == ',') {
+            n++;
+        }
+    }
+    if (n > n_neurons) {
+        fprintf(stderr, "More shards (%d) than neurons (%d)\n", n, n_neurons);
+        return 1;
+    }
+
+    // Populate fields
+    crd->n_shards = n;
+    crd->n_neurons = n_neurons;
+    crd->addrs = strdup(addrs);
+    crd->shards = (struct ProbeConnection *) malloc(n * sizeof(struct ProbeConnection));
+    crd->row_begin = (int *) malloc(n * sizeof(int));
+    crd->hists = (struct Histogram *) malloc(n * sizeof(struct Histogram));
+    crd->pfds = (struct pollfd *) malloc(n * sizeof(struct pollfd));
+
+    // Connect to each shard in turn
+    char* save;
+    char* addr = strtok_r(crd->addrs, ",", &save);
+    for (int k = 0; k < n; k++, addr = strtok_r(NULL, ",", &save)) {
+        char* colon = (addr != NULL) ? strrchr(addr, ':') : NULL;
+        if (colon == NULL) {
+            fprintf(stderr, "Malformed shard address %d in '%s' (expected 'host:port')\n", k, addrs);
+            crd->n_shards = k;
+            coordinator_disconnect(crd);
+            return 1;
+        }
+        *colon = '\0';
+        int port = atoi(colon + 1);
+
+        int row_end;
+        shard_rows(n_neurons, n, k, &crd->row_begin[k], &row_end);
+        if (probe_connect_shard(addr, port, n_neurons, crd->row_begin[k], row_end, encoding,
+                &crd->shards[k]) != 0) {
+            fprintf(stderr, "Could not connect to shard %d at %s:%d\n", k, addr, port);
+            crd->n_shards = k;
+            coordinator_disconnect(crd);
+            return 1;
+        }
+        Histogram_reset(&crd->hists[k]);
+        crd->pfds[k].events = POLLIN;
+    }
+
+    return 0;
+}
+
+
+// Disconnect from shards
+void coordinator_disconnect(struct ShardCoordinator* crd) {
+
+    for (int k = 0; k < crd->n_shards; k++) {
+        probe_disconnect(&crd->shards[k]);
+    }
+
+    // Free allocated memory
+    free(crd->pfds);
+    free(crd->hists);
+    free(crd->row_begin);
+    free(crd->shards);
+    free(crd->addrs);
+}
+
+
+// Send spike frame to every shard and gather their predictions
+int coordinator_step(struct ShardCoordinator* crd, int* spks, double* preds) {
+
+    // Send frame to every shard before waiting for any of them, so that they
+    // work in parallel
+    uint64_t t0 = timing_now();
+    for (int k = 0; k < crd->n_shards; k++) {
+        if (probe_send(&crd->shards[k], spks) != 0) {
+            fprintf(stderr, "Could not send frame to shard %d\n", k);
+            return 1;
+        }
+        crd->pfds[k].fd = crd->shards[k].sock_id;
+    }
+
+    // Receive predictions from shards in the order they arrive, so that each
+    // shard's latency is measured when its predictions are ready
+    int n_waiting = crd->n_shards;
+    while (n_waiting > 0) {
+        if (poll(crd->pfds, crd->n_shards, -1) < 0) {
+            perror("poll() on shards failed");
+            return 1;
+        }
+        for (int k = 0; k < crd->n_shards; k++) {
+            if (crd->pfds[k].fd < 0 || crd->pfds[k].revents == 0) {
+                continue;
+            }
+            struct ProbeConnection* shard = &crd->shards[k];
+            if (probe_recv(shard, preds + crd->row_begin[k]) != 0) {
+                fprintf(stderr, "Could not receive predictions from shard %d\n", k);
+                return 1;
+            }
+            if (shard->hdr_rx.seq != shard->seq_tx - 1) {
+                fprintf(stderr, "Shard %d answered frame %lu while frame %lu was pending\n", k,
+                    (unsigned long) shard->hdr_rx.seq, (unsigned long) (shard->seq_tx - 1));
+                return 1;
+            }
+            Histogram_record(&crd->hists[k], timing_ns(timing_now() - t0));
+            crd->pfds[k].fd = -1;
+            n_waiting--;
+        }
+    }
+
+    return 0;
+}
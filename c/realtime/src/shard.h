@@ -0,0 +1,123 @@
+/* Header file for sharded processing */
+
+
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#include <poll.h>
+
+#include "protocol.h"
+#include "kernels.h"
+#include "timing.h"
+
+
+/* Sharded LMS
+ *
+ * Splits the rows of the LMS weight matrix across several processes, so
+ * that a probe too large for one machine to update per bin can be spread over
+ * several. A coordinator takes the place of the processor: it receives each
+ * spike frame from the probe, sends it to every shard, and gathers their
+ * predictions into the reply. Each shard owns a contiguous block of rows of
+ * the weight matrix, and keeps the whole signal history, since every row reads
+ * all of it. The rows of shard k of n are [k * dim / n, (k + 1) * dim / n).
+ *
+ * Shards run the same fused kernel on their rows as FilterAutoLMS does on
+ * all of them, so the gathered predictions are identical to those of a single
+ * LMS processor.
+ */
+
+// LMS filter over block of rows (run by shard)
+struct FilterAutoLMSShard {
+
+    // Dimension of signal
+    int dim;
+
+    // Order of filter (number of signal vectors in history)
+    int order;
+
+    // Size of history (dim * order)
+    int hist_size;
+
+    // Step size used for filter updates
+    double mu;
+
+    // Rows of weight matrix owned by shard (first row, and number of rows)
+    int row_begin;
+    int n_rows;
+
+    // Predictions of owned rows
+    double* x_pred;
+
+    // Errors of owned rows from last step
+    double* x_err;
+
+    // Owned rows of weight matrix (row-major, n_rows x hist_size)
+    double* wts;
+
+    // Signal history (circular buffer, as in FilterAutoLMS), and pointers to
+    // its blocks before (blk_old) and after (blk_new) adding the newest signal
+    // value
+    double* x_hist;
+    int head;
+    const double** blk_old;
+    const double** blk_new;
+
+    // Fused update-and-predict kernel selected for this CPU
+    KernelLMS kernel;
+};
+
+// Constructor for filter object
+void FilterAutoLMSShard_new(struct FilterAutoLMSShard* flt, int dim, int order, double mu, int row_begin,
+    int row_end);
+
+// Destructor for filter object
+void FilterAutoLMSShard_delete(struct FilterAutoLMSShard* flt);
+
+// Update filter with new signal value and predict next value of owned rows
+void FilterAutoLMSShard_predict_next(struct FilterAutoLMSShard* flt, double* x);
+
+
+// Rows of shard k of n_shards over dim rows
+void shard_rows(int dim, int n_shards, int k, int* row_begin, int* row_end);
+
+
+// Coordinator of shards
+struct ShardCoordinator {
+
+    // Number of shards, and connection with each
+    int n_shards;
+    struct ProbeConnection* shards;
+
+    // Copy of shard addresses (hosts of connections point into it)
+    char* addrs;
+
+    // First row predicted by each shard
+    int* row_begin;
+
+    // Number of neurons
+    int n_neurons;
+
+    // Latency of each shard (from sending frame to all shards to receiving
+    // its predictions)
+    struct Histogram* hists;
+
+    // Sockets polled for predictions of current frame (socket of shard whose
+    // predictions have arrived is set to -1)
+    struct pollfd* pfds;
+};
+
+// Connect to shards at addresses ('host:port' separated by commas), giving
+// each a contiguous block of n_neurons rows and asking for spikes in given
+// encoding; returns 0 on success
+int coordinator_connect(struct ShardCoordinator* crd, const char* addrs, int n_neurons,
+    enum WireEncoding encoding);
+
+// Disconnect from shards
+void coordinator_disconnect(struct ShardCoordinator* crd);
+
+// Send spike frame to every shard and gather their predictions into preds
+// (n_neurons, in order of rows); returns 0 on success
+int coordinator_step(struct ShardCoordinator* crd, int* spks, double* preds);
+
+
+#endif
@@ -0,0 +1,321 @@
+/* Shared-memory transport */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm.h"
+#include "cpu.h"
+
+
+// Magic number and layout version of segment
+#define SHM_MAGIC 0x52544d53
+#define SHM_VERSION 1
+
+// Connection states
+#define SHM_STATE_CREATED 0
+#define SHM_STATE_READY 1
+#define SHM_STATE_ACKED 2
+
+// Number of slots in each ring
+#define SHM_CAPACITY 64
+
+// Number of spin iterations after which a waiting side yields its CPU
+#define SPINS_BEFORE_YIELD 1024
+
+// Time between checks while connecting (microseconds), and time probe waits
+// for processor to attach (seconds)
+#define CONNECT_POLL_US 1000
+#define CONNECT_TIMEOUT_S 10
+
+// Size of a slot or header rounded up to a whole number of cache lines
+#define CACHE_ROUND(n) (((n) + 63) & ~((size_t) 63))
+
+
+// Name of segment for port
+static void shm_name(int port, char* name, size_t len) {
+
+    snprintf(name, len, "/realtime-%d", port);
+}
+
+
+// Sleep while connecting
+static void connect_sleep(void) {
+
+    struct timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = CONNECT_POLL_US * 1000;
+    nanosleep(&ts, NULL);
+}
+
+
+// Set pointers to rings of mapped segment
+static void shm_map_rings(struct ShmChannel* ch) {
+
+    char* base = (char*) ch->hdr + CACHE_ROUND(sizeof(struct ShmHeader));
+    ch->slots_up = base;
+    ch->slots_down = base + (size_t) ch->hdr->capacity * ch->hdr->slot_size_up;
+}
+
+
+// Total length of buffers
+static size_t iov_total(const struct iovec* iov, int iovcnt) {
+
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
+
+// Create segment and wait for processor to attach
+int shm_create(int port, int n_neurons, size_t slot_size_up, size_t slot_size_down,
+    int busy_poll, struct ShmChannel* ch) {
+
+    char name[64];
+    shm_name(port, name, sizeof(name));
+
+    // Remove segment left behind by earlier run, then create new one
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        perror("Cannot create shared-memory segment");
+        return 1;
+    }
+
+    // Size and map segment
+    slot_size_up = CACHE_ROUND(slot_size_up);
+    slot_size_down = CACHE_ROUND(slot_size_down);
+    size_t map_size = CACHE_ROUND(sizeof(struct ShmHeader))
+        + SHM_CAPACITY * (slot_size_up + slot_size_down);
+    if (ftruncate(fd, map_size) != 0) {
+        perror("Cannot size shared-memory segment");
+        close(fd);
+        shm_unlink(name);
+        return 1;
+    }
+    void* addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror("Cannot map shared-memory segment");
+        shm_unlink(name);
+        return 1;
+    }
+
+    // Initialize header
+    struct ShmHeader* hdr = (struct ShmHeader*) addr;
+    hdr->magic = SHM_MAGIC;
+    hdr->version = SHM_VERSION;
+    hdr->n_neurons = n_neurons;
+    hdr->capacity = SHM_CAPACITY;
+    hdr->slot_size_up = (int) slot_size_up;
+    hdr->slot_size_down = (int) slot_size_down;
+    atomic_init(&hdr->probe_closed, 0);
+    atomic_init(&hdr->processor_closed, 0);
+    atomic_init(&hdr->up.head, 0);
+    atomic_init(&hdr->up.tail, 0);
+    atomic_init(&hdr->down.head, 0);
+    atomic_init(&hdr->down.tail, 0);
+    atomic_store_explicit(&hdr->state, SHM_STATE_READY, memory_order_release);
+
+    // Populate struct
+    ch->hdr = hdr;
+    ch->map_size = map_size;
+    ch->is_probe = 1;
+    ch->busy_poll = busy_poll;
+    shm_map_rings(ch);
+
+    // Wait for processor to acknowledge
+    int n_polls = CONNECT_TIMEOUT_S * (1000000 / CONNECT_POLL_US);
+    for (int i = 0; i < n_polls; i++) {
+        if (atomic_load_explicit(&hdr->state, memory_order_acquire) == SHM_STATE_ACKED) {
+            return 0;
+        }
+        connect_sleep();
+    }
+
+    fprintf(stderr, "Processor did not attach to shared-memory segment '%s'\n", name);
+    munmap(addr, map_size);
+    shm_unlink(name);
+    return 1;
+}
+
+
+// Wait for probe to create segment and attach to it
+int shm_attach(int port, int busy_poll, struct ShmChannel* ch) {
+
+    char name[64];
+    shm_name(port, name, sizeof(name));
+
+    // Wait until segment exists and has been initialized by probe
+    struct ShmHeader* hdr = NULL;
+    size_t map_size = 0;
+    while (hdr == NULL) {
+
+        int fd = shm_open(name, O_RDWR, 0600);
+        if (fd < 0) {
+            if (errno != ENOENT) {
+                perror("Cannot open shared-memory segment");
+                return 1;
+            }
+            connect_sleep();
+            continue;
+        }
+
+        // Map whole segment once probe has sized it
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(struct ShmHeader)) {
+            void* addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr != MAP_FAILED) {
+                hdr = (struct ShmHeader*) addr;
+                map_size = st.st_size;
+                if (atomic_load_explicit(&hdr->state, memory_order_acquire) != SHM_STATE_READY) {
+                    munmap(addr, map_size);
+                    hdr = NULL;
+                }
+            }
+        }
+        close(fd);
+
+        if (hdr == NULL) {
+            connect_sleep();
+        }
+    }
+
+    if (hdr->magic != SHM_MAGIC || hdr->version != SHM_VERSION) {
+        fprintf(stderr, "Shared-memory segment '%s' has unknown layout\n", name);
+        munmap(hdr, map_size);
+        return 1;
+    }
+
+    // Remove name, since no other process should attach to segment
+    shm_unlink(name);
+
+    // Populate struct
+    ch->hdr = hdr;
+    ch->map_size = map_size;
+    ch->is_probe = 0;
+    ch->busy_poll = busy_poll;
+    shm_map_rings(ch);
+
+    // Acknowledge probe
+    atomic_store_explicit(&hdr->state, SHM_STATE_ACKED, memory_order_release);
+
+    return 0;
+}
+
+
+// Mark this side as closed and unmap segment
+void shm_close(struct ShmChannel* ch) {
+
+    if (ch->is_probe) {
+        atomic_store_explicit(&ch->hdr->probe_closed, 1, memory_order_release);
+    }
+    else {
+        atomic_store_explicit(&ch->hdr->processor_closed, 1, memory_order_release);
+    }
+    munmap(ch->hdr, ch->map_size);
+}
+
+
+// Wait one step for other side
+static inline void shm_wait(struct ShmChannel* ch, int* spins) {
+
+    cpu_relax();
+    if (!ch->busy_poll && ++(*spins) == SPINS_BEFORE_YIELD) {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+
+// Send frame to other side
+int shm_send(struct ShmChannel* ch, const struct iovec* iov, int iovcnt) {
+
+    struct ShmRing* ring = ch->is_probe ? &ch->hdr->up : &ch->hdr->down;
+    char* slots = ch->is_probe ? ch->slots_up : ch->slots_down;
+    size_t slot_size = ch->is_probe ? ch->hdr->slot_size_up : ch->hdr->slot_size_down;
+    atomic_int* peer_closed = ch->is_probe ? &ch->hdr->processor_closed : &ch->hdr->probe_closed;
+    size_t len = iov_total(iov, iovcnt);
+    if (len > slot_size) {
+        fprintf(stderr, "Frame of %zu bytes does not fit in shared-memory slot\n", len);
+        return 1;
+    }
+
+    // Wait for free slot
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    int spins = 0;
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= (unsigned long) ch->hdr->capacity) {
+        if (atomic_load_explicit(peer_closed, memory_order_relaxed)) {
+            return 1;
+        }
+        shm_wait(ch, &spins);
+    }
+
+    // Write frame and publish slot
+    char* slot = slots + (head % ch->hdr->capacity) * slot_size;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(slot, iov[i].iov_base, iov[i].iov_len);
+        slot += iov[i].iov_len;
+    }
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return 0;
+}
+
+
+// Receive frame from other side
+int shm_recv(struct ShmChannel* ch, const struct iovec* iov, int iovcnt) {
+
+    struct ShmRing* ring = ch->is_probe ? &ch->hdr->down : &ch->hdr->up;
+    char* slots = ch->is_probe ? ch->slots_down : ch->slots_up;
+    size_t slot_size = ch->is_probe ? ch->hdr->slot_size_down : ch->hdr->slot_size_up;
+    atomic_int* peer_closed = ch->is_probe ? &ch->hdr->processor_closed : &ch->hdr->probe_closed;
+    size_t len = iov_total(iov, iovcnt);
+    if (len > slot_size) {
+        fprintf(stderr, "Frame of %zu bytes does not fit in shared-memory slot\n", len);
+        return 1;
+    }
+
+    // Wait for filled slot (other side may close after sending its last frame,
+    // so check ring again after seeing closed flag)
+    unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    int spins = 0;
+    while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+        if (atomic_load_explicit(peer_closed, memory_order_acquire)) {
+            if (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+                return 1;
+            }
+            break;
+        }
+        shm_wait(ch, &spins);
+    }
+
+    // Read frame and release slot
+    const char* slot = slots + (tail % ch->hdr->capacity) * slot_size;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(iov[i].iov_base, slot, iov[i].iov_len);
+        slot += iov[i].iov_len;
+    }
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return 0;
+}
+
+
+// Number of frames waiting to be received
+unsigned long shm_pending(struct ShmChannel* ch) {
+
+    struct ShmRing* ring = ch->is_probe ? &ch->hdr->down : &ch->hdr->up;
+    unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    return atomic_load_explicit(&ring->head, memory_order_acquire) - tail;
+}
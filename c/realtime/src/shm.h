@@ -0,0 +1,112 @@
+/* Header file for shared-memory transport */
+
+
+#ifndef _SHM_H
+#define _SHM_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+
+
+/* Shared-memory channel
+ *
+ * When probe and processor run on the same machine, they can exchange frames
+ * through a shared-memory segment (/dev/shm/realtime-<port>) instead of a TCP
+ * socket. The segment holds two single-producer, single-consumer lock-free
+ * rings of fixed-size slots: one carrying spike frames from probe to
+ * processor, and one carrying predictions back. Neither side makes a system
+ * call per frame: a waiting side spins on the ring indices, and, unless busy
+ * polling was requested, yields its CPU when the wait gets long.
+ *
+ * The probe creates the segment (it knows the number of neurons, which sets
+ * the slot size) and waits for the processor to attach and acknowledge it.
+ */
+
+// Indices of a ring (each on its own cache line, since they are written by
+// different processes)
+struct ShmRing {
+
+    // Number of slots written by producer
+    _Alignas(64) atomic_ulong head;
+
+    // Number of slots read by consumer
+    _Alignas(64) atomic_ulong tail;
+};
+
+// Header at start of shared-memory segment
+struct ShmHeader {
+
+    // Magic number and layout version
+    unsigned int magic;
+    unsigned int version;
+
+    // Number of neurons (set by probe)
+    int n_neurons;
+
+    // Number of slots in each ring
+    int capacity;
+
+    // Size of a slot in the probe-to-processor and processor-to-probe rings
+    int slot_size_up;
+    int slot_size_down;
+
+    // Connection state (see SHM_STATE_* in shm.c)
+    atomic_int state;
+
+    // Flags set when either side disconnects
+    atomic_int probe_closed;
+    atomic_int processor_closed;
+
+    // Probe-to-processor ring
+    struct ShmRing up;
+
+    // Processor-to-probe ring
+    struct ShmRing down;
+};
+
+// One side of a shared-memory channel
+struct ShmChannel {
+
+    // Mapped segment
+    struct ShmHeader* hdr;
+    size_t map_size;
+
+    // Slots of rings
+    char* slots_up;
+    char* slots_down;
+
+    // 1 for the probe side, 0 for the processor side
+    int is_probe;
+
+    // 1 to spin without ever yielding while waiting, 0 to yield after a while
+    int busy_poll;
+};
+
+// Create segment with rings whose slots hold up to slot_size_up bytes (probe
+// to processor) and slot_size_down bytes (processor to probe), and wait for
+// processor to attach (probe side); returns 0 on success
+int shm_create(int port, int n_neurons, size_t slot_size_up, size_t slot_size_down,
+    int busy_poll, struct ShmChannel* ch);
+
+// Wait for probe to create segment and attach to it (processor side); returns
+// 0 on success
+int shm_attach(int port, int busy_poll, struct ShmChannel* ch);
+
+// Mark this side as closed and unmap segment
+void shm_close(struct ShmChannel* ch);
+
+// Send frame gathered from iovcnt buffers (like writev()) to other side;
+// returns 0 on success, 1 if the other side has closed
+int shm_send(struct ShmChannel* ch, const struct iovec* iov, int iovcnt);
+
+// Receive frame from other side, scattering it into iovcnt buffers (like
+// readv()); returns 0 on success, 1 if the other side has closed and no frames
+// are left
+int shm_recv(struct ShmChannel* ch, const struct iovec* iov, int iovcnt);
+
+// Number of frames waiting to be received
+unsigned long shm_pending(struct ShmChannel* ch);
+
+
+#endif
@@ -0,0 +1,183 @@
+/* Timing */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "timing.h"
+
+#ifdef TIMING_HAVE_TSC
+#include <cpuid.h>
+#endif
+
+
+// Time over which the TSC rate is calibrated (nanoseconds)
+#define TSC_CALIBRATION_NS 20000000
+
+
+int timing_use_tsc = 0;
+double timing_ns_per_tick = 1.0;
+
+
+// Read CLOCK_MONOTONIC (nanoseconds)
+static uint64_t monotonic_ns(void) {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+// Select clock
+int timing_init(int use_tsc) {
+
+    timing_use_tsc = 0;
+    timing_ns_per_tick = 1.0;
+    if (!use_tsc) {
+        return 0;
+    }
+
+#ifdef TIMING_HAVE_TSC
+    // Invariant TSC runs at a constant rate in every power state
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8))) {
+        fprintf(stderr, "CPU has no invariant TSC, using CLOCK_MONOTONIC\n");
+        return 1;
+    }
+
+    // Calibrate TSC rate against CLOCK_MONOTONIC
+    uint64_t t0 = monotonic_ns();
+    uint64_t c0 = __rdtsc();
+    uint64_t t1;
+    while ((t1 = monotonic_ns()) - t0 < TSC_CALIBRATION_NS) {
+        continue;
+    }
+    uint64_t c1 = __rdtsc();
+    timing_ns_per_tick = (double) (t1 - t0) / (double) (c1 - c0);
+    timing_use_tsc = 1;
+    return 0;
+#else
+    fprintf(stderr, "TSC not supported on this architecture, using CLOCK_MONOTONIC\n");
+    return 1;
+#endif
+}
+
+
+// Name of clock in use
+const char* timing_clock_name(void) {
+
+    return timing_use_tsc ? "TSC" : "CLOCK_MONOTONIC";
+}
+
+
+// Bucket that value falls in
+static int hist_bucket(uint64_t v) {
+
+    if (v < (1u << HIST_SUB_BITS)) {
+        return (int) v;
+    }
+
+    // Top HIST_SUB_BITS bits of value select the bucket within its octave
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - (HIST_SUB_BITS - 1);
+    int bucket = (1 << HIST_SUB_BITS) + (shift - 1) * (1 << (HIST_SUB_BITS - 1))
+        + (int) ((v >> shift) - (1u << (HIST_SUB_BITS - 1)));
+
+    return (bucket < HIST_N_BUCKETS) ? bucket : HIST_N_BUCKETS - 1;
+}
+
+
+// Smallest value that falls in bucket
+uint64_t Histogram_bucket_value(int bucket) {
+
+    if (bucket < (1 << HIST_SUB_BITS)) {
+        return (uint64_t) bucket;
+    }
+
+    int rel = bucket - (1 << HIST_SUB_BITS);
+    int shift = rel / (1 << (HIST_SUB_BITS - 1)) + 1;
+    uint64_t mantissa = rel % (1 << (HIST_SUB_BITS - 1)) + (1u << (HIST_SUB_BITS - 1));
+
+    return mantissa << shift;
+}
+
+
+// Empty histogram
+void Histogram_reset(struct Histogram* hist) {
+
+    memset(hist->counts, 0, sizeof(hist->counts));
+    hist->n = 0;
+    hist->min = UINT64_MAX;
+    hist->max = 0;
+    hist->sum = 0.0;
+}
+
+
+// Record value
+void Histogram_record(struct Histogram* hist, uint64_t value_ns) {
+
+    hist->counts[hist_bucket(value_ns)]++;
+    hist->n++;
+    hist->sum += (double) value_ns;
+    if (value_ns < hist->min) {
+        hist->min = value_ns;
+    }
+    if (value_ns > hist->max) {
+        hist->max = value_ns;
+    }
+}
+
+
+// Mean of values recorded
+double Histogram_mean(const struct Histogram* hist) {
+
+    return (hist->n > 0) ? hist->sum / hist->n : 0.0;
+}
+
+
+// Value below which the given fraction of recorded values fall
+uint64_t Histogram_percentile(const struct Histogram* hist, double frac) {
+
+    if (hist->n == 0) {
+        return 0;
+    }
+
+    // Walk buckets until enough values have been seen, and report the bucket
+    // (clamped to the range of recorded values)
+    uint64_t target = (uint64_t) (frac * hist->n + 0.5);
+    if (target < 1) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_N_BUCKETS; b++) {
+        seen += hist->counts[b];
+        if (seen >= target) {
+            uint64_t v = Histogram_bucket_value(b);
+            if (v < hist->min) {
+                v = hist->min;
+            }
+            if (v > hist->max) {
+                v = hist->max;
+            }
+            return v;
+        }
+    }
+
+    return hist->max;
+}
+
+
+// Print one-line summary of histogram
+void Histogram_print(const struct Histogram* hist, const char* name) {
+
+    if (hist->n == 0) {
+        printf("  %-10s (no samples)\n", name);
+        return;
+    }
+
+    printf("  %-10s mean %9.2f  p50 %9.2f  p99 %9.2f  p99.9 %9.2f  max %9.2f us\n", name,
+        Histogram_mean(hist) / 1e3,
+        Histogram_percentile(hist, 0.5) / 1e3,
+        Histogram_percentile(hist, 0.99) / 1e3,
+        Histogram_percentile(hist, 0.999) / 1e3,
+        hist->max / 1e3);
+}
@@ -0,0 +1,116 @@
+/* Header file for timing */
+
+
+#ifndef _TIMING_H
+#define _TIMING_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TIMING_HAVE_TSC
+#endif
+
+
+/* Clock
+ *
+ * Hot-path timestamps come from timing_now(), which reads CLOCK_MONOTONIC by
+ * default (immune to wall-clock jumps, nanosecond resolution, about 20 ns per
+ * read through the vDSO). If timing_init() is asked for the TSC and the CPU
+ * has an invariant TSC, timing_now() reads the time-stamp counter instead,
+ * which is cheaper still; ticks are converted to nanoseconds with a rate
+ * calibrated against CLOCK_MONOTONIC. Only differences between timestamps are
+ * meaningful, and TSC timestamps should not be compared across machines.
+ */
+
+// 1 if timing_now() reads the TSC
+extern int timing_use_tsc;
+
+// Nanoseconds per tick of timing_now()
+extern double timing_ns_per_tick;
+
+// Select clock (TSC if use_tsc is 1 and the CPU has an invariant TSC,
+// otherwise CLOCK_MONOTONIC); returns 0 if the requested clock is in use
+int timing_init(int use_tsc);
+
+// Name of clock in use
+const char* timing_clock_name(void);
+
+// Current time in ticks
+static inline uint64_t timing_now(void) {
+
+#ifdef TIMING_HAVE_TSC
+    if (timing_use_tsc) {
+        return __rdtsc();
+    }
+#endif
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Convert difference between timestamps to nanoseconds
+static inline uint64_t timing_ns(uint64_t ticks) {
+
+    return (uint64_t) (ticks * timing_ns_per_tick);
+}
+
+
+/* Latency histogram
+ *
+ * Fixed-size log-linear histogram in the style of HdrHistogram: values below
+ * 2^HIST_SUB_BITS ns get a bucket each, and every power-of-two range above
+ * that is split into 2^(HIST_SUB_BITS - 1) equal buckets, so any recorded
+ * value is known to within 1/64 (1.6%) of itself. Values up to 2^HIST_MAX_BITS
+ * ns (about 18 minutes) are tracked; larger values land in the last bucket.
+ * Recording a value is a handful of integer operations and never allocates,
+ * so histograms can be updated on every frame of the hot path.
+ */
+
+// Number of bits of precision of each bucket
+#define HIST_SUB_BITS 7
+
+// Values tracked are below 2^HIST_MAX_BITS ns
+#define HIST_MAX_BITS 40
+
+// Number of buckets
+#define HIST_N_BUCKETS ((1 << HIST_SUB_BITS) + (HIST_MAX_BITS - HIST_SUB_BITS) * (1 << (HIST_SUB_BITS - 1)))
+
+// Histogram of latencies (nanoseconds)
+struct Histogram {
+
+    // Number of values in each bucket
+    uint64_t counts[HIST_N_BUCKETS];
+
+    // Number of values recorded
+    uint64_t n;
+
+    // Smallest and largest values recorded
+    uint64_t min;
+    uint64_t max;
+
+    // Sum of values recorded (for mean)
+    double sum;
+};
+
+// Empty histogram
+void Histogram_reset(struct Histogram* hist);
+
+// Record value (nanoseconds)
+void Histogram_record(struct Histogram* hist, uint64_t value_ns);
+
+// Smallest value that falls in bucket
+uint64_t Histogram_bucket_value(int bucket);
+
+// Mean of values recorded (nanoseconds)
+double Histogram_mean(const struct Histogram* hist);
+
+// Value below which the given fraction of recorded values fall (nanoseconds)
+uint64_t Histogram_percentile(const struct Histogram* hist, double frac);
+
+// Print one-line summary of histogram (microseconds)
+void Histogram_print(const struct Histogram* hist, const char* name);
+
+
+#endif
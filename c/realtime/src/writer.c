@@ -0,0 +1,243 @@
+/* Background result writer */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "writer.h"
+#include "reader.h"
+
+
+// Target size of queue (bytes of predictions)
+#define WRITER_QUEUE_BYTES (16 << 20)
+
+// Smallest number of rows in queue
+#define WRITER_MIN_ROWS 64
+
+// Number of rows per HDF5 chunk
+#define WRITER_CHUNK_ROWS 256
+
+// Time background thread sleeps when queue is empty (microseconds)
+#define WRITER_POLL_US 1000
+
+
+// Create extendable dataset with given number of columns (0 for 1-D)
+static hid_t writer_create_dataset(struct ResultWriter* wr, const char* name, hid_t type,
+    int n_cols, int compress_level) {
+
+    int rank = (n_cols > 0) ? 2 : 1;
+    hsize_t dims[2] = {0, (hsize_t) n_cols};
+    hsize_t max_dims[2] = {H5S_UNLIMITED, (hsize_t) n_cols};
+    hsize_t chunk[2] = {WRITER_CHUNK_ROWS, (hsize_t) n_cols};
+
+    hid_t dspace = H5Screate_simple(rank, dims, max_dims);
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, rank, chunk);
+    if (compress_level > 0) {
+        H5Pset_deflate(dcpl, compress_level);
+    }
+    hid_t dset = H5Dcreate(wr->file, name, type, dspace, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Pclose(dcpl);
+    H5Sclose(dspace);
+
+    return dset;
+}
+
+
+// Append rows to dataset (n_cols of 0 for 1-D)
+static int writer_append(hid_t dset, hid_t mem_type, int n_cols, long row0, long n_rows, const void* data) {
+
+    int rank = (n_cols > 0) ? 2 : 1;
+    hsize_t new_dims[2] = {(hsize_t) (row0 + n_rows), (hsize_t) n_cols};
+    hsize_t start[2] = {(hsize_t) row0, 0};
+    hsize_t count[2] = {(hsize_t) n_rows, (hsize_t) n_cols};
+
+    if (H5Dset_extent(dset, new_dims) < 0) {
+        return 1;
+    }
+    hid_t fspace = H5Dget_space(dset);
+    H5Sselect_hyperslab(fspace, H5S_SELECT_SET, start, NULL, count, NULL);
+    hid_t mspace = H5Screate_simple(rank, count, NULL);
+    herr_t status = H5Dwrite(dset, mem_type, mspace, fspace, H5P_DEFAULT, data);
+    H5Sclose(mspace);
+    H5Sclose(fspace);
+
+    return (status < 0) ? 1 : 0;
+}
+
+
+// Write rows [start, start + n) of queue storage to file
+static int writer_write_rows(struct ResultWriter* wr, long start, long n) {
+
+    pthread_mutex_lock(&hdf5_lock);
+    int status = writer_append(wr->dset_preds, H5T_NATIVE_DOUBLE, wr->n_neurons, wr->n_written, n,
+        wr->preds + start * wr->n_neurons);
+    status |= writer_append(wr->dset_rt, H5T_NATIVE_DOUBLE, 0, wr->n_written, n, wr->rt_us + start);
+    status |= writer_append(wr->dset_idx, H5T_NATIVE_LONG, 0, wr->n_written, n, wr->frame_idx + start);
+    pthread_mutex_unlock(&hdf5_lock);
+
+    wr->n_written += n;
+    return status;
+}
+
+
+// Main loop of background thread
+static void* writer_run(void* arg) {
+
+    struct ResultWriter* wr = (struct ResultWriter*) arg;
+    long tail = 0;
+
+    while (1) {
+
+        // Check stop flag before queue, so rows committed before the flag was
+        // set are always written
+        int stop = atomic_load_explicit(&wr->stop, memory_order_acquire);
+        long head = atomic_load_explicit(&wr->head, memory_order_acquire);
+        if (head == tail) {
+            if (stop) {
+                break;
+            }
+            struct timespec ts = {0, WRITER_POLL_US * 1000};
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        // Write contiguous run of rows (up to end of queue storage)
+        long start = tail % wr->capacity;
+        long n = head - tail;
+        if (n > wr->capacity - start) {
+            n = wr->capacity - start;
+        }
+        if (writer_write_rows(wr, start, n) != 0 && !wr->error) {
+            fprintf(stderr, "Failed to write output data\n");
+            wr->error = 1;
+        }
+        tail += n;
+        atomic_store_explicit(&wr->tail, tail, memory_order_release);
+    }
+
+    return NULL;
+}
+
+
+// Create output file and start background thread
+int ResultWriter_open(struct ResultWriter* wr, const char* path, int n_neurons, int compress_level) {
+
+    if (compress_level > 0 && !H5Zfilter_avail(H5Z_FILTER_DEFLATE)) {
+        fprintf(stderr, "HDF5 library has no deflate filter, writing uncompressed data\n");
+        compress_level = 0;
+    }
+
+    // Create file and datasets
+    pthread_mutex_lock(&hdf5_lock);
+    wr->file = H5Fcreate(path, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (wr->file < 0) {
+        pthread_mutex_unlock(&hdf5_lock);
+        fprintf(stderr, "Cannot create '%s'\n", path);
+        return 1;
+    }
+    wr->dset_preds = writer_create_dataset(wr, "filter_preds", H5T_IEEE_F64LE, n_neurons, compress_level);
+    wr->dset_rt = writer_create_dataset(wr, "rt_times_us", H5T_IEEE_F64LE, 0, compress_level);
+    wr->dset_idx = writer_create_dataset(wr, "frame_idx", H5T_STD_I64LE, 0, compress_level);
+    pthread_mutex_unlock(&hdf5_lock);
+
+    // Allocate queue
+    wr->n_neurons = n_neurons;
+    wr->capacity = WRITER_QUEUE_BYTES / ((long) n_neurons * sizeof(double));
+    if (wr->capacity < WRITER_MIN_ROWS) {
+        wr->capacity = WRITER_MIN_ROWS;
+    }
+    wr->preds = (double *) malloc(wr->capacity * n_neurons * sizeof(double));
+    wr->rt_us = (double *) malloc(wr->capacity * sizeof(double));
+    wr->frame_idx = (long *) malloc(wr->capacity * sizeof(long));
+
+    // Populate remaining fields
+    atomic_init(&wr->head, 0);
+    atomic_init(&wr->tail, 0);
+    atomic_init(&wr->stop, 0);
+    wr->n_written = 0;
+    wr->n_dropped = 0;
+    wr->error = 0;
+
+    // Start background thread
+    if (pthread_create(&wr->thread, NULL, writer_run, wr) != 0) {
+        perror("Could not create writer thread");
+        ResultWriter_close(wr);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// Next free row of queue, or NULL if queue is full
+static double* writer_next_row(struct ResultWriter* wr) {
+
+    long head = atomic_load_explicit(&wr->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&wr->tail, memory_order_acquire) >= wr->capacity) {
+        return NULL;
+    }
+
+    return wr->preds + (head % wr->capacity) * wr->n_neurons;
+}
+
+
+// Reserve next row of queue
+double* ResultWriter_reserve(struct ResultWriter* wr) {
+
+    double* row = writer_next_row(wr);
+    if (row == NULL) {
+        wr->n_dropped++;
+    }
+
+    return row;
+}
+
+
+// Reserve next row of queue, waiting for room
+double* ResultWriter_reserve_wait(struct ResultWriter* wr) {
+
+    double* row;
+    while ((row = writer_next_row(wr)) == NULL) {
+        struct timespec ts = {0, WRITER_POLL_US * 1000};
+        nanosleep(&ts, NULL);
+    }
+
+    return row;
+}
+
+
+// Commit reserved row
+void ResultWriter_commit(struct ResultWriter* wr, long frame_idx, double rt_us) {
+
+    long head = atomic_load_explicit(&wr->head, memory_order_relaxed);
+    wr->rt_us[head % wr->capacity] = rt_us;
+    wr->frame_idx[head % wr->capacity] = frame_idx;
+    atomic_store_explicit(&wr->head, head + 1, memory_order_release);
+}
+
+
+// Write remaining rows and stop background thread
+int ResultWriter_finish(struct ResultWriter* wr) {
+
+    atomic_store_explicit(&wr->stop, 1, memory_order_release);
+    pthread_join(wr->thread, NULL);
+
+    return wr->error;
+}
+
+
+// Close output file and free memory
+void ResultWriter_close(struct ResultWriter* wr) {
+
+    pthread_mutex_lock(&hdf5_lock);
+    H5Dclose(wr->dset_idx);
+    H5Dclose(wr->dset_rt);
+    H5Dclose(wr->dset_preds);
+    H5Fclose(wr->file);
+    pthread_mutex_unlock(&hdf5_lock);
+
+    free(wr->preds);
+    free(wr->rt_us);
+    free(wr->frame_idx);
+}
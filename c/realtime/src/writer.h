@@ -0,0 +1,92 @@
+/* Header file for background result writer */
+
+
+#ifndef _WRITER_H
+#define _WRITER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "hdf5.h"
+
+
+/* Background writer
+ *
+ * Appends results to an HDF5 file while the probe is running, so that memory
+ * use stays flat on long runs and a crash loses at most the rows still in
+ * flight. The thread receiving predictions reserves a row in a lock-free
+ * single-producer, single-consumer queue, receives the predictions straight
+ * into it, and commits it with the frame index and round-trip time. A
+ * background thread moves committed rows into chunked, extendable datasets
+ * ('filter_preds', 'rt_times_us' and 'frame_idx'), optionally compressed with
+ * deflate.
+ *
+ * The probe never blocks: if the queue is full, ResultWriter_reserve()
+ * returns NULL, and the row is dropped and counted (offline callers use
+ * ResultWriter_reserve_wait() instead). Rows are written in the
+ * order they were committed; 'frame_idx' says which frame each row belongs to,
+ * so frames that were never answered, or whose rows were dropped, show up as
+ * gaps.
+ */
+struct ResultWriter {
+
+    // Output file and datasets
+    hid_t file;
+    hid_t dset_preds;
+    hid_t dset_rt;
+    hid_t dset_idx;
+
+    // Number of neurons (length of each row of predictions)
+    int n_neurons;
+
+    // Number of rows in queue
+    long capacity;
+
+    // Queue storage: predictions, round-trip times and frame indices of each
+    // row
+    double* preds;
+    double* rt_us;
+    long* frame_idx;
+
+    // Number of rows committed by producer and number written by background
+    // thread (each on its own cache line)
+    _Alignas(64) atomic_long head;
+    _Alignas(64) atomic_long tail;
+
+    // Number of rows written to file (background thread only)
+    long n_written;
+
+    // Number of rows dropped because queue was full (producer only)
+    long n_dropped;
+
+    // Background thread, flag telling it to finish, and error flag
+    pthread_t thread;
+    atomic_int stop;
+    int error;
+};
+
+// Create output file and start background thread; compress_level is the
+// deflate level (0 for no compression); returns 0 on success
+int ResultWriter_open(struct ResultWriter* wr, const char* path, int n_neurons, int compress_level);
+
+// Reserve next row of queue, to be filled with n_neurons predictions and
+// committed; returns NULL if the queue is full (the caller should then use
+// its own buffer and skip the commit, and the row counts as dropped)
+double* ResultWriter_reserve(struct ResultWriter* wr);
+
+// Reserve next row of queue, waiting for the background thread to make room
+// if the queue is full (for offline use, where no row may be dropped)
+double* ResultWriter_reserve_wait(struct ResultWriter* wr);
+
+// Commit row returned by last call to ResultWriter_reserve()
+void ResultWriter_commit(struct ResultWriter* wr, long frame_idx, double rt_us);
+
+// Write remaining rows and stop background thread (file stays open, so that
+// the caller can add datasets to it); returns 0 if every write succeeded
+int ResultWriter_finish(struct ResultWriter* wr);
+
+// Close output file and free memory
+void ResultWriter_close(struct ResultWriter* wr);
+
+
+#endif